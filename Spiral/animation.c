@@ -0,0 +1,144 @@
+#include <math.h>
+
+#include "animation.h"
+
+/*
+ * The vectorised kernels are only built for x86 using GCC, since they rely on
+ * #pragma GCC target to enable instruction sets per kernel.
+ */
+#if defined(__GNUC__) && !defined(__clang__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define ANIMATION_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * A function evaluating a sine wave, as described for animation_sine.
+ */
+typedef void
+(*AnimationSineKernel)(float base, const float *phase, float scale,
+    float offset, float *out, unsigned int count);
+
+/*
+ * Portable; 1 element per iteration
+ */
+#define KERNEL_NAME animation_sine_float
+#define W 1
+#define VF float
+#define F_SET1(a) ((float)(a))
+#define F_LOADU(p) (*(p))
+#define F_STOREU(p, v) (*(p) = (v))
+#define F_ADD(a, b) ((a) + (b))
+#define F_SUB(a, b) ((a) - (b))
+#define F_MUL(a, b) ((a) * (b))
+#define F_MADD(a, b, c) ((a) * (b) + (c))
+#define F_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define F_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define F_ROUND(a) ((float)(int)((a) + 0.5f))
+#include "animation_simd.inc"
+
+#ifdef ANIMATION_SIMD
+
+/*
+ * SSE2; 4 elements per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#define KERNEL_NAME animation_sine_sse2
+#define W 4
+#define VF __m128
+#define F_SET1(a) _mm_set1_ps(a)
+#define F_LOADU(p) _mm_loadu_ps(p)
+#define F_STOREU(p, v) _mm_storeu_ps(p, v)
+#define F_ADD(a, b) _mm_add_ps(a, b)
+#define F_SUB(a, b) _mm_sub_ps(a, b)
+#define F_MUL(a, b) _mm_mul_ps(a, b)
+#define F_MADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define F_MIN(a, b) _mm_min_ps(a, b)
+#define F_MAX(a, b) _mm_max_ps(a, b)
+#define F_ROUND(a) _mm_cvtepi32_ps(_mm_cvtps_epi32(a))
+#include "animation_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX2 and FMA; 8 elements per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+#define KERNEL_NAME animation_sine_avx2
+#define W 8
+#define VF __m256
+#define F_SET1(a) _mm256_set1_ps(a)
+#define F_LOADU(p) _mm256_loadu_ps(p)
+#define F_STOREU(p, v) _mm256_storeu_ps(p, v)
+#define F_ADD(a, b) _mm256_add_ps(a, b)
+#define F_SUB(a, b) _mm256_sub_ps(a, b)
+#define F_MUL(a, b) _mm256_mul_ps(a, b)
+#define F_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#define F_MIN(a, b) _mm256_min_ps(a, b)
+#define F_MAX(a, b) _mm256_max_ps(a, b)
+#define F_ROUND(a) _mm256_round_ps(a, \
+    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#include "animation_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512; 16 elements per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define KERNEL_NAME animation_sine_avx512
+#define W 16
+#define VF __m512
+#define F_SET1(a) _mm512_set1_ps(a)
+#define F_LOADU(p) _mm512_loadu_ps(p)
+#define F_STOREU(p, v) _mm512_storeu_ps(p, v)
+#define F_ADD(a, b) _mm512_add_ps(a, b)
+#define F_SUB(a, b) _mm512_sub_ps(a, b)
+#define F_MUL(a, b) _mm512_mul_ps(a, b)
+#define F_MADD(a, b, c) _mm512_fmadd_ps(a, b, c)
+#define F_MIN(a, b) _mm512_min_ps(a, b)
+#define F_MAX(a, b) _mm512_max_ps(a, b)
+#define F_ROUND(a) _mm512_roundscale_ps(a, \
+    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#include "animation_simd.inc"
+
+#pragma GCC pop_options
+
+#endif
+
+/**
+ * Selects the fastest kernel supported by the CPU.
+ *
+ * @return the kernel
+ */
+static AnimationSineKernel
+animation_sine_kernel(void)
+{
+#ifdef ANIMATION_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return animation_sine_avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return animation_sine_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return animation_sine_sse2;
+    }
+#endif
+
+    return animation_sine_float;
+}
+
+void
+animation_sine(float base, const float *phase, float scale, float offset,
+    float *out, unsigned int count)
+{
+    animation_sine_kernel()(base, phase, scale, offset, out, count);
+}
@@ -0,0 +1,439 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+/**
+ * The suffix of the names of entry files.
+ */
+#define CACHE_SUFFIX ".cache"
+
+/**
+ * The template appended to the name of an entry file to create the temporary
+ * file it is written to.
+ */
+#define CACHE_TEMPORARY_SUFFIX ".XXXXXX"
+
+/**
+ * The identifier at the start of every entry file; this must be changed if
+ * the format of the files changes.
+ */
+static const char cache_magic[8] = "SPCACHE1";
+
+/**
+ * The header of an entry file, which is followed by the key and the data.
+ */
+typedef struct {
+    /** The value of cache_magic */
+    char magic[8];
+
+    /** The size of the key */
+    uint64_t key_size;
+
+    /** The size of the data */
+    uint64_t data_size;
+} CacheHeader;
+
+struct Cache {
+    /** The directory containing the entries */
+    char *directory;
+
+    /** The maximum total size of all entries */
+    size_t limit;
+};
+
+struct CacheEntry {
+    /** The mapped file */
+    void *mapping;
+
+    /** The size of the mapped file */
+    size_t length;
+
+    /** The data, which points into mapping */
+    const void *data;
+
+    /** The size of the data */
+    size_t size;
+};
+
+/**
+ * An entry file found when removing old entries.
+ */
+typedef struct {
+    /** The name of the file */
+    char *name;
+
+    /** The time the entry was last used */
+    struct timespec used;
+
+    /** The size of the file */
+    size_t size;
+} CacheFile;
+
+/**
+ * Writes the path of the file of an entry.
+ *
+ * The name of the file is the 64 bit FNV-1a hash of the key.
+ *
+ * @param self
+ *     The cache.
+ * @param key, key_size
+ *     The key of the entry.
+ * @param suffix
+ *     A string appended to the path.
+ * @return the path, which must be freed, or NULL if memory could not be
+ *     allocated
+ */
+static char*
+cache_path(Cache *self, const void *key, size_t key_size, const char *suffix)
+{
+    const unsigned char *k = key;
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i, length;
+    char *path;
+
+    for (i = 0; i < key_size; i++) {
+        hash = (hash ^ k[i]) * 1099511628211ULL;
+    }
+
+    length = strlen(self->directory) + 1 + 16 + strlen(CACHE_SUFFIX)
+        + strlen(suffix) + 1;
+    path = malloc(length);
+    if (path) {
+        snprintf(path, length, "%s/%016llx%s%s", self->directory,
+            (unsigned long long)hash, CACHE_SUFFIX, suffix);
+    }
+
+    return path;
+}
+
+/**
+ * Writes a buffer to a file, retrying after partial writes.
+ *
+ * @param fd
+ *     The file descriptor.
+ * @param data, size
+ *     The buffer.
+ * @return non-zero if the buffer was written and 0 otherwise
+ */
+static int
+cache_write(int fd, const void *data, size_t size)
+{
+    const char *d = data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, d, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        d += written;
+        size -= written;
+    }
+
+    return 1;
+}
+
+/**
+ * Determines whether a file of the cache directory is an entry file, or a
+ * temporary file of an entry.
+ *
+ * A temporary file is left behind if a process is terminated while writing
+ * it, so temporary files count towards the limit and are removed like
+ * entries; one still being written is the most recent file, and is removed
+ * last.
+ *
+ * @param name
+ *     The name of the file.
+ * @return non-zero if the file belongs to the cache and 0 otherwise
+ */
+static int
+cache_is_file(const char *name)
+{
+    const char *suffix = strstr(name, CACHE_SUFFIX);
+
+    if (!suffix || suffix == name) {
+        return 0;
+    }
+    suffix += strlen(CACHE_SUFFIX);
+
+    return *suffix == '\0'
+        || (*suffix == '.'
+            && strlen(suffix) == strlen(CACHE_TEMPORARY_SUFFIX));
+}
+
+/**
+ * Orders entry files by the time they were last used, oldest first.
+ */
+static int
+cache_file_compare(const void *a, const void *b)
+{
+    const CacheFile *fa = a;
+    const CacheFile *fb = b;
+
+    if (fa->used.tv_sec != fb->used.tv_sec) {
+        return fa->used.tv_sec < fb->used.tv_sec ? -1 : 1;
+    }
+    if (fa->used.tv_nsec != fb->used.tv_nsec) {
+        return fa->used.tv_nsec < fb->used.tv_nsec ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Removes the least recently used entries until the total size of the
+ * entries is within the limit.
+ *
+ * The time an entry was last used is the modification time of its file.
+ * Temporary files are included, as described for cache_is_file.
+ *
+ * @param self
+ *     The cache.
+ */
+static void
+cache_evict(Cache *self)
+{
+    DIR *dir;
+    struct dirent *d;
+    CacheFile *files = NULL;
+    size_t count = 0, capacity = 0, total = 0, i;
+
+    dir = opendir(self->directory);
+    if (!dir) {
+        return;
+    }
+
+    while ((d = readdir(dir))) {
+        struct stat st;
+
+        if (!cache_is_file(d->d_name)
+                || fstatat(dirfd(dir), d->d_name, &st, 0) != 0
+                || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        if (count == capacity) {
+            CacheFile *f;
+
+            capacity = capacity ? 2 * capacity : 16;
+            f = realloc(files, sizeof(*files) * capacity);
+            if (!f) {
+                break;
+            }
+            files = f;
+        }
+        files[count].name = strdup(d->d_name);
+        if (!files[count].name) {
+            break;
+        }
+        files[count].used = st.st_mtim;
+        files[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+
+    /* Another process may already have removed a file, which is fine */
+    qsort(files, count, sizeof(*files), cache_file_compare);
+    for (i = 0; i < count && total > self->limit; i++) {
+        unlinkat(dirfd(dir), files[i].name, 0);
+        total -= files[i].size;
+    }
+
+    for (i = 0; i < count; i++) {
+        free(files[i].name);
+    }
+    free(files);
+    closedir(dir);
+}
+
+Cache*
+cache_create(const char *directory, size_t limit)
+{
+    Cache *self;
+
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create cache directory %s: %s\n", directory,
+            strerror(errno));
+        return NULL;
+    }
+
+    self = malloc(sizeof(*self));
+    if (!self) {
+        fprintf(stderr, "Unable to allocate cache.\n");
+        return NULL;
+    }
+
+    self->directory = strdup(directory);
+    if (!self->directory) {
+        fprintf(stderr, "Unable to allocate cache.\n");
+        free(self);
+        return NULL;
+    }
+    self->limit = limit;
+
+    return self;
+}
+
+CacheEntry*
+cache_get(Cache *self, const void *key, size_t key_size)
+{
+    CacheEntry *entry;
+    CacheHeader header;
+    struct stat st;
+    char *path;
+    int fd;
+
+    if (!self) {
+        return NULL;
+    }
+
+    path = cache_path(self, key, key_size, "");
+    if (!path) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    entry = malloc(sizeof(*entry));
+    if (!entry || fstat(fd, &st) != 0 || st.st_size < sizeof(header)) {
+        free(entry);
+        close(fd);
+        return NULL;
+    }
+
+    entry->length = st.st_size;
+    entry->mapping = mmap(NULL, entry->length, PROT_READ, MAP_SHARED, fd, 0);
+    if (entry->mapping == MAP_FAILED) {
+        free(entry);
+        close(fd);
+        return NULL;
+    }
+
+    /* Reject files from other versions, truncated files and files whose
+       name collides with that of the key */
+    memcpy(&header, entry->mapping, sizeof(header));
+    if (memcmp(header.magic, cache_magic, sizeof(header.magic)) != 0
+            || entry->length < sizeof(header) + key_size
+            || header.key_size != key_size
+            || header.data_size != entry->length - sizeof(header) - key_size
+            || memcmp((char*)entry->mapping + sizeof(header), key,
+                key_size) != 0) {
+        munmap(entry->mapping, entry->length);
+        free(entry);
+        close(fd);
+        return NULL;
+    }
+    entry->data = (char*)entry->mapping + sizeof(header) + key_size;
+    entry->size = header.data_size;
+
+    /* Mark the entry as recently used; this fails harmlessly if the file
+       belongs to another user */
+    futimens(fd, NULL);
+    close(fd);
+
+    return entry;
+}
+
+int
+cache_put(Cache *self, const void *key, size_t key_size, const void *data,
+    size_t size)
+{
+    CacheHeader header;
+    char *path, *temporary;
+    int fd, result;
+
+    if (!self) {
+        return 0;
+    }
+
+    path = cache_path(self, key, key_size, "");
+    temporary = cache_path(self, key, key_size, CACHE_TEMPORARY_SUFFIX);
+    if (!path || !temporary) {
+        free(path);
+        free(temporary);
+        return 0;
+    }
+
+    /* Write a temporary file that is renamed into place once it is complete,
+       so that other processes never see a partial entry */
+    memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.key_size = key_size;
+    header.data_size = size;
+    fd = mkstemp(temporary);
+    result = fd >= 0
+        && fchmod(fd, 0644) == 0
+        && cache_write(fd, &header, sizeof(header))
+        && cache_write(fd, key, key_size)
+        && cache_write(fd, data, size)
+        && fsync(fd) == 0;
+    if (fd >= 0) {
+        result = close(fd) == 0 && result;
+    }
+    result = result && rename(temporary, path) == 0;
+    if (!result) {
+        fprintf(stderr, "Unable to write cache entry %s: %s\n", path,
+            strerror(errno));
+        if (fd >= 0) {
+            unlink(temporary);
+        }
+    }
+
+    free(path);
+    free(temporary);
+
+    if (result) {
+        cache_evict(self);
+    }
+
+    return result;
+}
+
+void
+cache_free(Cache *self)
+{
+    if (!self) {
+        return;
+    }
+
+    free(self->directory);
+    free(self);
+}
+
+const void*
+cache_entry_get_data(CacheEntry *self)
+{
+    return self->data;
+}
+
+size_t
+cache_entry_get_size(CacheEntry *self)
+{
+    return self->size;
+}
+
+void
+cache_entry_free(CacheEntry *self)
+{
+    if (!self) {
+        return;
+    }
+
+    munmap(self->mapping, self->length);
+    free(self);
+}
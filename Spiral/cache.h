@@ -0,0 +1,115 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+/**
+ * A directory of files keyed by the contents of a key.
+ *
+ * Every entry is stored in a file named after a hash of its key, together
+ * with the key itself, so that hash collisions are detected. Entries are
+ * written to temporary files that are renamed into place, so several
+ * processes may use the same directory at once. When the total size of the
+ * entries exceeds the limit, the least recently used entries are removed.
+ */
+typedef struct Cache Cache;
+
+/**
+ * An entry read from a cache.
+ *
+ * The data is mapped into memory, and remains valid until the entry is freed,
+ * even if the file is replaced or removed.
+ */
+typedef struct CacheEntry CacheEntry;
+
+/**
+ * Opens a cache directory.
+ *
+ * All functions accept NULL in place of a cache and behave as if the cache
+ * were empty, so a cache that is disabled need not be checked by the caller.
+ *
+ * If this function returns successfully, cache_free must be called.
+ *
+ * @param directory
+ *     The directory containing the entries. It is created if it does not
+ *     exist, but its parent must exist.
+ * @param limit
+ *     The maximum total size, in bytes, of all entries.
+ * @return a new cache, or NULL if an error occurred
+ * @see cache_free
+ */
+Cache*
+cache_create(const char *directory, size_t limit);
+
+/**
+ * Looks up an entry.
+ *
+ * A found entry is marked as the most recently used one.
+ *
+ * @param self
+ *     The cache.
+ * @param key, key_size
+ *     The key of the entry.
+ * @return the entry, or NULL if it does not exist or is damaged
+ * @see cache_entry_free
+ */
+CacheEntry*
+cache_get(Cache *self, const void *key, size_t key_size);
+
+/**
+ * Stores an entry, replacing any entry with the same key.
+ *
+ * Least recently used entries are removed afterwards until the total size of
+ * the entries is within the limit.
+ *
+ * @param self
+ *     The cache.
+ * @param key, key_size
+ *     The key of the entry.
+ * @param data, size
+ *     The data to store.
+ * @return non-zero if the entry was stored and 0 otherwise
+ */
+int
+cache_put(Cache *self, const void *key, size_t key_size, const void *data,
+    size_t size);
+
+/**
+ * Releases the resources allocated by cache_create.
+ *
+ * @param self
+ *     The cache.
+ */
+void
+cache_free(Cache *self);
+
+/**
+ * Returns the data of an entry.
+ *
+ * @param self
+ *     The entry.
+ * @return the data, which is mapped read only
+ */
+const void*
+cache_entry_get_data(CacheEntry *self);
+
+/**
+ * Returns the size of the data of an entry.
+ *
+ * @param self
+ *     The entry.
+ * @return the size of the data in bytes
+ */
+size_t
+cache_entry_get_size(CacheEntry *self);
+
+/**
+ * Unmaps an entry, and releases the resources allocated by cache_get.
+ *
+ * @param self
+ *     The entry. If this is NULL, no action is taken.
+ */
+void
+cache_entry_free(CacheEntry *self);
+
+#endif
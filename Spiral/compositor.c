@@ -0,0 +1,876 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <para/para.h>
+
+#include "compositor.h"
+
+/* The loops blending and packing scan lines are written so that GCC can
+   vectorise them, but GCC only does so at -O2 from version 12; sampling the
+   spiral needs gathers, which it does not generate, so it has explicit
+   kernels below */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("tree-vectorize")
+#endif
+
+/*
+ * The vectorised kernels are only built for x86 using GCC, since they rely on
+ * #pragma GCC target to enable instruction sets per kernel.
+ */
+#if defined(__GNUC__) && !defined(__clang__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define COMPOSITOR_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * The number of scan lines for which the triangles of the mesh are collected
+ * at once.
+ */
+#define COMPOSITOR_BAND 16
+
+/**
+ * The smallest weight of the second level of detail that is sampled; a
+ * smaller weight changes no opacity by a whole level.
+ */
+#define COMPOSITOR_LOD_EPSILON (1.0 / 256.0)
+
+/**
+ * The smallest number of texels of a level of detail sampled by the
+ * vectorised kernels, which read the 32 bits around every texel.
+ */
+#define COMPOSITOR_GATHER_MIN 4
+
+/**
+ * A function sampling one level of detail of the spiral along a scan line,
+ * as described for compositor_spiral_row.
+ *
+ * @param data, width, height
+ *     The level of detail.
+ * @param u, ux, v, vx
+ *     The texel coordinates at the first pixel of the scan line, and their
+ *     gradients along it.
+ * @param weight
+ *     The factor applied to the texel values.
+ * @param accumulate
+ *     Whether to add to the opacities rather than overwrite them.
+ * @param opacity
+ *     The opacities of the scan line.
+ * @param first, count
+ *     The first pixel sampled, and one past the last.
+ */
+typedef void
+(*CompositorSampleKernel)(const unsigned char *data, int width, int height,
+    float u, float ux, float v, float vx, float weight, int accumulate,
+    float *opacity, int first, int count);
+
+/**
+ * A triangle of the mesh, prepared for drawing scan lines.
+ */
+typedef struct {
+    /** The vertices in pixels, sorted by y */
+    float x[3], y[3];
+
+    /** The red, green, blue and alpha values at the pixel (0, 0), and their
+        gradients along x and y */
+    float c[4], cx[4], cy[4];
+
+    /** The first and one past the last scan line covered */
+    int first, last;
+} CompositorTriangle;
+
+struct Compositor {
+    /** The dimensions of the frames */
+    unsigned int width, height;
+
+    /** The positions of the channels in a pixel */
+    unsigned int red_shift, green_shift, blue_shift, alpha_shift;
+
+    /** The context drawing scan lines */
+    ParaContext *para;
+
+    /** The frame being drawn, and its destination */
+    const CompositorFrame *frame;
+    unsigned char *pixels;
+    ptrdiff_t pitch;
+
+    /** The transformation from mesh positions to pixels */
+    float mesh_ax, mesh_bx, mesh_ay, mesh_by;
+
+    /** The lowest and highest y, in pixels, of every row of squares of the
+        mesh, and the number of rows they have room for */
+    float *mesh_low, *mesh_high;
+    unsigned int mesh_rows;
+
+    /** The texture coordinates of the spiral at the pixel (0, 0), and their
+        gradients along x and y; the texture extends from 0 to 1 */
+    double s0, sx, sy, t0, tx, ty;
+
+    /** The level of detail sampled, and the weight of the next level */
+    unsigned int level;
+    float level_weight;
+
+    /** The kernel sampling the spiral */
+    CompositorSampleKernel sample;
+};
+
+/**
+ * Prepares a triangle of the mesh.
+ *
+ * @param self
+ *     The compositor.
+ * @param t
+ *     The triangle to prepare.
+ * @param a, b, c
+ *     The indices of the vertices.
+ * @return non-zero if the triangle covers any pixel centre and 0 otherwise
+ */
+static int
+compositor_triangle_init(const Compositor *self, CompositorTriangle *t,
+    unsigned int a, unsigned int b, unsigned int c)
+{
+    const CompositorFrame *f = self->frame;
+    unsigned int index[3] = {a, b, c};
+    float values[3][4];
+    float dx1, dy1, dx2, dy2, det;
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+        t->x[i] = f->positions[2 * index[i]] * self->mesh_ax + self->mesh_bx;
+        t->y[i] = f->positions[2 * index[i] + 1] * self->mesh_ay
+            + self->mesh_by;
+        memcpy(values[i], f->colors + 4 * index[i], sizeof(values[i]));
+    }
+
+    /* Sort the vertices by y, so that an edge shared by two triangles is
+       always evaluated from the same end and covers the same pixels */
+    for (i = 0; i < 2; i++) {
+        for (j = 2; j > i; j--) {
+            if (t->y[j] < t->y[j - 1]) {
+                float x = t->x[j], y = t->y[j], v[4];
+
+                memcpy(v, values[j], sizeof(v));
+                t->x[j] = t->x[j - 1];
+                t->y[j] = t->y[j - 1];
+                memcpy(values[j], values[j - 1], sizeof(v));
+                t->x[j - 1] = x;
+                t->y[j - 1] = y;
+                memcpy(values[j - 1], v, sizeof(v));
+            }
+        }
+    }
+
+    /* Pixel centres on the lower edge are covered, and those on the upper
+       edge are not */
+    t->first = (int)ceilf(t->y[0] - 0.5f);
+    t->last = (int)ceilf(t->y[2] - 0.5f);
+    if (t->first < 0) {
+        t->first = 0;
+    }
+    if (t->last > (int)self->height) {
+        t->last = self->height;
+    }
+
+    dx1 = t->x[1] - t->x[0];
+    dy1 = t->y[1] - t->y[0];
+    dx2 = t->x[2] - t->x[0];
+    dy2 = t->y[2] - t->y[0];
+    det = dx1 * dy2 - dx2 * dy1;
+    if (t->first >= t->last || det == 0.0f) {
+        return 0;
+    }
+
+    for (i = 0; i < 4; i++) {
+        float dc1 = values[1][i] - values[0][i];
+        float dc2 = values[2][i] - values[0][i];
+
+        t->cx[i] = (dc1 * dy2 - dc2 * dy1) / det;
+        t->cy[i] = (dx1 * dc2 - dx2 * dc1) / det;
+        t->c[i] = values[0][i] - t->cx[i] * t->x[0] - t->cy[i] * t->y[0];
+    }
+
+    return 1;
+}
+
+/**
+ * Calculates the x of an edge of a triangle at a scan line.
+ *
+ * @param t
+ *     The triangle.
+ * @param a, b
+ *     The indices of the vertices at the ends of the edge; t->y[a] must be
+ *     less than t->y[b].
+ * @param y
+ *     The centre of the scan line.
+ * @return the x of the edge
+ */
+static inline float
+compositor_triangle_edge(const CompositorTriangle *t, int a, int b, float y)
+{
+    return t->x[a] + (y - t->y[a]) * (t->x[b] - t->x[a])
+        / (t->y[b] - t->y[a]);
+}
+
+/**
+ * Blends a triangle over one scan line.
+ *
+ * Pixel centres on the left edge are covered, and those on the right edge are
+ * not, so that pixels on an edge shared by two triangles are drawn once.
+ *
+ * @param self
+ *     The compositor.
+ * @param t
+ *     The triangle, which must cover the scan line.
+ * @param y
+ *     The scan line.
+ * @param r, g, b, a
+ *     The channels of the scan line.
+ */
+static void
+compositor_triangle_row(const Compositor *self, const CompositorTriangle *t,
+    int y, float * restrict r, float * restrict g, float * restrict b,
+    float * restrict a)
+{
+    float center = y + 0.5f;
+    float left = compositor_triangle_edge(t, 0, 2, center);
+    float right = center < t->y[1]
+        ? compositor_triangle_edge(t, 0, 1, center)
+        : compositor_triangle_edge(t, 1, 2, center);
+    float red, green, blue, alpha;
+    int x, start, end;
+
+    if (left > right) {
+        float swap = left;
+
+        left = right;
+        right = swap;
+    }
+    start = (int)ceilf(left - 0.5f);
+    end = (int)ceilf(right - 0.5f);
+    if (start < 0) {
+        start = 0;
+    }
+    if (end > (int)self->width) {
+        end = self->width;
+    }
+
+    /* The values at the centre of the pixel at x = 0 */
+    red = t->c[0] + t->cx[0] * 0.5f + t->cy[0] * center;
+    green = t->c[1] + t->cx[1] * 0.5f + t->cy[1] * center;
+    blue = t->c[2] + t->cx[2] * 0.5f + t->cy[2] * center;
+    alpha = t->c[3] + t->cx[3] * 0.5f + t->cy[3] * center;
+
+    for (x = start; x < end; x++) {
+        float fx = (float)x;
+        float opacity = alpha + t->cx[3] * fx;
+
+        r[x] += opacity * (red + t->cx[0] * fx - r[x]);
+        g[x] += opacity * (green + t->cx[1] * fx - g[x]);
+        b[x] += opacity * (blue + t->cx[2] * fx - b[x]);
+        a[x] += opacity * (opacity - a[x]);
+    }
+}
+
+/*
+ * Portable; 1 pixel per iteration
+ */
+#define KERNEL_NAME compositor_sample_float
+#define W 1
+#define VF float
+#define VI int
+#define F_SET1(a) ((float)(a))
+#define F_LANES 0.0f
+#define F_LOADU(p) (*(p))
+#define F_STOREU(p, v) (*(p) = (v))
+#define F_ADD(a, b) ((a) + (b))
+#define F_SUB(a, b) ((a) - (b))
+#define F_MUL(a, b) ((a) * (b))
+#define F_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define F_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define F_FROM_I(a) ((float)(a))
+#define I_SET1(a) ((int)(a))
+#define I_ADD(a, b) ((a) + (b))
+#define I_MUL(a, b) ((a) * (b))
+#define I_TRUNC(a) ((int)(a))
+#define GATHER(data, i) ((float)(data)[i])
+#include "compositor_simd.inc"
+
+#ifdef COMPOSITOR_SIMD
+
+/*
+ * SSE2; 4 pixels per iteration
+ *
+ * SSE2 has neither gathers nor a 32 bit multiplication, so both are
+ * emulated.
+ */
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+/**
+ * Multiplies 32 bit integers, keeping the low 32 bits of the products.
+ */
+static inline __m128i
+compositor_mul_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32),
+        _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/**
+ * Loads the texels at the indices of every lane of a level of detail.
+ */
+static inline __m128
+compositor_gather_sse2(const unsigned char *data, __m128i index)
+{
+    int i[4];
+
+    _mm_storeu_si128((__m128i*)i, index);
+
+    return _mm_setr_ps(data[i[0]], data[i[1]], data[i[2]], data[i[3]]);
+}
+
+#define KERNEL_NAME compositor_sample_sse2
+#define W 4
+#define VF __m128
+#define VI __m128i
+#define F_SET1(a) _mm_set1_ps(a)
+#define F_LANES _mm_setr_ps(0, 1, 2, 3)
+#define F_LOADU(p) _mm_loadu_ps(p)
+#define F_STOREU(p, v) _mm_storeu_ps(p, v)
+#define F_ADD(a, b) _mm_add_ps(a, b)
+#define F_SUB(a, b) _mm_sub_ps(a, b)
+#define F_MUL(a, b) _mm_mul_ps(a, b)
+#define F_MIN(a, b) _mm_min_ps(a, b)
+#define F_MAX(a, b) _mm_max_ps(a, b)
+#define F_FROM_I(a) _mm_cvtepi32_ps(a)
+#define I_SET1(a) _mm_set1_epi32(a)
+#define I_ADD(a, b) _mm_add_epi32(a, b)
+#define I_MUL(a, b) compositor_mul_sse2(a, b)
+#define I_TRUNC(a) _mm_cvttps_epi32(a)
+#define GATHER(data, i) compositor_gather_sse2(data, i)
+#include "compositor_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX2; 8 pixels per iteration
+ *
+ * There are no byte gathers, so the 32 bits ending at every texel are
+ * gathered and shifted; for the first three texels of a level, the 32 bits
+ * starting at the first texel are used instead.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+/**
+ * Loads the texels at the indices of every lane of a level of detail.
+ */
+static inline __m256
+compositor_gather_avx2(const unsigned char *data, __m256i index)
+{
+    __m256i offset = _mm256_min_epi32(index, _mm256_set1_epi32(3));
+    __m256i words = _mm256_i32gather_epi32((const int*)data,
+        _mm256_sub_epi32(index, offset), 1);
+
+    words = _mm256_srlv_epi32(words, _mm256_slli_epi32(offset, 3));
+
+    return _mm256_cvtepi32_ps(
+        _mm256_and_si256(words, _mm256_set1_epi32(0xff)));
+}
+
+#define KERNEL_NAME compositor_sample_avx2
+#define W 8
+#define VF __m256
+#define VI __m256i
+#define F_SET1(a) _mm256_set1_ps(a)
+#define F_LANES _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+#define F_LOADU(p) _mm256_loadu_ps(p)
+#define F_STOREU(p, v) _mm256_storeu_ps(p, v)
+#define F_ADD(a, b) _mm256_add_ps(a, b)
+#define F_SUB(a, b) _mm256_sub_ps(a, b)
+#define F_MUL(a, b) _mm256_mul_ps(a, b)
+#define F_MIN(a, b) _mm256_min_ps(a, b)
+#define F_MAX(a, b) _mm256_max_ps(a, b)
+#define F_FROM_I(a) _mm256_cvtepi32_ps(a)
+#define I_SET1(a) _mm256_set1_epi32(a)
+#define I_ADD(a, b) _mm256_add_epi32(a, b)
+#define I_MUL(a, b) _mm256_mullo_epi32(a, b)
+#define I_TRUNC(a) _mm256_cvttps_epi32(a)
+#define GATHER(data, i) compositor_gather_avx2(data, i)
+#include "compositor_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512; 16 pixels per iteration
+ *
+ * The texels are gathered like for AVX2. AVX-512 implies FMA, which is not
+ * used, so that all kernels round alike.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+
+/**
+ * Loads the texels at the indices of every lane of a level of detail.
+ */
+static inline __m512
+compositor_gather_avx512(const unsigned char *data, __m512i index)
+{
+    __m512i offset = _mm512_min_epi32(index, _mm512_set1_epi32(3));
+    __m512i words = _mm512_i32gather_epi32(
+        _mm512_sub_epi32(index, offset), data, 1);
+
+    words = _mm512_srlv_epi32(words, _mm512_slli_epi32(offset, 3));
+
+    return _mm512_cvtepi32_ps(
+        _mm512_and_si512(words, _mm512_set1_epi32(0xff)));
+}
+
+#define KERNEL_NAME compositor_sample_avx512
+#define W 16
+#define VF __m512
+#define VI __m512i
+#define F_SET1(a) _mm512_set1_ps(a)
+#define F_LANES _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, \
+    13, 14, 15)
+#define F_LOADU(p) _mm512_loadu_ps(p)
+#define F_STOREU(p, v) _mm512_storeu_ps(p, v)
+#define F_ADD(a, b) _mm512_add_ps(a, b)
+#define F_SUB(a, b) _mm512_sub_ps(a, b)
+#define F_MUL(a, b) _mm512_mul_ps(a, b)
+#define F_MIN(a, b) _mm512_min_ps(a, b)
+#define F_MAX(a, b) _mm512_max_ps(a, b)
+#define F_FROM_I(a) _mm512_cvtepi32_ps(a)
+#define I_SET1(a) _mm512_set1_epi32(a)
+#define I_ADD(a, b) _mm512_add_epi32(a, b)
+#define I_MUL(a, b) _mm512_mullo_epi32(a, b)
+#define I_TRUNC(a) _mm512_cvttps_epi32(a)
+#define GATHER(data, i) compositor_gather_avx512(data, i)
+#include "compositor_simd.inc"
+
+#pragma GCC pop_options
+
+#endif
+
+/**
+ * Selects the fastest sampling kernel supported by the CPU.
+ *
+ * @return the kernel
+ */
+static CompositorSampleKernel
+compositor_sample_kernel(void)
+{
+#ifdef COMPOSITOR_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return compositor_sample_avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return compositor_sample_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return compositor_sample_sse2;
+    }
+#endif
+
+    return compositor_sample_float;
+}
+
+/**
+ * Samples one level of detail of the spiral along one scan line.
+ *
+ * The texels are filtered bilinearly, and clamped at the edges; the edges of
+ * the spiral are transparent, so pixels outside of the square it covers are
+ * not drawn.
+ *
+ * @param self
+ *     The compositor.
+ * @param level
+ *     The level of detail.
+ * @param y
+ *     The scan line.
+ * @param weight
+ *     The weight of the level.
+ * @param accumulate
+ *     Whether to add to the opacities instead of replacing them.
+ * @param opacity
+ *     The opacities of the scan line.
+ */
+static void
+compositor_spiral_row(const Compositor *self, unsigned int level, int y,
+    float weight, int accumulate, float * restrict opacity)
+{
+    const CompositorFrame *f = self->frame;
+    const unsigned char *data = f->spiral;
+    unsigned int width = f->spiral_width, height = f->spiral_height;
+    unsigned int i;
+    float u, v;
+
+    /* The levels are stored consecutively */
+    for (i = 0; i < level; i++) {
+        data += width * height;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    /* Texel centres are at half integers */
+    u = (self->s0 + self->sx * 0.5 + self->sy * (y + 0.5)) * width - 0.5;
+    v = (self->t0 + self->tx * 0.5 + self->ty * (y + 0.5)) * height - 0.5;
+
+    self->sample(data, width, height, u, self->sx * width, v,
+        self->tx * height, weight / 255.0f, accumulate, opacity, 0,
+        self->width);
+}
+
+/**
+ * Blends the spiral over one scan line.
+ *
+ * @param self
+ *     The compositor.
+ * @param opacity
+ *     The opacities of the spiral along the scan line.
+ * @param r, g, b, a
+ *     The channels of the scan line.
+ */
+static void
+compositor_blend_row(const Compositor *self, const float * restrict opacity,
+    float * restrict r, float * restrict g, float * restrict b,
+    float * restrict a)
+{
+    float red = self->frame->spiral_color[0];
+    float green = self->frame->spiral_color[1];
+    float blue = self->frame->spiral_color[2];
+    int x;
+
+    for (x = 0; x < (int)self->width; x++) {
+        float o = opacity[x];
+
+        r[x] += o * (red - r[x]);
+        g[x] += o * (green - g[x]);
+        b[x] += o * (blue - b[x]);
+        a[x] += o * (o - a[x]);
+    }
+}
+
+/**
+ * Converts a channel value to 8 bits.
+ *
+ * The value is clamped after the conversion, since integer comparisons are
+ * vectorised without branches.
+ *
+ * @param value
+ *     The value, which is nominally between 0.0 and 1.0.
+ * @return the 8 bit value
+ */
+static inline uint32_t
+compositor_pack(float value)
+{
+    int v = (int)(value * 255.0f + 0.5f);
+
+    v = v < 0 ? 0 : v;
+    v = v > 255 ? 255 : v;
+
+    return (uint32_t)v;
+}
+
+/**
+ * Converts one scan line to 32 bit pixels.
+ *
+ * @param self
+ *     The compositor.
+ * @param r, g, b, a
+ *     The channels of the scan line.
+ * @param d
+ *     The destination.
+ */
+static void
+compositor_pack_row(const Compositor *self, const float * restrict r,
+    const float * restrict g, const float * restrict b,
+    const float * restrict a, uint32_t * restrict d)
+{
+    unsigned int red_shift = self->red_shift;
+    unsigned int green_shift = self->green_shift;
+    unsigned int blue_shift = self->blue_shift;
+    unsigned int alpha_shift = self->alpha_shift;
+    int x;
+
+    for (x = 0; x < (int)self->width; x++) {
+        d[x] = compositor_pack(r[x]) << red_shift
+            | compositor_pack(g[x]) << green_shift
+            | compositor_pack(b[x]) << blue_shift
+            | compositor_pack(a[x]) << alpha_shift;
+    }
+}
+
+/**
+ * Draws a range of scan lines.
+ *
+ * The triangles of the mesh are collected for bands of COMPOSITOR_BAND scan
+ * lines, and every scan line is then composed in rows of single precision
+ * channels that stay in the cache.
+ */
+static int
+compositor_rows_do(Compositor *self, int start, int end, int gstart,
+    int gend)
+{
+    const CompositorFrame *f = self->frame;
+    unsigned int stride = f->mesh_width + 1;
+    CompositorTriangle *triangles = NULL;
+    unsigned int capacity = 0, count, i;
+    float *r, *g, *b, *a, *opacity;
+    int band, y, x;
+    unsigned int m, n;
+
+    /* The scan lines are left as they are if the channels cannot be
+       allocated */
+    r = malloc(sizeof(*r) * 5 * self->width);
+    if (!r) {
+        return 0;
+    }
+    g = r + self->width;
+    b = g + self->width;
+    a = b + self->width;
+    opacity = a + self->width;
+
+    for (band = start; band < end; band += COMPOSITOR_BAND) {
+        int band_end = band + COMPOSITOR_BAND < end
+            ? band + COMPOSITOR_BAND
+            : end;
+
+        /* Collect the triangles covering the band in the order in which
+           they are drawn by OpenGL, since they may overlap */
+        count = 0;
+        for (m = 0; m < f->mesh_height; m++) {
+            if (ceilf(self->mesh_high[m] - 0.5f) <= band
+                    || ceilf(self->mesh_low[m] - 0.5f) >= band_end) {
+                continue;
+            }
+            if (count + 2 * f->mesh_width > capacity) {
+                CompositorTriangle *grown = realloc(triangles,
+                    sizeof(*triangles) * (count + 2 * f->mesh_width));
+                if (!grown) {
+                    break;
+                }
+                triangles = grown;
+                capacity = count + 2 * f->mesh_width;
+            }
+
+            for (n = 0; n < f->mesh_width; n++) {
+                unsigned int top_left = m * stride + n;
+
+                count += compositor_triangle_init(self, &triangles[count],
+                        top_left, top_left + stride, top_left + stride + 1)
+                    && triangles[count].first < band_end
+                    && triangles[count].last > band;
+                count += compositor_triangle_init(self, &triangles[count],
+                        top_left, top_left + stride + 1, top_left + 1)
+                    && triangles[count].first < band_end
+                    && triangles[count].last > band;
+            }
+        }
+
+        for (y = band; y < band_end; y++) {
+            uint32_t *d = (uint32_t*)(self->pixels + y * self->pitch);
+
+            for (x = 0; x < (int)self->width; x++) {
+                r[x] = f->background[0];
+                g[x] = f->background[1];
+                b[x] = f->background[2];
+                a[x] = 0.0f;
+            }
+
+            for (i = 0; i < count; i++) {
+                if (y >= triangles[i].first && y < triangles[i].last) {
+                    compositor_triangle_row(self, &triangles[i], y, r, g, b,
+                        a);
+                }
+            }
+
+            if (f->spiral) {
+                compositor_spiral_row(self, self->level, y,
+                    1.0f - self->level_weight, 0, opacity);
+                if (self->level_weight > 0.0f) {
+                    compositor_spiral_row(self, self->level + 1, y,
+                        self->level_weight, 1, opacity);
+                }
+                compositor_blend_row(self, opacity, r, g, b, a);
+            }
+
+            compositor_pack_row(self, r, g, b, a, d);
+        }
+    }
+
+    free(triangles);
+    free(r);
+
+    return 0;
+}
+
+/**
+ * Calculates the extents of the rows of squares of the mesh.
+ *
+ * @param self
+ *     The compositor.
+ * @return non-zero if the extents were calculated and 0 if they could not
+ *     be allocated
+ */
+static int
+compositor_mesh_init(Compositor *self)
+{
+    const CompositorFrame *f = self->frame;
+    unsigned int stride = f->mesh_width + 1;
+    unsigned int m, n;
+
+    self->mesh_ax = f->mesh_scale[0] * self->width / (2.0 * f->xscale);
+    self->mesh_bx = 0.5 * self->width;
+    self->mesh_ay = f->mesh_scale[1] * self->height / (2.0 * f->yscale);
+    self->mesh_by = 0.5 * self->height;
+
+    if (f->mesh_height > self->mesh_rows) {
+        float *low = realloc(self->mesh_low,
+            2 * sizeof(*low) * f->mesh_height);
+        if (!low) {
+            return 0;
+        }
+        self->mesh_low = low;
+        self->mesh_high = low + f->mesh_height;
+        self->mesh_rows = f->mesh_height;
+    }
+
+    for (m = 0; m < f->mesh_height; m++) {
+        float low = INFINITY, high = -INFINITY;
+
+        for (n = m * stride; n < (m + 2) * stride; n++) {
+            float y = f->positions[2 * n + 1] * self->mesh_ay
+                + self->mesh_by;
+
+            low = y < low ? y : low;
+            high = y > high ? y : high;
+        }
+        self->mesh_low[m] = low;
+        self->mesh_high[m] = high;
+    }
+
+    return 1;
+}
+
+/**
+ * Calculates the texture coordinates and the level of detail of the spiral.
+ *
+ * The spiral covers a rotated square; the texture coordinates are linear in
+ * the pixel coordinates, so the level of detail is the same for all pixels.
+ *
+ * @param self
+ *     The compositor.
+ */
+static void
+compositor_spiral_init(Compositor *self)
+{
+    const CompositorFrame *f = self->frame;
+    double c = cos(f->spiral_angle) / f->spiral_scale;
+    double s = sin(f->spiral_angle) / f->spiral_scale;
+
+    /* The view coordinates of a pixel are linear in x and y */
+    double vx = 2.0 * f->xscale / self->width, vx0 = -f->xscale;
+    double vy = 2.0 * f->yscale / self->height, vy0 = -f->yscale;
+    double rho, lambda;
+
+    /* Rotate back, and map the square from -1 to 1 to the texture */
+    self->s0 = 0.5 * (c * vx0 + s * vy0) + 0.5;
+    self->sx = 0.5 * c * vx;
+    self->sy = 0.5 * s * vy;
+    self->t0 = 0.5 * (-s * vx0 + c * vy0) + 0.5;
+    self->tx = -0.5 * s * vx;
+    self->ty = 0.5 * c * vy;
+
+    /* Select the levels of detail like GL_LINEAR_MIPMAP_LINEAR */
+    rho = hypot(self->sx * f->spiral_width, self->tx * f->spiral_height);
+    if (hypot(self->sy * f->spiral_width, self->ty * f->spiral_height) > rho) {
+        rho = hypot(self->sy * f->spiral_width, self->ty * f->spiral_height);
+    }
+    lambda = rho > 1.0 ? log2(rho) : 0.0;
+    self->level = (unsigned int)lambda;
+    self->level_weight = lambda - self->level;
+    if (self->level_weight > 1.0 - COMPOSITOR_LOD_EPSILON) {
+        self->level++;
+        self->level_weight = 0.0;
+    }
+    else if (self->level_weight < COMPOSITOR_LOD_EPSILON) {
+        self->level_weight = 0.0;
+    }
+    if (self->level + 1 >= f->spiral_levels) {
+        self->level = f->spiral_levels - 1;
+        self->level_weight = 0.0;
+    }
+}
+
+Compositor*
+compositor_create(unsigned int width, unsigned int height,
+    unsigned int red_shift, unsigned int green_shift, unsigned int blue_shift,
+    unsigned int alpha_shift)
+{
+    Compositor *self;
+
+    self = malloc(sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+    memset(self, 0, sizeof(*self));
+
+    self->width = width;
+    self->height = height;
+    self->red_shift = red_shift;
+    self->green_shift = green_shift;
+    self->blue_shift = blue_shift;
+    self->alpha_shift = alpha_shift;
+    self->sample = compositor_sample_kernel();
+
+    self->para = para_create(self, (ParaCallback)compositor_rows_do);
+    if (!self->para) {
+        free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+compositor_render(Compositor *self, const CompositorFrame *frame,
+    void *pixels, ptrdiff_t pitch)
+{
+    CompositorFrame f = *frame;
+
+    self->frame = &f;
+    self->pixels = pixels;
+    self->pitch = pitch;
+
+    /* Draw the frame without the mesh rather than not at all */
+    if (f.mesh_width && f.mesh_height && !compositor_mesh_init(self)) {
+        f.mesh_height = 0;
+    }
+    if (f.spiral) {
+        compositor_spiral_init(self);
+    }
+
+    para_execute(self->para, 0, self->height);
+    self->frame = NULL;
+}
+
+void
+compositor_free(Compositor *self)
+{
+    if (!self) {
+        return;
+    }
+
+    para_free(self->para);
+    free(self->mesh_low);
+    free(self);
+}
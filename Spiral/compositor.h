@@ -0,0 +1,109 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stddef.h>
+
+/**
+ * The contents of one frame drawn by a compositor.
+ *
+ * All coordinates are view coordinates, in which the frame extends from
+ * -xscale to xscale horisontally and from -yscale to yscale vertically, just
+ * like the orthographic projection of the OpenGL renderer.
+ */
+typedef struct {
+    /** The extents of the view */
+    float xscale, yscale;
+
+    /** The colour filling the frame before anything is drawn */
+    float background[3];
+
+    /** The number of squares of the mesh along each axis, or 0 to not draw
+        the mesh; the mesh has (mesh_width + 1) * (mesh_height + 1)
+        vertices, and the vertex at (x, y) has the index
+        y * (mesh_width + 1) + x */
+    unsigned int mesh_width, mesh_height;
+
+    /** The positions of the vertices, two values per vertex, which are
+        multiplied by mesh_scale to obtain view coordinates */
+    const float *positions;
+    float mesh_scale[2];
+
+    /** The RGBA colours of the vertices, four values per vertex; they are
+        interpolated across every triangle and blended over the
+        background */
+    const float *colors;
+
+    /** The opacities of the spiral, or NULL to not draw the spiral; this
+        contains all levels of detail, as returned by spiral_get_data */
+    const unsigned char *spiral;
+
+    /** The dimensions of the first level, and the number of levels */
+    unsigned int spiral_width, spiral_height, spiral_levels;
+
+    /** The angle, in radians, by which the spiral is rotated
+        counterclockwise, and half the side of the square it covers */
+    double spiral_angle, spiral_scale;
+
+    /** The colour of the spiral */
+    float spiral_color[3];
+} CompositorFrame;
+
+/**
+ * A software renderer drawing frames on the CPU.
+ *
+ * The frame is split into bands of scan lines that are drawn by several
+ * threads. Every scan line is composed in separate single precision rows for
+ * the channels, and is converted to 32 bit pixels at the end. The spiral is
+ * sampled by a kernel for the best instruction set of the CPU, and the other
+ * loops are vectorised by the compiler.
+ */
+typedef struct Compositor Compositor;
+
+/**
+ * Creates a compositor.
+ *
+ * If this function returns successfully, compositor_free must be called.
+ *
+ * @param width, height
+ *     The dimensions of the frames.
+ * @param red_shift, green_shift, blue_shift, alpha_shift
+ *     The positions, in bits, of the 8 bit channels in a 32 bit pixel.
+ * @return a new compositor, or NULL if an error occurred
+ * @see compositor_free
+ */
+Compositor*
+compositor_create(unsigned int width, unsigned int height,
+    unsigned int red_shift, unsigned int green_shift, unsigned int blue_shift,
+    unsigned int alpha_shift);
+
+/**
+ * Draws a frame.
+ *
+ * The result matches the OpenGL renderer to within the rounding of the
+ * blending. The alpha channel is blended like the colour channels, with the
+ * source opacity as source value, starting from 0.
+ *
+ * @param self
+ *     The compositor.
+ * @param frame
+ *     The contents of the frame.
+ * @param pixels
+ *     The bottom scan line of the destination.
+ * @param pitch
+ *     The offset, in bytes, from a scan line to the one above it; this is
+ *     negative for surfaces stored with the top scan line first.
+ */
+void
+compositor_render(Compositor *self, const CompositorFrame *frame,
+    void *pixels, ptrdiff_t pitch);
+
+/**
+ * Releases the resources allocated by compositor_create.
+ *
+ * @param self
+ *     The compositor.
+ */
+void
+compositor_free(Compositor *self);
+
+#endif
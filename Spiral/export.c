@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "export.h"
+#include "opengl.h"
+
+/**
+ * The number of pixel buffers that frames are read back through; a frame is
+ * mapped EXPORT_BUFFERS - 1 frames after its read back was started.
+ */
+#define EXPORT_BUFFERS 3
+
+/**
+ * The number of frames that may be waiting for the writer thread.
+ */
+#define EXPORT_QUEUE 4
+
+struct Export {
+    /** The file written to */
+    FILE *file;
+
+    /** The file format */
+    ExportFormat format;
+
+    /** The dimensions of the frames */
+    unsigned int width, height;
+
+    /** The pixel buffers that frames are read back through, or 0 if pixel
+        buffers are not supported */
+    GLuint buffers[EXPORT_BUFFERS];
+
+    /** The number of frames whose read back has been started */
+    unsigned long started;
+
+    /** The number of frames that have been copied to the queue */
+    unsigned long queued;
+
+    /** The RGBA frames waiting for the writer thread; this is a ring buffer
+        of EXPORT_QUEUE frames, starting at the frame with the index written
+        modulo EXPORT_QUEUE */
+    unsigned char *queue;
+
+    /** The encoded frame currently being written */
+    unsigned char *output;
+
+    /** The thread writing frames */
+    SDL_Thread *thread;
+
+    /** The lock protecting the fields below, and the condition signalled
+        whenever they change */
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+
+    /** The number of frames that have been written */
+    unsigned long written;
+
+    /** Non-zero if no more frames will be queued */
+    int closing;
+
+    /** Non-zero if writing to the file has failed */
+    int failed;
+};
+
+/**
+ * Returns the size of an RGBA frame.
+ */
+static size_t
+export_frame_size(const Export *self)
+{
+    return (size_t)self->width * self->height * 4;
+}
+
+/**
+ * Converts a frame to the file format.
+ *
+ * The frame is read back with the bottom scan line first, so the scan lines
+ * are reversed.
+ *
+ * @param self
+ *     The export.
+ * @param frame
+ *     The RGBA frame.
+ * @return the number of bytes written to self->output
+ */
+static size_t
+export_encode(Export *self, const unsigned char *frame)
+{
+    size_t stride = self->width * 4;
+    unsigned int x, y;
+
+    if (self->format == EXPORT_FORMAT_RAW) {
+        for (y = 0; y < self->height; y++) {
+            memcpy(self->output + y * stride,
+                frame + (self->height - 1 - y) * stride, stride);
+        }
+        return stride * self->height;
+    }
+
+    /* Convert to full range BT.601, which is what C420jpeg specifies; the
+       chroma planes are averaged over blocks of 2x2 pixels */
+    unsigned int cwidth = (self->width + 1) / 2;
+    unsigned int cheight = (self->height + 1) / 2;
+    unsigned char *luma = self->output;
+    unsigned char *cb = luma + self->width * self->height;
+    unsigned char *cr = cb + cwidth * cheight;
+
+    for (y = 0; y < self->height; y++) {
+        const unsigned char *s = frame + (self->height - 1 - y) * stride;
+        unsigned char *d = luma + y * self->width;
+
+        for (x = 0; x < self->width; x++) {
+            d[x] = (77 * s[0] + 150 * s[1] + 29 * s[2] + 128) >> 8;
+            s += 4;
+        }
+    }
+
+    for (y = 0; y < cheight; y++) {
+        const unsigned char *s0 = frame
+            + (self->height - 1 - 2 * y) * stride;
+        const unsigned char *s1 = 2 * y + 1 < self->height
+            ? s0 - stride
+            : s0;
+
+        for (x = 0; x < cwidth; x++) {
+            size_t i0 = 8 * x;
+            size_t i1 = 2 * x + 1 < self->width ? i0 + 4 : i0;
+            int r = s0[i0] + s0[i1] + s1[i0] + s1[i1];
+            int g = s0[i0 + 1] + s0[i1 + 1] + s1[i0 + 1] + s1[i1 + 1];
+            int b = s0[i0 + 2] + s0[i1 + 2] + s1[i0 + 2] + s1[i1 + 2];
+
+            cb[y * cwidth + x] = (-43 * r - 85 * g + 128 * b + 131072 + 511)
+                >> 10;
+            cr[y * cwidth + x] = (128 * r - 107 * g - 21 * b + 131072 + 511)
+                >> 10;
+        }
+    }
+
+    return self->width * self->height + 2 * cwidth * cheight;
+}
+
+/**
+ * The function run by the writer thread.
+ *
+ * @param self
+ *     The export.
+ * @return 0
+ */
+static int
+export_run(Export *self)
+{
+    SDL_mutexP(self->mutex);
+    while (!self->failed) {
+        if (self->written < self->queued) {
+            const unsigned char *frame = self->queue
+                + (self->written % EXPORT_QUEUE) * export_frame_size(self);
+            size_t size;
+            int failed;
+
+            /* The main thread does not touch queued frames */
+            SDL_mutexV(self->mutex);
+            size = export_encode(self, frame);
+            failed = (self->format == EXPORT_FORMAT_Y4M
+                    && fputs("FRAME\n", self->file) < 0)
+                || fwrite(self->output, 1, size, self->file) != size;
+            SDL_mutexP(self->mutex);
+
+            self->written++;
+            self->failed = failed;
+            SDL_CondBroadcast(self->cond);
+        }
+        else if (self->closing) {
+            break;
+        }
+        else {
+            SDL_CondWait(self->cond, self->mutex);
+        }
+    }
+    SDL_mutexV(self->mutex);
+
+    return 0;
+}
+
+/**
+ * Returns a free frame of the queue, waiting for the writer thread if the
+ * queue is full.
+ *
+ * @param self
+ *     The export.
+ * @return the frame, or NULL if writing has failed
+ */
+static unsigned char*
+export_queue_reserve(Export *self)
+{
+    unsigned char *result = NULL;
+
+    SDL_mutexP(self->mutex);
+    while (!self->failed && self->queued - self->written >= EXPORT_QUEUE) {
+        SDL_CondWait(self->cond, self->mutex);
+    }
+    if (!self->failed) {
+        result = self->queue
+            + (self->queued % EXPORT_QUEUE) * export_frame_size(self);
+    }
+    SDL_mutexV(self->mutex);
+
+    return result;
+}
+
+/**
+ * Hands the frame returned by export_queue_reserve to the writer thread.
+ *
+ * @param self
+ *     The export.
+ */
+static void
+export_queue_commit(Export *self)
+{
+    SDL_mutexP(self->mutex);
+    self->queued++;
+    SDL_CondBroadcast(self->cond);
+    SDL_mutexV(self->mutex);
+}
+
+/**
+ * Copies the oldest frame in the pixel buffers to the queue.
+ *
+ * @param self
+ *     The export.
+ * @return non-zero if the frame was queued and 0 otherwise
+ */
+static int
+export_collect(Export *self)
+{
+    unsigned char *frame = export_queue_reserve(self);
+    const void *mapping;
+
+    if (!frame) {
+        return 0;
+    }
+
+    /* Mapping waits for the read back, which has had several frames to
+       complete */
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,
+        self->buffers[self->queued % EXPORT_BUFFERS]);
+    mapping = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapping) {
+        memcpy(frame, mapping, export_frame_size(self));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (!mapping) {
+        fprintf(stderr, "Unable to map pixel buffer.\n");
+        return 0;
+    }
+
+    export_queue_commit(self);
+
+    return 1;
+}
+
+Export*
+export_create(const char *path, ExportFormat format, unsigned int width,
+    unsigned int height, unsigned int rate)
+{
+    Export *self;
+    int i;
+
+    self = malloc(sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+    memset(self, 0, sizeof(*self));
+
+    self->format = format;
+    self->width = width;
+    self->height = height;
+
+    /* The encoded frame is never larger than the RGBA frame */
+    self->queue = malloc(export_frame_size(self) * EXPORT_QUEUE);
+    self->output = malloc(export_frame_size(self));
+    if (!self->queue || !self->output) {
+        fprintf(stderr, "Unable to allocate frames of size %dx%d.\n", width,
+            height);
+        free(self->queue);
+        free(self->output);
+        free(self);
+        return NULL;
+    }
+
+    self->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!self->file) {
+        fprintf(stderr, "Unable to open %s.\n", path);
+        free(self->queue);
+        free(self->output);
+        free(self);
+        return NULL;
+    }
+
+    if (format == EXPORT_FORMAT_Y4M) {
+        fprintf(self->file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+            width, height, rate);
+    }
+
+    /* Without pixel buffers glReadPixels waits for the frame to be
+       rendered, but the writer thread still runs in parallel */
+    if (opengl_has_pixel_buffers()) {
+        glGenBuffers(EXPORT_BUFFERS, self->buffers);
+        for (i = 0; i < EXPORT_BUFFERS; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, self->buffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, export_frame_size(self), NULL,
+                GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    self->mutex = SDL_CreateMutex();
+    self->cond = SDL_CreateCond();
+    self->thread = self->mutex && self->cond
+        ? SDL_CreateThread((int (*)(void*))export_run, self)
+        : NULL;
+    if (!self->thread) {
+        fprintf(stderr, "Unable to create export thread: %s\n",
+            SDL_GetError());
+        self->failed = 1;
+        export_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+int
+export_frame(Export *self)
+{
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    if (!self->buffers[0]) {
+        unsigned char *frame = export_queue_reserve(self);
+        if (!frame) {
+            return 0;
+        }
+
+        glReadPixels(0, 0, self->width, self->height, GL_RGBA,
+            GL_UNSIGNED_BYTE, frame);
+        export_queue_commit(self);
+
+        return 1;
+    }
+
+    /* Start the read back of this frame, and collect the oldest one once all
+       buffers are in use */
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,
+        self->buffers[self->started % EXPORT_BUFFERS]);
+    glReadPixels(0, 0, self->width, self->height, GL_RGBA, GL_UNSIGNED_BYTE,
+        NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    self->started++;
+
+    if (self->started - self->queued < EXPORT_BUFFERS) {
+        return 1;
+    }
+
+    return export_collect(self);
+}
+
+unsigned char*
+export_frame_reserve(Export *self)
+{
+    return export_queue_reserve(self);
+}
+
+void
+export_frame_commit(Export *self)
+{
+    export_queue_commit(self);
+}
+
+int
+export_free(Export *self)
+{
+    int result;
+
+    /* Collect the frames still in the pixel buffers */
+    if (self->buffers[0]) {
+        while (self->queued < self->started && export_collect(self));
+        glDeleteBuffers(EXPORT_BUFFERS, self->buffers);
+    }
+
+    if (self->thread) {
+        SDL_mutexP(self->mutex);
+        self->closing = 1;
+        SDL_CondBroadcast(self->cond);
+        SDL_mutexV(self->mutex);
+
+        SDL_WaitThread(self->thread, NULL);
+    }
+    if (self->cond) {
+        SDL_DestroyCond(self->cond);
+    }
+    if (self->mutex) {
+        SDL_DestroyMutex(self->mutex);
+    }
+
+    result = !self->failed && fflush(self->file) == 0;
+    if (self->file != stdout) {
+        result = fclose(self->file) == 0 && result;
+    }
+
+    free(self->queue);
+    free(self->output);
+    free(self);
+
+    return result;
+}
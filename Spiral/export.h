@@ -0,0 +1,96 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+/**
+ * The file formats of exported frames.
+ */
+typedef enum {
+    /** YUV4MPEG2 with 4:2:0 chroma subsampling, which most video encoders
+        accept directly */
+    EXPORT_FORMAT_Y4M,
+
+    /** Raw RGBA frames without any header */
+    EXPORT_FORMAT_RAW
+} ExportFormat;
+
+/**
+ * A stream of frames read back from the current framebuffer, or drawn
+ * directly into the queue of the stream.
+ */
+typedef struct Export Export;
+
+/**
+ * Opens a file and starts the thread writing frames to it.
+ *
+ * Frames are read back through a ring of pixel buffers when supported, so
+ * that the read back of one frame overlaps with the rendering of the next
+ * ones, and they are converted and written by a separate thread.
+ *
+ * If this function returns successfully, export_free must be called.
+ *
+ * @param path
+ *     The path of the file to write. If this is "-", frames are written to
+ *     stdout.
+ * @param format
+ *     The file format.
+ * @param width, height
+ *     The dimensions of the frames.
+ * @param rate
+ *     The number of frames per second; this is written to the header of
+ *     formats supporting it.
+ * @return a new export, or NULL if an error occurred
+ * @see export_free
+ */
+Export*
+export_create(const char *path, ExportFormat format, unsigned int width,
+    unsigned int height, unsigned int rate);
+
+/**
+ * Reads back the current framebuffer as the next frame.
+ *
+ * This function returns once the read back has been started; it blocks only
+ * if the writer thread lags behind.
+ *
+ * @param self
+ *     The export.
+ * @return non-zero if the frame was queued and 0 if writing has failed
+ */
+int
+export_frame(Export *self);
+
+/**
+ * Returns the memory of the next frame, for frames drawn without OpenGL.
+ *
+ * The frame must be filled with RGBA pixels, with the bottom scan line first
+ * like a framebuffer that is read back, and handed to the writer thread with
+ * export_frame_commit. This blocks only if the writer thread lags behind.
+ *
+ * @param self
+ *     The export.
+ * @return the frame, or NULL if writing has failed
+ * @see export_frame_commit
+ */
+unsigned char*
+export_frame_reserve(Export *self);
+
+/**
+ * Queues the frame returned by export_frame_reserve.
+ *
+ * @param self
+ *     The export.
+ */
+void
+export_frame_commit(Export *self);
+
+/**
+ * Writes all pending frames, closes the file and releases the resources
+ * allocated by export_create.
+ *
+ * @param self
+ *     The export.
+ * @return non-zero if all frames were written and 0 otherwise
+ */
+int
+export_free(Export *self);
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "headless.h"
+#include "opengl.h"
+
+static struct {
+    /** The EGL display and context */
+    EGLDisplay display;
+    EGLContext context;
+
+    /** The surface used if the driver does not support surfaceless
+        contexts, or EGL_NO_SURFACE */
+    EGLSurface surface;
+
+    /** The framebuffer that is rendered to, and its colour buffer */
+    GLuint framebuffer, renderbuffer;
+} headless;
+
+/**
+ * Looks up an OpenGL function.
+ *
+ * @param name
+ *     The name of the function.
+ * @return the function, or NULL if it is not available
+ */
+static void*
+headless_get_proc_address(const char *name)
+{
+    return (void*)eglGetProcAddress(name);
+}
+
+/**
+ * Opens an EGL display that does not require a window system.
+ *
+ * The Mesa surfaceless platform is preferred, since it works without an X
+ * server; the default display is used otherwise.
+ *
+ * @return the display, or EGL_NO_DISPLAY if none is available
+ */
+static EGLDisplay
+headless_display_open(void)
+{
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+                "eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(
+                EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+int
+headless_init(unsigned int width, unsigned int height)
+{
+    static const EGLint config_attributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE};
+    static const EGLint surface_attributes[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE};
+    EGLConfig config;
+    EGLint count;
+
+    memset(&headless, 0, sizeof(headless));
+    headless.surface = EGL_NO_SURFACE;
+
+    headless.display = headless_display_open();
+    if (headless.display == EGL_NO_DISPLAY
+            || !eglInitialize(headless.display, NULL, NULL)) {
+        fprintf(stderr, "Unable to open EGL display.\n");
+        return 0;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)
+            || !eglChooseConfig(headless.display, config_attributes, &config,
+                1, &count)
+            || count < 1) {
+        fprintf(stderr, "Unable to find an OpenGL configuration.\n");
+        eglTerminate(headless.display);
+        return 0;
+    }
+
+    headless.context = eglCreateContext(headless.display, config,
+        EGL_NO_CONTEXT, NULL);
+    if (headless.context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Unable to create OpenGL context.\n");
+        eglTerminate(headless.display);
+        return 0;
+    }
+
+    /* We render to a framebuffer object, so a surface is only needed if the
+       driver does not support surfaceless contexts */
+    if (!eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+            headless.context)) {
+        headless.surface = eglCreatePbufferSurface(headless.display, config,
+            surface_attributes);
+        if (headless.surface == EGL_NO_SURFACE
+                || !eglMakeCurrent(headless.display, headless.surface,
+                    headless.surface, headless.context)) {
+            fprintf(stderr, "Unable to activate OpenGL context.\n");
+            headless_free();
+            return 0;
+        }
+    }
+
+    opengl_load(headless_get_proc_address);
+    if (!opengl_has_framebuffers()) {
+        fprintf(stderr, "Framebuffer objects are not supported.\n");
+        headless_free();
+        return 0;
+    }
+
+    /* Create the framebuffer and make it the target of all rendering */
+    glGenRenderbuffers(1, &headless.renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &headless.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, headless.renderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER)
+            != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Unable to create framebuffer of size %dx%d.\n", width,
+            height);
+        headless_free();
+        return 0;
+    }
+
+    return 1;
+}
+
+void
+headless_free(void)
+{
+    if (headless.framebuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &headless.framebuffer);
+    }
+    if (headless.renderbuffer) {
+        glDeleteRenderbuffers(1, &headless.renderbuffer);
+    }
+
+    eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+        EGL_NO_CONTEXT);
+    if (headless.surface != EGL_NO_SURFACE) {
+        eglDestroySurface(headless.display, headless.surface);
+    }
+    eglDestroyContext(headless.display, headless.context);
+    eglTerminate(headless.display);
+}
@@ -0,0 +1,25 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/**
+ * Creates an OpenGL context that is not connected to a display, and binds a
+ * framebuffer of a specific size to it.
+ *
+ * The functions in opengl.def are loaded. If this function returns
+ * successfully, headless_free must be called.
+ *
+ * @param width, height
+ *     The dimensions of the framebuffer.
+ * @return non-zero if the context was created and 0 otherwise
+ * @see headless_free
+ */
+int
+headless_init(unsigned int width, unsigned int height);
+
+/**
+ * Releases the context and framebuffer created by headless_init.
+ */
+void
+headless_free(void);
+
+#endif
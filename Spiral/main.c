@@ -1,5 +1,8 @@
+#include <errno.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <GL/gl.h>
 #include <SDL.h>
@@ -8,17 +11,46 @@
 #define ARGUMENTS_NO_TEARDOWN
 #include "arguments/arguments.h"
 
+#include <para/para.h>
+
+#include "animation.h"
+#include "cache.h"
+#include "compositor.h"
+#include "export.h"
+#include "headless.h"
+#include "metrics.h"
+#include "opengl.h"
 #include "spiral.h"
+#include "spiral_shader.h"
+
+/**
+ * The number of frames per second, or 0.0 to synchronise with the display.
+ */
+#define FRAME_RATE ARGUMENT_VALUE(frame_rate)
+
+/**
+ * The number of frames per second used if vertical sync does not limit the
+ * frame rate.
+ */
+#define SCHEDULER_FALLBACK_RATE 60.0
+
+/**
+ * The highest frame rate that is assumed to be limited by vertical sync.
+ */
+#define SCHEDULER_MAX_VSYNC_RATE 300.0
 
 /**
- * The user event code that signals that the display should be refreshed.
+ * The number of frames presented before deciding whether vertical sync limits
+ * the frame rate.
  */
-#define USER_EVENT_DISPLAY (SDL_USEREVENT + 1)
+#define SCHEDULER_PROBE_FRAMES 30
 
 /**
- * The number of milliseconds between each redraw.
+ * The number of seconds before a deadline that are spent polling the clock
+ * instead of sleeping; this covers the timer slack by which the kernel may
+ * delay waking up, 50 microseconds by default on Linux.
  */
-#define TIMER_INTERVAL 40
+#define SCHEDULER_SPIN 0.00005
 
 /**
  * The number of alterations for the spiral.
@@ -45,6 +77,155 @@
  */
 #define SPIRAL_TWIST ARGUMENT_VALUE(spiral_twist)
 
+/**
+ * How the spiral is drawn.
+ */
+#define SPIRAL_MODE ARGUMENT_VALUE(spiral_mode)
+
+/**
+ * The number of bits per distance when the spiral is drawn from a distance
+ * field.
+ */
+#define SPIRAL_DISTANCE_BITS ARGUMENT_VALUE(spiral_distance_bits)
+
+/**
+ * The number of samples along each axis of the pixels on edges.
+ */
+#define SPIRAL_SAMPLES ARGUMENT_VALUE(spiral_samples)
+
+/**
+ * The kernel used to generate texture spirals, and whether they are created
+ * from a separable phase.
+ */
+#define SPIRAL_KERNEL ARGUMENT_VALUE(spiral_kernel)
+
+/**
+ * Whether levels of detail are calculated for the spiral texture.
+ */
+#define SPIRAL_MIPMAPS ARGUMENT_VALUE(spiral_mipmaps)
+
+/**
+ * The duration, in seconds, of one breath of the spiral, or 0.0 if it does
+ * not breathe.
+ */
+#define SPIRAL_BREATHE_PERIOD ARGUMENT_VALUE(spiral_breathe_period)
+
+/**
+ * The amplitudes of the swings of the twist and the line width of a
+ * breathing spiral.
+ */
+#define SPIRAL_BREATHE_TWIST ARGUMENT_VALUE(spiral_breathe_twist)
+#define SPIRAL_BREATHE_LINE_WIDTH ARGUMENT_VALUE(spiral_breathe_line_width)
+
+/**
+ * The longest time, in seconds, spent generating a breathing spiral during
+ * one frame.
+ */
+#define SPIRAL_BREATHE_BUDGET (ARGUMENT_VALUE(spiral_breathe_budget) / 1000.0)
+
+/**
+ * The directory where generated spirals are stored, or NULL to not store
+ * them.
+ */
+#define CACHE_DIRECTORY ARGUMENT_VALUE(cache_directory)
+
+/**
+ * The maximum total size, in bytes, of the stored spirals.
+ */
+#define CACHE_SIZE ((size_t)ARGUMENT_VALUE(cache_size) << 20)
+
+/**
+ * The number of threads generating the spiral, or 0 for one per CPU.
+ */
+#define THREADS ARGUMENT_VALUE(threads)
+
+/**
+ * Whether the threads generating the spiral are bound to CPUs.
+ */
+#define THREAD_AFFINITY ARGUMENT_VALUE(thread_affinity)
+
+/**
+ * How frames are drawn.
+ */
+#define RENDERER ARGUMENT_VALUE(renderer)
+
+/**
+ * The file that frames are exported to, or NULL to display them in a window.
+ */
+#define EXPORT_PATH ARGUMENT_VALUE(export_path)
+
+/**
+ * The number of frames to export.
+ */
+#define EXPORT_FRAMES ARGUMENT_VALUE(export_frames)
+
+/**
+ * The number of exported frames per second of animation.
+ */
+#define EXPORT_RATE ARGUMENT_VALUE(export_rate)
+
+/**
+ * The size of exported frames if no window size is specified.
+ */
+#define EXPORT_DEFAULT_WIDTH 1920
+#define EXPORT_DEFAULT_HEIGHT 1080
+
+/**
+ * The base 2 logarithm of the factor by which the first spiral shown at
+ * startup is scaled down; the spiral is then refined by factors of two on
+ * the regeneration thread until it has full resolution.
+ */
+#define SPIRAL_PROGRESSIVE_SHIFT 3
+
+/**
+ * The base 2 logarithm of the largest factor by which a distance field is
+ * smaller than the texture it replaces; since the edges are found by the
+ * shader, the field need not have the resolution of the screen.
+ */
+#define SPIRAL_DISTANCE_MAX_SHIFT 2
+
+/**
+ * The smallest number of texels of a distance field between consecutive
+ * curves along a radius; linear filtering cannot reproduce curves that are
+ * closer.
+ */
+#define SPIRAL_DISTANCE_PERIOD 8.0
+
+/**
+ * The change of twist for every key press.
+ */
+#define RETUNE_TWIST_STEP 0.5
+
+/**
+ * The change of line width for every key press.
+ */
+#define RETUNE_LINE_WIDTH_STEP 0.05
+
+/**
+ * The base 2 logarithm of the largest factor by which a breathing spiral is
+ * scaled down to fit in the budget.
+ */
+#define BREATHE_MAX_SHIFT 4
+
+/**
+ * The largest number of frames over whose budgets a breathing spiral is
+ * generated before its resolution is lowered.
+ */
+#define BREATHE_MAX_FRAMES 4
+
+/**
+ * The fraction of the budgets of BREATHE_MAX_FRAMES frames within which a
+ * breathing spiral with twice the resolution, and thus four times the
+ * pixels, must be expected to be generated before the resolution is raised.
+ */
+#define BREATHE_HEADROOM 0.75
+
+/**
+ * The number of scan lines of the first band of a breathing spiral, before
+ * the time per pixel is known.
+ */
+#define BREATHE_FIRST_BAND 16
+
 /**
  * The number of horizontal nodes in the animated background.
  */
@@ -71,15 +252,61 @@
 #define ANIMATION_OPACITY ARGUMENT_VALUE(background_animation_opacity)
 
 /**
- * One node of the animated background.
+ * The smallest number of nodes for which the background animation is updated
+ * by several threads.
+ */
+#define ANIMATION_PARALLEL_NODES 16384
+
+/**
+ * The states of the upload of a regenerated spiral.
+ */
+typedef enum {
+    /** No upload is in progress */
+    UPLOAD_IDLE,
+
+    /** The regeneration thread waits for the pixel buffer to be mapped, to
+        render the spiral directly into it */
+    UPLOAD_MAPPING,
+
+    /** The pixel buffer is mapped, and the regeneration thread is rendering
+        the spiral into it, at once or one band per frame */
+    UPLOAD_RENDERING,
+
+    /** The pixel buffer is mapped, and the regeneration thread is copying the
+        spiral to it */
+    UPLOAD_COPYING,
+
+    /** The spiral has been copied or rendered to the pixel buffer, which must
+        be unmapped and uploaded to the back texture */
+    UPLOAD_COPIED,
+
+    /** The back texture has been updated, and will be swapped with the front
+        texture before the next frame */
+    UPLOAD_DONE
+} UploadState;
+
+/**
+ * The key of a spiral stored in the cache.
+ *
+ * Every value that affects the spiral data is included.
  */
 typedef struct {
-    /** The colour of the node */
-    GLfloat red, green, blue;
+    /** The version of the spiral data, and the kernel, or
+        SPIRAL_KERNEL_AUTO for a separable phase, and the number of samples
+        used to calculate it */
+    unsigned int version, kernel, samples;
 
-    /** The random offset of the node */
-    double d;
-} AnimationNode;
+    /** The way the spiral is drawn */
+    unsigned int mode;
+
+    /** The dimensions, the number of levels of detail and the number of
+        bytes per pixel of the spiral */
+    unsigned int width, height, levels, depth;
+
+    /** The parameters of the spiral */
+    unsigned int curves, alterations, radius;
+    double twist, line_width;
+} SpiralCacheKey;
 
 static struct {
     /** The scale factor to apply to make horisontal and vertical distances
@@ -91,76 +318,365 @@ static struct {
             texture is square */
         unsigned int size;
 
-        /** The identifier for the spiral texture */
-        GLuint texture;
+        /** The identifiers for the spiral textures; the texture at index
+            front is drawn, and the other one receives regenerated spirals */
+        GLuint textures[2];
+
+        /** The index of the texture being drawn */
+        int front;
 
         /** The scale factor used to zoom into the actual spiral */
         GLfloat scale;
+
+        /** The parameters most recently requested */
+        SpiralParameters parameters;
+
+        /** The parameters at the current time, which differ from parameters
+            while the spiral breathes */
+        SpiralParameters current;
+
+        /** The pixel buffer used to upload regenerated spirals, or 0 if pixel
+            buffers are not supported */
+        GLuint buffer;
+
+        /** The program calculating the spiral if it is drawn by a shader,
+            mapping the polar texture to the screen or thresholding the
+            distance field, and 0 if it is drawn as a texture */
+        GLuint program;
+
+        /** The way the spiral is drawn; this is SPIRAL_MODE_TEXTURE if the
+            requested mode is not supported */
+        SpiralMode mode;
+
+        /** The dimensions of the textures, which are 0 until a texture is
+            first uploaded, and the number of curves of the spirals they
+            contain */
+        unsigned int widths[2], heights[2], curves[2];
+
+        /** The number of bytes per texel of the textures */
+        unsigned int depth;
+
+        /** The largest supported texture dimension */
+        GLint max_size;
+
+        /** The cache of generated spirals, or NULL if spirals are not
+            stored */
+        Cache *cache;
+
+        /** The base 2 logarithm of the factor by which the spiral in the
+            front texture is scaled down after initialisation */
+        unsigned int shift;
+
+        /** The polar coordinates of the pixels of the spiral most recently
+            created from a separable phase, or NULL; see
+            context_spiral_create_separable */
+        SpiralGrid *grid;
     } spiral;
 
+    struct {
+        /** The thread regenerating the spiral */
+        SDL_Thread *thread;
+
+        /** The lock protecting the fields of this struct, and the condition
+            used to wake the thread */
+        SDL_mutex *mutex;
+        SDL_cond *cond;
+
+        /** Non-zero if the parameters have changed since the last
+            regeneration started */
+        int requested;
+
+        /** The base 2 logarithm of the factor by which the next spiral is
+            scaled down; after a scaled down spiral, a spiral with twice the
+            resolution is generated, until it has full resolution */
+        unsigned int shift;
+
+        /** Non-zero if the next full resolution spiral should be stored in
+            the cache */
+        int store;
+
+        /** Non-zero if the thread should exit */
+        int quit;
+
+        /** Non-zero if the spiral breathes, in which case the thread
+            generates a spiral with the current parameters as soon as the
+            previous one has been copied, and lowers the resolution to fit
+            the budget */
+        int breathing;
+
+        /** The base 2 logarithm of the factor by which breathing spirals are
+            scaled down */
+        unsigned int breathe_shift;
+
+        /** The parameters to use for the next regeneration */
+        SpiralParameters parameters;
+
+        /** The most recently regenerated spiral, which has not yet been
+            uploaded */
+        Spiral *spiral;
+
+        /** The spiral being copied to the pixel buffer; a spiral regenerated
+            meanwhile replaces spiral, since the buffer has the size of this
+            one */
+        Spiral *copying;
+
+        /** The state of the upload */
+        UploadState state;
+
+        /** The number of curves of the most recently regenerated spiral */
+        unsigned int curves;
+
+        /** The time, in seconds, spent generating the most recently
+            regenerated spiral, and the time spent copying and uploading the
+            spiral being uploaded */
+        double generation, upload;
+
+        /** The dimensions and the number of levels of detail of the spiral
+            being uploaded */
+        unsigned int width, height, levels;
+
+        /** The mapped pixel buffer; this is valid while state is
+            UPLOAD_COPYING or UPLOAD_RENDERING */
+        void *mapping;
+
+        /** The scaled down parameters of the spiral rendered directly into
+            the pixel buffer, and the base 2 logarithm of the factor by which
+            it is scaled down */
+        SpiralParameters rendering;
+        unsigned int rendering_shift;
+
+        /** Whether the spiral being uploaded is rendered directly into the
+            pixel buffer */
+        int direct;
+
+        /** Whether mapping the pixel buffer for a spiral rendered directly
+            into it failed, in which case spirals are copied from then on */
+        int unmapped;
+
+        /** Whether the spiral rendered directly into the pixel buffer is
+            rendered in bands, one per frame, and whether the thread may
+            render the next band */
+        int banded, granted;
+
+        /** The first scan line of the spiral rendered directly into the
+            pixel buffer that has not yet been rendered */
+        unsigned int row;
+
+        /** The time, in seconds, spent rendering one pixel of the most
+            recent band, or 0.0 if no band has been rendered */
+        double pixel_time;
+
+        /** The time, in seconds, spent rendering directly into the pixel
+            buffer that has not yet been recorded */
+        double rendered;
+    } regeneration;
+
+    struct {
+        /** The number of seconds between frames, or 0.0 if frames are paced
+            by vertical sync */
+        double period;
+
+        /** The time at which the next frame should be drawn */
+        double deadline;
+
+        /** The time when the first frame was presented, and the number of
+            frames presented since; these are used to detect whether vertical
+            sync limits the frame rate */
+        double probe_start;
+        unsigned int probe_frames;
+    } scheduler;
+
+    /** The frame time statistics, or NULL if they are not recorded */
+    Metrics *metrics;
+
+    struct {
+        /** The compositor drawing frames, or NULL if they are drawn by
+            OpenGL */
+        Compositor *compositor;
+
+        /** The window surface, or NULL if frames are exported */
+        SDL_Surface *screen;
+
+        /** The bottom scan line of the destination of the frame being drawn,
+            and the offset from a scan line to the one above it */
+        unsigned char *pixels;
+        ptrdiff_t pitch;
+
+        /** The spiral drawn, or NULL if it was read from the cache, and the
+            cache entry containing it otherwise */
+        Spiral *spiral;
+        CacheEntry *entry;
+
+        /** The data of the spiral drawn, which contains all levels of
+            detail, or NULL if there is none */
+        const unsigned char *data;
+
+        /** The dimensions of the first level, and the number of levels */
+        unsigned int width, height, levels;
+    } software;
+
     struct {
         /** The width and height, in nodes, of the animation */
         unsigned int width, height;
 
-        /** The animation nodes; this array will contain width * height
-            elements */
-        AnimationNode *nodes;
+        /** The colours of the nodes; these arrays, and all other arrays of
+            node values, contain width * height elements */
+        GLfloat *red, *green, *blue;
+
+        /** The random offsets of the nodes, expressed in cycles of the
+            colour wave and of the skew waves */
+        float *color_phase, *skew_phase;
+
+        /** The opacities and skews of the nodes for the current frame */
+        float *alpha, *skew_x, *skew_y;
+
+        /** The phases shared by all nodes for the current frame, expressed
+            in cycles */
+        float color_base, skew_x_base, skew_y_base;
+
+        /** The contexts updating the nodes and the vertices */
+        ParaContext *nodes_para, *vertices_para;
+
+        /** The vertices of the grid mesh; the vertex at (x, y), where x is
+            in [0, width] and y in [0, height], has the index
+            y * (width + 1) + x */
+        unsigned int vertex_count;
+
+        /** The vertex data: the first 2 * vertex_count elements are the
+            positions, and the remaining 4 * vertex_count elements are the
+            colours */
+        GLfloat *vertices;
+
+        /** The indices of the triangles of the mesh, two for every pair of
+            nodes; this is NULL once it has been uploaded to index_buffer */
+        GLuint *indices;
+        unsigned int index_count;
+
+        /** The buffers storing vertices and indices, or 0 if buffer objects
+            are not supported */
+        GLuint vertex_buffer, index_buffer;
     } animation;
 } context;
 
 /**
- * Returns the opacity of a colour value based on the current time.
+ * Returns the index of a node of the animated background.
  *
- * @param t
- *     The current time, expressed as seconds since the first frame.
- * @return the opacity of the colour expressed as a value between 0.0 and 1.0
+ * @param x, y
+ *     The coordinates of the node. The coordinates are clipped to the
+ *     dimensions of the animated background before being used.
+ * @return the index of the node at (x, y) in the arrays of node values
  */
-static inline double
-color_function(double t)
+static inline unsigned int
+context_animation_get_index(int x, int y)
 {
-    return (sin(ANIMATION_SPEED * t * 2.0 * M_PI) + 1.0) / 2.0;
+    if (x < 0) {
+        x = 0;
+    }
+    else if (x >= context.animation.width - 1) {
+        x = context.animation.width - 1;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+    else if (y >= context.animation.height - 1) {
+        y = context.animation.height - 1;
+    }
+
+    return y * context.animation.width + x;
 }
 
 /**
- * Returns the amount of skew to apply to a coordinate of the background
- * animation based on the current time.
+ * Calculates the opacities and skews of a range of rows of nodes for the
+ * current frame.
  *
- * @param t
- *     The current time, expressed as seconds since the first frame. The random
- *     offset of the node should be added to this value.
- * @return the skew
+ * The colour wave has a period of 1 / ANIMATION_SPEED seconds, and the skew
+ * waves a period of 2 pi / ANIMATION_SPEED seconds; the horisontal skew is
+ * a quarter of a period ahead of the vertical skew.
  */
-static inline double
-skew_function(double t)
+static int
+context_animation_nodes_do(void *dummy, int start, int end, int gstart,
+    int gend)
 {
-    return ANIMATION_TURBULENCE * sin(ANIMATION_SPEED * t);
+    unsigned int first = start * context.animation.width;
+    unsigned int count = (end - start) * context.animation.width;
+
+    animation_sine(context.animation.color_base,
+        context.animation.color_phase + first,
+        0.5 * ANIMATION_OPACITY, 0.5 * ANIMATION_OPACITY,
+        context.animation.alpha + first, count);
+    animation_sine(context.animation.skew_x_base,
+        context.animation.skew_phase + first,
+        ANIMATION_TURBULENCE, 0.0,
+        context.animation.skew_x + first, count);
+    animation_sine(context.animation.skew_y_base,
+        context.animation.skew_phase + first,
+        ANIMATION_TURBULENCE, 0.0,
+        context.animation.skew_y + first, count);
+
+    return 0;
 }
 
 /**
- * Returns a node of the animated background.
+ * Updates the positions and opacities of a range of rows of vertices from
+ * the values of the nodes.
  *
- * @param x, y
- *     The coordinates of the node to get. The coordinates are clipped to the
- *     dimensions of the animated background before being used.
- * @return the node at (x, y)
+ * The edges of the mesh are not skewed, so that the background always covers
+ * the screen.
  */
-static inline AnimationNode*
-context_animation_get_node(int x, int y)
+static int
+context_animation_vertices_do(void *dummy, int start, int end, int gstart,
+    int gend)
 {
-    if (x < 0) {
-        x = 0;
+    unsigned int stride = context.animation.width + 1;
+    GLfloat *position = context.animation.vertices + 2 * start * stride;
+    GLfloat *alpha = context.animation.vertices
+        + 2 * context.animation.vertex_count + 4 * start * stride + 3;
+    int x, y;
+
+    for (y = start; y < end; y++) {
+        unsigned int row = context_animation_get_index(0, y);
+        int skew_y = y > 0 && y < context.animation.height;
+
+        for (x = 0; x <= context.animation.width; x++) {
+            unsigned int i = row + (x < context.animation.width
+                ? x
+                : context.animation.width - 1);
+
+            *position++ = x - 0.5 * context.animation.width
+                + (x > 0 && x < context.animation.width
+                    ? context.animation.skew_x[i]
+                    : 0.0);
+            *position++ = y - 0.5 * context.animation.height
+                + (skew_y
+                    ? context.animation.skew_y[i]
+                    : 0.0);
+            *alpha = context.animation.alpha[i];
+            alpha += 4;
+        }
     }
-    else if (x >= context.animation.width - 1) {
-        x = context.animation.width - 1;
+
+    return 0;
+}
+
+/**
+ * Releases the resouces allocated by context_animation_init.
+ */
+static void
+context_animation_free(void)
+{
+    if (context.animation.vertex_buffer) {
+        glDeleteBuffers(1, &context.animation.vertex_buffer);
+        glDeleteBuffers(1, &context.animation.index_buffer);
     }
-    if (y < 0) {
-        y = 0;
+    if (context.animation.nodes_para) {
+        para_free(context.animation.nodes_para);
     }
-    else if (y >= context.animation.height - 1) {
-        y = context.animation.height - 1;
+    if (context.animation.vertices_para) {
+        para_free(context.animation.vertices_para);
     }
-
-    return &context.animation.nodes[y * context.animation.width + x];
+    free(context.animation.indices);
+    free(context.animation.vertices);
+    free(context.animation.red);
 }
 
 /**
@@ -175,40 +691,147 @@ context_animation_get_node(int x, int y)
 static int
 context_animation_init(void)
 {
+    memset(&context.animation, 0, sizeof(context.animation));
     context.animation.width = ANIMATION_WIDTH;
     context.animation.height = ANIMATION_HEIGHT;
 
-    /* Allocate a buffer for the nodes and fail if that fails */
-    context.animation.nodes = malloc(sizeof(*context.animation.nodes)
-        * context.animation.width * context.animation.height);
-    if (!context.animation.nodes) {
-        printf("Failed to create animation of size %dx%d.\n",
+    /* Every vertex of the mesh is shared by up to four squares, and takes its
+       values from the clipped node */
+    unsigned int node_count = context.animation.width
+        * context.animation.height;
+    context.animation.vertex_count = (context.animation.width + 1)
+        * (context.animation.height + 1);
+    context.animation.index_count = 6 * context.animation.width
+        * context.animation.height;
+
+    /* Allocate one buffer for all arrays of node values, and fail if any
+       allocation fails */
+    context.animation.red = malloc(sizeof(*context.animation.red) * 8
+        * node_count);
+    context.animation.vertices = malloc(sizeof(*context.animation.vertices)
+        * 6 * context.animation.vertex_count);
+    context.animation.indices = malloc(sizeof(*context.animation.indices)
+        * context.animation.index_count);
+    context.animation.nodes_para = para_create(NULL,
+        (ParaCallback)context_animation_nodes_do);
+    context.animation.vertices_para = para_create(NULL,
+        (ParaCallback)context_animation_vertices_do);
+    if (!context.animation.red
+            || !context.animation.vertices
+            || !context.animation.indices
+            || !context.animation.nodes_para
+            || !context.animation.vertices_para) {
+        fprintf(stderr, "Failed to create animation of size %dx%d.\n",
             context.animation.width, context.animation.height);
+        context_animation_free();
         return 0;
     }
+    context.animation.green = context.animation.red + node_count;
+    context.animation.blue = context.animation.green + node_count;
+    context.animation.color_phase = context.animation.blue + node_count;
+    context.animation.skew_phase = context.animation.color_phase + node_count;
+    context.animation.alpha = context.animation.skew_phase + node_count;
+    context.animation.skew_x = context.animation.alpha + node_count;
+    context.animation.skew_y = context.animation.skew_x + node_count;
 
     /* Initialise the nodes */
     int x, y;
     for (x = 0; x < context.animation.width; x++) {
         for (y = 0; y < context.animation.height; y++) {
-            AnimationNode *node = context_animation_get_node(x, y);
-            node->red = (GLfloat)rand() / RAND_MAX;
-            node->green = (GLfloat)rand() / RAND_MAX;
-            node->blue = (GLfloat)rand() / RAND_MAX;
-            node->d = 2.0 * M_PI * (double)rand() / RAND_MAX;
+            unsigned int i = context_animation_get_index(x, y);
+            double d;
+            context.animation.red[i] = (GLfloat)rand() / RAND_MAX;
+            context.animation.green[i] = (GLfloat)rand() / RAND_MAX;
+            context.animation.blue[i] = (GLfloat)rand() / RAND_MAX;
+            d = 2.0 * M_PI * (double)rand() / RAND_MAX;
+            context.animation.color_phase[i] = ANIMATION_SPEED * d;
+            context.animation.skew_phase[i] = ANIMATION_SPEED * d
+                / (2.0 * M_PI);
+        }
+    }
+
+    GLfloat *colors = context.animation.vertices
+        + 2 * context.animation.vertex_count;
+    for (y = 0; y <= context.animation.height; y++) {
+        for (x = 0; x <= context.animation.width; x++) {
+            unsigned int i = context_animation_get_index(x, y);
+            *colors++ = context.animation.red[i];
+            *colors++ = context.animation.green[i];
+            *colors++ = context.animation.blue[i];
+            *colors++ = 0.0;
+        }
+    }
+
+    /* Split every square into the triangles top left, bottom left, bottom
+       right and top left, bottom right, top right */
+    GLuint *index = context.animation.indices;
+    unsigned int stride = context.animation.width + 1;
+    for (y = 0; y < context.animation.height; y++) {
+        for (x = 0; x < context.animation.width; x++) {
+            GLuint top_left = y * stride + x;
+            *index++ = top_left;
+            *index++ = top_left + stride;
+            *index++ = top_left + stride + 1;
+            *index++ = top_left;
+            *index++ = top_left + stride + 1;
+            *index++ = top_left + 1;
         }
     }
 
+    /* The indices never change, so they are uploaded once */
+    context.animation.vertex_buffer = 0;
+    context.animation.index_buffer = 0;
+    if (opengl_has_buffers()) {
+        glGenBuffers(1, &context.animation.vertex_buffer);
+        glGenBuffers(1, &context.animation.index_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, context.animation.index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+            sizeof(*context.animation.indices) * context.animation.index_count,
+            context.animation.indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        free(context.animation.indices);
+        context.animation.indices = NULL;
+    }
+
     return 1;
 }
 
 /**
- * Releases the resouces allocated by context_animation_init.
+ * Updates the positions and opacities of the vertices of the animated
+ * background.
+ *
+ * The values of every node are calculated once, and then copied to the
+ * vertices sharing the node. Large grids are updated by several threads.
+ *
+ * @param t
+ *     The current time, expressed as seconds since the first frame.
  */
 static void
-context_animation_free(void)
+context_animation_update(double t)
 {
-    free(context.animation.nodes);
+    double cycles = ANIMATION_SPEED * t;
+
+    /* Only the fractional part of the shared phases matters, and removing the
+       integral part keeps the precision when t is large */
+    context.animation.color_base = cycles - floor(cycles);
+    cycles /= 2.0 * M_PI;
+    context.animation.skew_y_base = cycles - floor(cycles);
+    cycles += ANIMATION_SPEED / 4.0;
+    context.animation.skew_x_base = cycles - floor(cycles);
+
+    if (context.animation.width * context.animation.height
+            < ANIMATION_PARALLEL_NODES) {
+        context_animation_nodes_do(NULL, 0, context.animation.height, 0,
+            context.animation.height);
+        context_animation_vertices_do(NULL, 0, context.animation.height + 1,
+            0, context.animation.height + 1);
+    }
+    else {
+        para_execute(context.animation.nodes_para, 0,
+            context.animation.height);
+        para_execute(context.animation.vertices_para, 0,
+            context.animation.height + 1);
+    }
 }
 
 /**
@@ -220,168 +843,1383 @@ context_animation_free(void)
 static void
 context_animation_render(double t)
 {
-    /* Do nothing if the animation will not be visible */
-    if (ANIMATION_OPACITY <= 0.0) {
+    /* Do nothing if the animation will not be visible */
+    if (ANIMATION_OPACITY <= 0.0) {
+        return;
+    }
+
+    glPushMatrix();
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    /* Make sure that the mesh covers the entire screen; we keep a margin so
+       that all drawn squares are animated */
+    glScalef(
+        context.xscale * 2.0 / (context.animation.width - 1.5),
+        context.yscale * 2.0 / (context.animation.height - 1.5),
+        1.0);
+
+    context_animation_update(t);
+
+    /* Draw the entire mesh in one call; the vertex buffer is orphaned so that
+       the upload does not wait for the previous frame */
+    const GLvoid *positions = context.animation.vertices;
+    const GLvoid *colors = context.animation.vertices
+        + 2 * context.animation.vertex_count;
+    const GLvoid *indices = context.animation.indices;
+    if (context.animation.vertex_buffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, context.animation.vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER,
+            sizeof(GLfloat) * 6 * context.animation.vertex_count,
+            context.animation.vertices, GL_STREAM_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, context.animation.index_buffer);
+
+        /* The pointers are offsets into the buffers */
+        positions = (const GLvoid*)0;
+        colors = (const GLvoid*)(
+            sizeof(GLfloat) * 2 * context.animation.vertex_count);
+        indices = (const GLvoid*)0;
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, positions);
+    glColorPointer(4, GL_FLOAT, 0, colors);
+    glDrawElements(GL_TRIANGLES, context.animation.index_count,
+        GL_UNSIGNED_INT, indices);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if (context.animation.vertex_buffer) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    glDisable(GL_BLEND);
+
+    glPopMatrix();
+}
+
+/**
+ * Calculates the factor by which a distance field is smaller than the
+ * texture it replaces.
+ *
+ * A twisted curve crosses a radius once every 2 pi radius / (curves |twist|
+ * alterations) pixels, so a strongly twisted spiral requires a field with the
+ * resolution of the texture. The factor does not depend on the radius, so
+ * that it is the same for scaled down parameters.
+ *
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return the base 2 logarithm of the factor
+ */
+static unsigned int
+context_spiral_distance_shift(const SpiralParameters *parameters)
+{
+    double period = M_PI * context.spiral.size
+        / (parameters->curves * fabs(parameters->twist)
+            * parameters->alterations);
+    unsigned int shift = 0;
+
+    while (shift < SPIRAL_DISTANCE_MAX_SHIFT
+            && period >= 2.0 * SPIRAL_DISTANCE_PERIOD) {
+        period /= 2.0;
+        shift++;
+    }
+
+    return shift;
+}
+
+/**
+ * Calculates the dimensions of the spiral drawn in the current mode.
+ *
+ * @param parameters
+ *     The parameters of the spiral; the radius must already be scaled down
+ *     by context_spiral_scale if the spiral is.
+ * @param shift
+ *     The base 2 logarithm of the factor by which the spiral is scaled down.
+ * @param width, height, levels
+ *     The dimensions and the number of levels of detail are stored here.
+ */
+static void
+context_spiral_dimensions(const SpiralParameters *parameters,
+    unsigned int shift, unsigned int *width, unsigned int *height,
+    unsigned int *levels)
+{
+    if (context.spiral.mode == SPIRAL_MODE_POLAR) {
+        /* Reduce the resolution rather than fail if the texture would be
+           too large */
+        spiral_polar_size(parameters, width, height);
+        if (*width > (unsigned int)context.spiral.max_size) {
+            *width = context.spiral.max_size;
+        }
+        if (*height > (unsigned int)context.spiral.max_size) {
+            *height = context.spiral.max_size;
+        }
+        *levels = 1;
+    }
+    else if (context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+        shift += context_spiral_distance_shift(parameters);
+        *width = context.spiral.size >> shift;
+        *height = context.spiral.size >> shift;
+        *levels = 1;
+    }
+    else {
+        *width = context.spiral.size >> shift;
+        *height = context.spiral.size >> shift;
+        *levels = SPIRAL_MIPMAPS ? spiral_mipmap_levels(*width, *height) : 1;
+    }
+}
+
+/**
+ * Scales down the parameters of a spiral.
+ *
+ * A scaled down spiral covers the same area of the screen as the full
+ * resolution spiral when drawn, since the texture coordinates do not depend
+ * on the size of the texture.
+ *
+ * @param parameters
+ *     The parameters to scale down.
+ * @param shift
+ *     The base 2 logarithm of the factor by which to scale down.
+ */
+static void
+context_spiral_scale(SpiralParameters *parameters, unsigned int shift)
+{
+    /* The diameter of the scaled down spiral must not exceed the scaled
+       down texture */
+    unsigned int diameter = (parameters->radius + 1) >> shift;
+
+    parameters->radius = diameter > 1 ? diameter - 1 : 1;
+}
+
+/**
+ * Determines whether texture spirals are created from a separable phase.
+ *
+ * This is the case if the separable kernel was selected, or if the kernel
+ * was selected automatically and is not vectorised, since the separable
+ * phase is only faster than those kernels. The separable phase does not
+ * supersample the edges, so it is never used with more than one sample.
+ *
+ * @return non-zero if texture spirals are created by
+ *     context_spiral_create_separable and 0 otherwise
+ */
+static int
+context_spiral_separable(void)
+{
+    SpiralKernel kernel = spiral_get_kernel();
+
+    if (spiral_get_samples() > 1) {
+        return 0;
+    }
+
+    return SPIRAL_KERNEL.separable
+        || (SPIRAL_KERNEL.kernel == SPIRAL_KERNEL_AUTO
+            && (kernel == SPIRAL_KERNEL_SCALAR
+                || kernel == SPIRAL_KERNEL_FLOAT));
+}
+
+/**
+ * Creates a texture spiral from a separable phase if it was selected.
+ *
+ * The phase is split into a term of the angle and a term of the distance to
+ * the centre by spiral_create_batch, which reads the polar coordinates of
+ * the pixels from a grid. The grid is kept for the next spiral, so changing
+ * the parameters of a spiral only calculates the small table of the term of
+ * the distance.
+ *
+ * This is only called by one thread at a time: the main thread until the
+ * regeneration thread starts, and then the regeneration thread.
+ *
+ * @param width, height, levels
+ *     The dimensions and the number of levels of detail of the spiral.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return a new spiral, or NULL if the separable phase is not selected or
+ *     the spiral could not be created
+ * @see context_spiral_separable
+ */
+static Spiral*
+context_spiral_create_separable(unsigned int width, unsigned int height,
+    unsigned int levels, const SpiralParameters *parameters)
+{
+    Spiral *spiral;
+
+    if (!context_spiral_separable()) {
+        return NULL;
+    }
+
+    /* The grid only depends on the dimensions */
+    if (context.spiral.grid
+            && (spiral_grid_get_width(context.spiral.grid) != width
+                || spiral_grid_get_height(context.spiral.grid) != height)) {
+        spiral_grid_free(context.spiral.grid);
+        context.spiral.grid = NULL;
+    }
+    if (!context.spiral.grid) {
+        context.spiral.grid = spiral_grid_create(width, height);
+        if (!context.spiral.grid) {
+            return NULL;
+        }
+    }
+
+    if (!(levels > 1
+            ? spiral_create_batch_with_mipmaps(context.spiral.grid,
+                parameters, 1, &spiral)
+            : spiral_create_batch(context.spiral.grid, parameters, 1,
+                &spiral))) {
+        return NULL;
+    }
+
+    return spiral;
+}
+
+/**
+ * Creates a spiral to draw in the current mode.
+ *
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param shift
+ *     The base 2 logarithm of the factor by which to scale down the spiral.
+ * @return a new spiral, or NULL if it could not be created, in which case an
+ *     error message has been printed
+ */
+static Spiral*
+context_spiral_create(const SpiralParameters *parameters, unsigned int shift)
+{
+    Spiral *spiral;
+    SpiralParameters scaled = *parameters;
+    unsigned int width, height, levels;
+
+    context_spiral_scale(&scaled, context.spiral.mode == SPIRAL_MODE_DISTANCE
+        ? shift + context_spiral_distance_shift(parameters)
+        : shift);
+    context_spiral_dimensions(&scaled, shift, &width, &height, &levels);
+    if (context.spiral.mode == SPIRAL_MODE_POLAR) {
+        spiral = spiral_create_polar(width, height, &scaled);
+    }
+    else if (context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+        spiral = spiral_create_distance(width, height, &scaled,
+            SPIRAL_DISTANCE_BITS);
+    }
+    else {
+        spiral = context_spiral_create_separable(width, height, levels,
+            &scaled);
+        if (!spiral && levels > 1) {
+            spiral = spiral_create_with_mipmaps(width, height, &scaled);
+        }
+        else if (!spiral) {
+            spiral = spiral_create_with_parameters(width, height, &scaled);
+        }
+    }
+
+    if (!spiral) {
+        fprintf(stderr, "Failed to create spiral of size %dx%d.\n", width,
+            height);
+    }
+
+    return spiral;
+}
+
+/**
+ * Calculates the key of a spiral stored in the cache.
+ *
+ * @param key
+ *     The key to initialise.
+ * @param parameters
+ *     The parameters of the spiral.
+ */
+static void
+context_spiral_cache_key(SpiralCacheKey *key,
+    const SpiralParameters *parameters)
+{
+    /* The padding is part of the key */
+    memset(key, 0, sizeof(*key));
+    key->version = SPIRAL_DATA_VERSION;
+    /* spiral_get_kernel never returns SPIRAL_KERNEL_AUTO, so it marks
+       spirals created from a separable phase, which differ slightly */
+    key->kernel = context.spiral.mode == SPIRAL_MODE_TEXTURE
+            && context_spiral_separable()
+        ? SPIRAL_KERNEL_AUTO
+        : spiral_get_kernel();
+    key->samples = spiral_get_samples();
+    key->mode = context.spiral.mode;
+    context_spiral_dimensions(parameters, 0, &key->width, &key->height,
+        &key->levels);
+    key->depth = context.spiral.depth;
+    key->curves = parameters->curves;
+    key->alterations = parameters->alterations;
+    key->radius = parameters->radius;
+    key->twist = parameters->twist;
+
+    /* A distance field is the same for all line widths */
+    key->line_width = context.spiral.mode == SPIRAL_MODE_DISTANCE
+        ? 0.0
+        : parameters->line_width;
+}
+
+/**
+ * Calculates the size of the data of a spiral with all its levels of detail.
+ *
+ * @param width, height
+ *     The dimensions of the first level.
+ * @param levels
+ *     The number of levels of detail.
+ * @param depth
+ *     The number of bytes per pixel.
+ * @return the size in bytes
+ */
+static size_t
+context_spiral_data_size(unsigned int width, unsigned int height,
+    unsigned int levels, unsigned int depth)
+{
+    size_t size = 0;
+    unsigned int level;
+
+    for (level = 0; level < levels; level++) {
+        size += (size_t)width * height * depth;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return size;
+}
+
+/**
+ * Stores a spiral in the cache.
+ *
+ * The dimensions in the key are read from the spiral, so that they describe
+ * the stored data even if the spiral has fewer levels than requested; such
+ * an entry is never found by a lookup for the requested levels.
+ *
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param spiral
+ *     The spiral.
+ */
+static void
+context_spiral_cache_put(const SpiralParameters *parameters, Spiral *spiral)
+{
+    SpiralCacheKey key;
+
+    context_spiral_cache_key(&key, parameters);
+    key.width = spiral_get_width(spiral);
+    key.height = spiral_get_height(spiral);
+    key.levels = spiral_get_levels(spiral);
+    key.depth = spiral_get_depth(spiral);
+    cache_put(context.spiral.cache, &key, sizeof(key),
+        spiral_get_data(spiral), spiral_get_size(spiral));
+}
+
+/**
+ * Uploads spiral data to a texture.
+ *
+ * The texture is reallocated if its dimensions change, which happens when the
+ * number of curves of a polar spiral changes.
+ *
+ * @param index
+ *     The index of the texture to update.
+ * @param data
+ *     The spiral data, or the offset into the bound pixel buffer. This
+ *     contains all levels of detail, as returned by spiral_get_data.
+ * @param width, height
+ *     The dimensions of the first level.
+ * @param levels
+ *     The number of levels of detail.
+ */
+static void
+context_spiral_upload(int index, const char *data, unsigned int width,
+    unsigned int height, unsigned int levels)
+{
+    int reallocate = width != context.spiral.widths[index]
+        || height != context.spiral.heights[index];
+    GLint format = context.spiral.depth == 2 ? GL_ALPHA16 : GL_ALPHA8;
+    GLenum type = context.spiral.depth == 2
+        ? GL_UNSIGNED_SHORT
+        : GL_UNSIGNED_BYTE;
+    unsigned int level;
+
+    context.spiral.widths[index] = width;
+    context.spiral.heights[index] = height;
+    glBindTexture(GL_TEXTURE_2D, context.spiral.textures[index]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    for (level = 0; level < levels; level++) {
+        if (reallocate) {
+            glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0,
+                GL_ALPHA, type, data);
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height,
+                GL_ALPHA, type, data);
+        }
+
+        /* The levels are stored consecutively */
+        data += width * height * context.spiral.depth;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+}
+
+/**
+ * Replaces the spiral drawn by the compositor.
+ *
+ * The compositor draws the data of the spiral directly, so the spiral or the
+ * cache entry is kept until it is replaced.
+ *
+ * @param spiral
+ *     The new spiral, or NULL if it was read from the cache. This is freed
+ *     once it is replaced.
+ * @param entry
+ *     The cache entry containing the new spiral if spiral is NULL, or NULL
+ *     to draw no spiral. This is freed once it is replaced.
+ * @param width, height
+ *     The dimensions of the first level.
+ * @param levels
+ *     The number of levels of detail.
+ */
+static void
+context_software_set_spiral(Spiral *spiral, CacheEntry *entry,
+    unsigned int width, unsigned int height, unsigned int levels)
+{
+    spiral_free(context.software.spiral);
+    cache_entry_free(context.software.entry);
+
+    context.software.spiral = spiral;
+    context.software.entry = entry;
+    context.software.data = spiral
+        ? (const unsigned char*)spiral_get_data(spiral)
+        : entry
+            ? (const unsigned char*)cache_entry_get_data(entry)
+            : NULL;
+    context.software.width = width;
+    context.software.height = height;
+    context.software.levels = levels;
+}
+
+/**
+ * Creates the spiral texture and initialises the spiral struct of context.
+ *
+ * Unless the spiral is stored in the cache or frames are exported, the
+ * texture initially contains a scaled down spiral, which
+ * context_regeneration_init arranges to be refined.
+ *
+ * If this function returns successfully, context_spiral_free must be called.
+ *
+ * @param viewport_width, viewport_height
+ *     The dimensions of the spiral viewport.
+ * @return non-zero if the spiral struct was sucessfully initialised and 0
+ *     otherwise
+ * @see context_spiral_free
+ */
+static int
+context_spiral_init(unsigned int viewport_width, unsigned int viewport_height)
+{
+    /* Calculate the spiral texture size; it must be a power of two, and we
+       allow a maximum of 2^16 */
+    int i;
+    unsigned int radius, spiral_size;
+    radius = (unsigned int)hypot(viewport_width * 0.5, viewport_height * 0.5);
+    spiral_size = 2 * (radius + 1);
+    for (i = 16; i; i--) {
+        if ((1 << i) & spiral_size) {
+            if (((1 << i) - 1) & spiral_size) {
+                context.spiral.size =  1 << (i + 1);
+            }
+            else {
+                context.spiral.size = spiral_size;
+            }
+            break;
+        }
+    }
+
+    /* Calculate the scale factors */
+    context.spiral.scale = (GLfloat)context.spiral.size / spiral_size
+        * (2.0 * radius
+            / (viewport_width < viewport_height
+                ? viewport_width : viewport_height));
+
+    context.spiral.parameters.curves = SPIRAL_CURVES;
+    context.spiral.parameters.alterations = SPIRAL_ALTERATIONS;
+    context.spiral.parameters.radius = radius;
+    context.spiral.parameters.twist = SPIRAL_TWIST;
+    context.spiral.parameters.line_width = SPIRAL_LINE_WIDTH;
+    context.spiral.current = context.spiral.parameters;
+
+    /* A shader replaces the texture completely, while a polar texture
+       requires a shader to be drawn */
+    context.spiral.program = 0;
+    context.spiral.buffer = 0;
+    context.spiral.grid = NULL;
+    context.spiral.mode = SPIRAL_MODE;
+    if (context.software.compositor
+            && context.spiral.mode != SPIRAL_MODE_TEXTURE) {
+        fprintf(stderr,
+            "The software renderer draws the spiral as a texture.\n");
+        context.spiral.mode = SPIRAL_MODE_TEXTURE;
+    }
+    if (context.spiral.mode == SPIRAL_MODE_SHADER) {
+        context.spiral.program = spiral_shader_create();
+        if (context.spiral.program) {
+            return 1;
+        }
+    }
+    else if (context.spiral.mode == SPIRAL_MODE_POLAR) {
+        context.spiral.program = spiral_shader_create_polar();
+    }
+    else if (context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+        context.spiral.program = spiral_shader_create_distance();
+    }
+    if (context.spiral.mode != SPIRAL_MODE_TEXTURE
+            && !context.spiral.program) {
+        fprintf(stderr, "Unable to create spiral shader; using a texture.\n");
+        context.spiral.mode = SPIRAL_MODE_TEXTURE;
+    }
+    context.spiral.depth = context.spiral.mode == SPIRAL_MODE_DISTANCE
+            && SPIRAL_DISTANCE_BITS == 16
+        ? 2
+        : 1;
+
+    /* Map a stored spiral if there is one; the cache is optional, so failing
+       to open it is not an error */
+    if (!context.software.compositor) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &context.spiral.max_size);
+    }
+    SpiralCacheKey key;
+    context_spiral_cache_key(&key, &context.spiral.parameters);
+    context.spiral.cache = CACHE_DIRECTORY
+        ? cache_create(CACHE_DIRECTORY, CACHE_SIZE)
+        : NULL;
+    CacheEntry *entry = cache_get(context.spiral.cache, &key, sizeof(key));
+
+    /* Ignore an entry whose size does not match the dimensions in its key,
+       which may have been written by another build */
+    if (entry && cache_entry_get_size(entry) != context_spiral_data_size(
+            key.width, key.height, key.levels, key.depth)) {
+        cache_entry_free(entry);
+        entry = NULL;
+    }
+
+    /* Otherwise show a scaled down spiral as soon as possible, and let the
+       regeneration thread refine it; exported frames must all have full
+       resolution */
+    Spiral *spiral = NULL;
+    context.spiral.shift = 0;
+    if (!entry) {
+        if (!EXPORT_PATH) {
+            context.spiral.shift = SPIRAL_PROGRESSIVE_SHIFT;
+        }
+        spiral = context_spiral_create(&context.spiral.parameters,
+            context.spiral.shift);
+        if (!spiral) {
+            cache_free(context.spiral.cache);
+            spiral_grid_free(context.spiral.grid);
+            if (context.spiral.program) {
+                glDeleteProgram(context.spiral.program);
+            }
+            return 0;
+        }
+    }
+
+    /* The compositor keeps the spiral, or the mapped file, instead of a
+       texture */
+    if (context.software.compositor) {
+        if (spiral && !context.spiral.shift) {
+            context_spiral_cache_put(&context.spiral.parameters, spiral);
+        }
+        context.spiral.front = 0;
+        if (entry) {
+            context_software_set_spiral(NULL, entry, key.width, key.height,
+                key.levels);
+        }
+        else {
+            context_software_set_spiral(spiral, NULL,
+                spiral_get_width(spiral), spiral_get_height(spiral),
+                spiral_get_levels(spiral));
+        }
+        return 1;
+    }
+
+    /* Bind the data to the front texture; the back texture is allocated by
+       the first upload of a regenerated spiral, since it is not drawn
+       before that */
+    glEnable(GL_TEXTURE_2D);
+    glGenTextures(2, context.spiral.textures);
+    context.spiral.front = 0;
+    for (i = 0; i < 2; i++) {
+        context.spiral.widths[i] = 0;
+        context.spiral.heights[i] = 0;
+        context.spiral.curves[i] = context.spiral.parameters.curves;
+        if (i == context.spiral.front) {
+            /* The mapped file is uploaded without copying it first */
+            if (entry) {
+                context_spiral_upload(i, cache_entry_get_data(entry),
+                    key.width, key.height, key.levels);
+            }
+            else {
+                context_spiral_upload(i, spiral_get_data(spiral),
+                    spiral_get_width(spiral), spiral_get_height(spiral),
+                    spiral_get_levels(spiral));
+            }
+        }
+        else {
+            glBindTexture(GL_TEXTURE_2D, context.spiral.textures[i]);
+        }
+
+        /* A polar texture repeats along the angle, but not along the
+           radius */
+        if (context.spiral.mode == SPIRAL_MODE_POLAR) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE);
+        }
+
+        /* The distances at opposite edges of a field are unrelated */
+        else if (context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE);
+        }
+    }
+    glDisable(GL_TEXTURE_2D);
+
+    /* Store a created full resolution spiral for the next start, and free
+       the spiral, since we do not need it any more; the regeneration thread
+       stores the spiral if it is refined */
+    if (spiral && !context.spiral.shift) {
+        context_spiral_cache_put(&context.spiral.parameters, spiral);
+    }
+    cache_entry_free(entry);
+    spiral_free(spiral);
+
+    /* Regenerated spirals are uploaded through a pixel buffer if possible */
+    if (opengl_has_pixel_buffers()) {
+        glGenBuffers(1, &context.spiral.buffer);
+    }
+
+    return 1;
+}
+
+/**
+ * Releases the resouces allocated by context_spiral_init.
+ *
+ * context_regeneration_free must be called before this function.
+ */
+static void
+context_spiral_free(void)
+{
+    spiral_grid_free(context.spiral.grid);
+    context.spiral.grid = NULL;
+
+    if (context.software.compositor) {
+        context_software_set_spiral(NULL, NULL, 0, 0, 0);
+        cache_free(context.spiral.cache);
+        return;
+    }
+
+    if (context.spiral.program) {
+        glDeleteProgram(context.spiral.program);
+    }
+    if (context.spiral.mode == SPIRAL_MODE_SHADER) {
+        return;
+    }
+
+    cache_free(context.spiral.cache);
+
+    if (context.spiral.buffer) {
+        /* The buffer may still be mapped if we exit during an upload */
+        if (context.regeneration.state == UPLOAD_COPYING
+                || context.regeneration.state == UPLOAD_RENDERING
+                || context.regeneration.state == UPLOAD_COPIED) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, context.spiral.buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &context.spiral.buffer);
+    }
+    glDeleteTextures(2, context.spiral.textures);
+}
+
+/**
+ * Adapts the regeneration to the time taken by the most recent one.
+ *
+ * The resolution of a breathing spiral is lowered while it does not fit in
+ * the budgets of BREATHE_MAX_FRAMES frames, and raised once a spiral with
+ * four times the pixels would. A scaled down spiral that is not breathing is
+ * followed by one with twice the resolution, unless the parameters have
+ * changed.
+ *
+ * This must be called with the regeneration mutex held.
+ *
+ * @param shift
+ *     The base 2 logarithm of the factor by which the spiral was scaled down.
+ * @param generation
+ *     The time, in seconds, spent generating the spiral.
+ */
+static void
+context_regeneration_adapt(unsigned int shift, double generation)
+{
+    double budget = BREATHE_MAX_FRAMES * SPIRAL_BREATHE_BUDGET;
+
+    if (context.regeneration.breathing) {
+        if (generation > budget && shift < BREATHE_MAX_SHIFT) {
+            context.regeneration.breathe_shift = shift + 1;
+        }
+        else if (shift > 0 && 4.0 * generation < BREATHE_HEADROOM * budget) {
+            context.regeneration.breathe_shift = shift - 1;
+        }
+    }
+    else if (shift > 0 && !context.regeneration.requested) {
+        context.regeneration.shift = shift - 1;
+        context.regeneration.requested = 1;
+    }
+}
+
+/**
+ * Determines whether a spiral can be rendered directly into the pixel
+ * buffer.
+ *
+ * This is the case for a texture without levels of detail that is not
+ * stored in the cache, since the buffer is mapped write only, and no copy of
+ * the spiral is kept. A breathing spiral is always rendered without levels
+ * of detail, since it is scaled down to fit in the budget and thus rarely
+ * drawn smaller than its size.
+ *
+ * @param parameters
+ *     The parameters of the spiral; these are scaled down on success.
+ * @param shift
+ *     The base 2 logarithm of the factor by which to scale down the spiral.
+ * @param store
+ *     Whether the spiral would be stored in the cache.
+ * @param width, height
+ *     The dimensions of the spiral are stored here on success.
+ * @return non-zero if the spiral can be rendered into the pixel buffer and 0
+ *     otherwise
+ */
+static int
+context_regeneration_direct(SpiralParameters *parameters, unsigned int shift,
+    int store, unsigned int *width, unsigned int *height)
+{
+    SpiralParameters scaled = *parameters;
+    unsigned int levels;
+
+    if (!context.spiral.buffer || context.regeneration.unmapped
+            || context.software.compositor
+            || context.spiral.mode != SPIRAL_MODE_TEXTURE
+            || (store && context.spiral.cache)) {
+        return 0;
+    }
+
+    context_spiral_scale(&scaled, shift);
+    context_spiral_dimensions(&scaled, shift, width, height, &levels);
+    if (levels > 1 && !context.regeneration.breathing) {
+        return 0;
+    }
+
+    *parameters = scaled;
+
+    return 1;
+}
+
+/**
+ * The function run by the regeneration thread.
+ *
+ * The thread waits for changed parameters, creates a new spiral and, once the
+ * main thread has mapped the pixel buffer, copies the spiral to it. Only the
+ * most recent parameters are used if they change several times during a
+ * regeneration.
+ *
+ * A spiral that context_regeneration_direct accepts is instead rendered
+ * directly into the pixel buffer once no other upload is in progress: the
+ * thread asks the main thread to map the buffer, and renders the spiral when
+ * it is mapped. A breathing spiral is rendered in bands of scan lines, one
+ * per frame as granted by the main thread, each sized to take the budget.
+ *
+ * While the spiral breathes, the next spiral is created with the current
+ * parameters as soon as the previous one has been handed over for copying,
+ * so that at most one spiral waits for the main thread.
+ *
+ * @param dummy
+ *     Not used.
+ * @return 0
+ */
+static int
+context_regeneration_run(void *dummy)
+{
+    SDL_mutexP(context.regeneration.mutex);
+    while (!context.regeneration.quit) {
+        if (context.regeneration.state == UPLOAD_COPYING) {
+            Spiral *spiral = context.regeneration.copying;
+            void *mapping = context.regeneration.mapping;
+            double start;
+
+            context.regeneration.copying = NULL;
+            SDL_mutexV(context.regeneration.mutex);
+
+            start = metrics_now();
+            memcpy(mapping, spiral_get_data(spiral), spiral_get_size(spiral));
+            spiral_free(spiral);
+
+            SDL_mutexP(context.regeneration.mutex);
+            context.regeneration.upload += metrics_now() - start;
+            context.regeneration.state = UPLOAD_COPIED;
+        }
+        else if (context.regeneration.state == UPLOAD_RENDERING) {
+            SpiralParameters parameters = context.regeneration.rendering;
+            unsigned int width = context.regeneration.width;
+            unsigned int height = context.regeneration.height;
+            SpiralRegion band;
+            double start, generation;
+
+            /* Wait for the next frame */
+            if (context.regeneration.banded
+                    && !context.regeneration.granted) {
+                SDL_CondWait(context.regeneration.cond,
+                    context.regeneration.mutex);
+                continue;
+            }
+
+            /* A band takes the budget at the time per pixel of the previous
+               one */
+            band.x = 0;
+            band.y = context.regeneration.row;
+            band.width = width;
+            band.height = height - band.y;
+            if (context.regeneration.banded) {
+                double rows = context.regeneration.pixel_time > 0.0
+                    ? SPIRAL_BREATHE_BUDGET
+                        / (context.regeneration.pixel_time * width)
+                    : BREATHE_FIRST_BAND;
+
+                if (rows < band.height) {
+                    band.height = rows < 1.0 ? 1 : (unsigned int)rows;
+                }
+            }
+            context.regeneration.granted = 0;
+            SDL_mutexV(context.regeneration.mutex);
+
+            start = metrics_now();
+            spiral_render_into(
+                (unsigned char*)context.regeneration.mapping
+                    + (size_t)band.y * width,
+                width, width, height, &band, &parameters);
+            generation = metrics_now() - start;
+
+            SDL_mutexP(context.regeneration.mutex);
+            context.regeneration.row += band.height;
+            context.regeneration.rendered += generation;
+            context.regeneration.generation += generation;
+            context.regeneration.pixel_time = generation
+                / ((double)band.width * band.height);
+            if (context.regeneration.row == height) {
+                context.regeneration.state = UPLOAD_COPIED;
+                context_regeneration_adapt(
+                    context.regeneration.rendering_shift,
+                    context.regeneration.generation);
+            }
+        }
+        else if (context.regeneration.requested
+                || (context.regeneration.breathing
+                    && !context.regeneration.spiral)) {
+            SpiralParameters parameters = context.regeneration.parameters;
+            unsigned int shift = context.regeneration.breathing
+                ? context.regeneration.breathe_shift
+                : context.regeneration.shift;
+            int store = !shift && context.regeneration.store
+                && !context.regeneration.breathing;
+            unsigned int width, height;
+            Spiral *spiral;
+            double start, generation;
+
+            if (context_regeneration_direct(&parameters, shift, store,
+                    &width, &height)) {
+                /* Wait for the upload in progress to finish */
+                if (context.regeneration.state != UPLOAD_IDLE
+                        || context.regeneration.spiral) {
+                    SDL_CondWait(context.regeneration.cond,
+                        context.regeneration.mutex);
+                    continue;
+                }
+
+                context.regeneration.requested = 0;
+                context.regeneration.rendering = parameters;
+                context.regeneration.rendering_shift = shift;
+                context.regeneration.width = width;
+                context.regeneration.height = height;
+                context.regeneration.levels = 1;
+                context.regeneration.curves = parameters.curves;
+                context.regeneration.direct = 1;
+                context.regeneration.banded = context.regeneration.breathing;
+                context.regeneration.row = 0;
+                context.regeneration.generation = 0.0;
+                context.regeneration.state = UPLOAD_MAPPING;
+                continue;
+            }
+
+            context.regeneration.requested = 0;
+            if (store) {
+                context.regeneration.store = 0;
+            }
+            SDL_mutexV(context.regeneration.mutex);
+
+            start = metrics_now();
+            spiral = context_spiral_create(&parameters, shift);
+            generation = metrics_now() - start;
+            if (spiral && store) {
+                context_spiral_cache_put(&parameters, spiral);
+            }
+
+            SDL_mutexP(context.regeneration.mutex);
+            if (spiral) {
+                /* A spiral that has not yet been uploaded is obsolete */
+                spiral_free(context.regeneration.spiral);
+                context.regeneration.spiral = spiral;
+                context.regeneration.curves = parameters.curves;
+                context.regeneration.generation = generation;
+            }
+            context_regeneration_adapt(shift, generation);
+        }
+        else {
+            SDL_CondWait(context.regeneration.cond,
+                context.regeneration.mutex);
+        }
+    }
+    SDL_mutexV(context.regeneration.mutex);
+
+    return 0;
+}
+
+/**
+ * Starts the thread regenerating the spiral.
+ *
+ * No thread is started if the spiral is calculated by a shader, since the
+ * parameters are then passed directly to the shader, or if frames are
+ * exported, since the parameters only change when a breathing spiral is then
+ * regenerated for every frame.
+ *
+ * If this function returns successfully, context_regeneration_free must be
+ * called.
+ *
+ * @return non-zero if the thread was started and 0 otherwise
+ * @see context_regeneration_free
+ */
+static int
+context_regeneration_init(void)
+{
+    context.regeneration.thread = NULL;
+    context.regeneration.requested = 0;
+    context.regeneration.shift = 0;
+    context.regeneration.store = 0;
+    context.regeneration.quit = 0;
+    context.regeneration.spiral = NULL;
+    context.regeneration.copying = NULL;
+    context.regeneration.state = UPLOAD_IDLE;
+    context.regeneration.mapping = NULL;
+    context.regeneration.direct = 0;
+    context.regeneration.unmapped = 0;
+    context.regeneration.banded = 0;
+    context.regeneration.granted = 0;
+    context.regeneration.row = 0;
+    context.regeneration.pixel_time = 0.0;
+    context.regeneration.rendered = 0.0;
+    context.regeneration.generation = 0.0;
+    context.regeneration.upload = 0.0;
+
+    /* A shader draws the breathing line width of a distance field, but all
+       other breathing parameters are part of the spiral data */
+    context.regeneration.breathing = SPIRAL_BREATHE_PERIOD > 0.0
+        && (SPIRAL_BREATHE_TWIST > 0.0
+            || (SPIRAL_BREATHE_LINE_WIDTH > 0.0
+                && context.spiral.mode != SPIRAL_MODE_DISTANCE));
+    context.regeneration.breathe_shift = context.spiral.shift;
+    if (context.spiral.mode == SPIRAL_MODE_SHADER || EXPORT_PATH) {
+        context.regeneration.breathing = context.regeneration.breathing
+            && context.spiral.mode != SPIRAL_MODE_SHADER;
+        return 1;
+    }
+
+    context.regeneration.mutex = SDL_CreateMutex();
+    context.regeneration.cond = SDL_CreateCond();
+    if (!context.regeneration.mutex || !context.regeneration.cond) {
+        fprintf(stderr, "Unable to create regeneration lock: %s\n",
+            SDL_GetError());
+        return 0;
+    }
+
+    /* Refine a scaled down spiral shown at startup */
+    if (context.spiral.shift) {
+        context.regeneration.parameters = context.spiral.parameters;
+        context.regeneration.requested = 1;
+        context.regeneration.shift = context.spiral.shift - 1;
+        context.regeneration.store = 1;
+    }
+
+    context.regeneration.thread = SDL_CreateThread(context_regeneration_run,
+        NULL);
+    if (!context.regeneration.thread) {
+        fprintf(stderr, "Unable to create regeneration thread: %s\n",
+            SDL_GetError());
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Stops the thread regenerating the spiral and releases the resources
+ * allocated by context_regeneration_init.
+ */
+static void
+context_regeneration_free(void)
+{
+    if (!context.regeneration.thread) {
+        return;
+    }
+
+    SDL_mutexP(context.regeneration.mutex);
+    context.regeneration.quit = 1;
+    SDL_CondSignal(context.regeneration.cond);
+    SDL_mutexV(context.regeneration.mutex);
+
+    SDL_WaitThread(context.regeneration.thread, NULL);
+    spiral_free(context.regeneration.spiral);
+    spiral_free(context.regeneration.copying);
+    SDL_DestroyCond(context.regeneration.cond);
+    SDL_DestroyMutex(context.regeneration.mutex);
+}
+
+/**
+ * Requests that the spiral is regenerated with the parameters in
+ * context.spiral.parameters.
+ *
+ * The spiral currently displayed is drawn until the new one is ready.
+ */
+static void
+context_regeneration_request(void)
+{
+    printf("Spiral: curves %u, alterations %u, twist %.2f, "
+        "line width %.2f\n",
+        context.spiral.parameters.curves,
+        context.spiral.parameters.alterations,
+        context.spiral.parameters.twist,
+        context.spiral.parameters.line_width);
+
+    /* A breathing spiral follows the parameters from the next frame */
+    if (!context.regeneration.thread || context.regeneration.breathing) {
+        return;
+    }
+
+    SDL_mutexP(context.regeneration.mutex);
+    context.regeneration.parameters = context.spiral.parameters;
+    context.regeneration.requested = 1;
+    context.regeneration.shift = 0;
+    SDL_CondSignal(context.regeneration.cond);
+    SDL_mutexV(context.regeneration.mutex);
+}
+
+/**
+ * Advances the upload of a regenerated spiral by one step.
+ *
+ * This is called once before every frame. It never waits for the
+ * regeneration thread; a regenerated spiral is mapped, uploaded and finally
+ * swapped with the front texture over consecutive frames.
+ *
+ * The time spent generating a spiral is recorded when its upload starts, and
+ * the time spent copying and uploading it when the upload ends. The time
+ * spent rendering a spiral directly into the pixel buffer is instead
+ * recorded once per frame while it is rendered in bands, and when it has
+ * been rendered.
+ */
+static void
+context_regeneration_update(void)
+{
+    double start;
+
+    if (!context.regeneration.thread) {
         return;
     }
 
-    glPushMatrix();
+    start = metrics_now();
+    SDL_mutexP(context.regeneration.mutex);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    /* The next breathing spiral is generated with the current parameters */
+    if (context.regeneration.breathing) {
+        context.regeneration.parameters = context.spiral.current;
+    }
 
-    /* Make sure that the loops below iterate over the entire screen; we keep a
-       margin so that all drawn squares are animated */
-    glScalef(
-        context.xscale * 2.0 / (context.animation.width - 1.5),
-        context.yscale * 2.0 / (context.animation.height - 1.5),
-        1.0);
+    switch (context.regeneration.state) {
+    case UPLOAD_IDLE:
+        if (!context.regeneration.spiral) {
+            break;
+        }
+        metrics_add(context.metrics, METRICS_STAGE_GENERATION,
+            context.regeneration.generation);
+        context.regeneration.width = spiral_get_width(
+            context.regeneration.spiral);
+        context.regeneration.height = spiral_get_height(
+            context.regeneration.spiral);
+        context.regeneration.levels = spiral_get_levels(
+            context.regeneration.spiral);
+        context.spiral.curves[!context.spiral.front] =
+            context.regeneration.curves;
+
+        /* The compositor draws the spiral directly */
+        if (context.software.compositor) {
+            context_software_set_spiral(context.regeneration.spiral, NULL,
+                context.regeneration.width, context.regeneration.height,
+                context.regeneration.levels);
+            context.regeneration.spiral = NULL;
+            metrics_add(context.metrics, METRICS_STAGE_UPLOAD,
+                metrics_now() - start);
+            SDL_CondSignal(context.regeneration.cond);
+            break;
+        }
 
-    int x, y;
-    for (y = 0; y < context.animation.height; y++) {
-        for (x = 0; x < context.animation.width; x++) {
-            AnimationNode *a;
-
-            glPushMatrix();
-
-            /* Move to the correct square */
-            glTranslatef(
-                x - 0.5 * context.animation.width,
-                y - 0.5 * context.animation.height,
-                0.0);
-
-            glBegin(GL_QUADS);
-
-            /* Top left */
-            a = context_animation_get_node(x, y);
-            glColor4f(a->red, a->green, a->blue,
-                ANIMATION_OPACITY * color_function(t + a->d));
-            glVertex2f(
-                (x
-                    ? skew_function(t + a->d + M_PI / 2.0)
-                    : 0.0),
-                (y
-                    ? skew_function(t + a->d)
-                    : 0.0));
-
-            /* Bottom left */
-            a = context_animation_get_node(x, y + 1);
-            glColor4f(a->red, a->green, a->blue,
-                ANIMATION_OPACITY * color_function(t + a->d));
-            glVertex2f(
-                (x
-                    ? skew_function(t + a->d + M_PI / 2.0)
-                    : 0.0),
-                1.0 + (y < context.animation.height - 1
-                    ? skew_function(t + a->d)
-                    : 0.0));
-
-            /* Bottom right */
-            a = context_animation_get_node(x + 1, y + 1);
-            glColor4f(a->red, a->green, a->blue,
-                ANIMATION_OPACITY * color_function(t + a->d));
-            glVertex2f(
-                1.0 + (x < context.animation.width - 1
-                    ? skew_function(t + a->d + M_PI / 2.0)
-                    : 0.0),
-                1.0 + (y < context.animation.height - 1
-                    ? skew_function(t + a->d)
-                    : 0.0));
-
-            /* Top right */
-            a = context_animation_get_node(x + 1, y);
-            glColor4f(a->red, a->green, a->blue,
-                ANIMATION_OPACITY * color_function(t + a->d));
-            glVertex2f(
-                1.0 + (x < context.animation.width - 1
-                    ? skew_function(t + a->d + M_PI / 2.0)
-                    : 0.0),
-                (y
-                    ? skew_function(t + a->d)
-                    : 0.0));
-
-            glEnd();
-
-            glPopMatrix();
+        /* Let the regeneration thread copy the spiral to the pixel buffer;
+           discarding the previous contents prevents glMapBuffer from waiting
+           for a pending upload */
+        if (context.spiral.buffer) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, context.spiral.buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                spiral_get_size(context.regeneration.spiral), NULL,
+                GL_STREAM_DRAW);
+            context.regeneration.mapping = glMapBuffer(
+                GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            if (context.regeneration.mapping) {
+                context.regeneration.copying = context.regeneration.spiral;
+                context.regeneration.spiral = NULL;
+                context.regeneration.upload = metrics_now() - start;
+                context.regeneration.state = UPLOAD_COPYING;
+                SDL_CondSignal(context.regeneration.cond);
+                break;
+            }
         }
-    }
 
-    glDisable(GL_BLEND);
+        /* Without a pixel buffer we upload directly from the spiral */
+        context_spiral_upload(!context.spiral.front,
+            spiral_get_data(context.regeneration.spiral),
+            context.regeneration.width, context.regeneration.height,
+            context.regeneration.levels);
+        spiral_free(context.regeneration.spiral);
+        context.regeneration.spiral = NULL;
+        context.regeneration.state = UPLOAD_DONE;
+        metrics_add(context.metrics, METRICS_STAGE_UPLOAD,
+            metrics_now() - start);
+
+        /* Let a breathing spiral be generated */
+        SDL_CondSignal(context.regeneration.cond);
+        break;
+
+    case UPLOAD_MAPPING:
+        /* Let the regeneration thread render the spiral into the pixel
+           buffer */
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, context.spiral.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER,
+            (GLsizeiptr)context.regeneration.width
+                * context.regeneration.height,
+            NULL, GL_STREAM_DRAW);
+        context.regeneration.mapping = glMapBuffer(GL_PIXEL_UNPACK_BUFFER,
+            GL_WRITE_ONLY);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        context.spiral.curves[!context.spiral.front] =
+            context.regeneration.curves;
+
+        if (context.regeneration.mapping) {
+            context.regeneration.upload = metrics_now() - start;
+            context.regeneration.state = UPLOAD_RENDERING;
+            context.regeneration.granted = 1;
+        }
 
-    glPopMatrix();
+        /* Generate the spiral again, and copy it from now on */
+        else {
+            context.regeneration.unmapped = 1;
+            context.regeneration.direct = 0;
+            context.regeneration.requested = 1;
+            context.regeneration.state = UPLOAD_IDLE;
+        }
+        SDL_CondSignal(context.regeneration.cond);
+        break;
+
+    case UPLOAD_RENDERING:
+        /* Let the regeneration thread render the next band */
+        if (context.regeneration.banded && !context.regeneration.granted) {
+            metrics_add(context.metrics, METRICS_STAGE_GENERATION,
+                context.regeneration.rendered);
+            context.regeneration.rendered = 0.0;
+            context.regeneration.granted = 1;
+            SDL_CondSignal(context.regeneration.cond);
+        }
+        break;
+
+    case UPLOAD_COPIED:
+        if (context.regeneration.direct) {
+            metrics_add(context.metrics, METRICS_STAGE_GENERATION,
+                context.regeneration.rendered);
+            context.regeneration.rendered = 0.0;
+            context.regeneration.direct = 0;
+        }
+
+        /* Start the transfer from the pixel buffer to the back texture */
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, context.spiral.buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        context_spiral_upload(!context.spiral.front, NULL,
+            context.regeneration.width, context.regeneration.height,
+            context.regeneration.levels);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        context.regeneration.state = UPLOAD_DONE;
+        metrics_add(context.metrics, METRICS_STAGE_UPLOAD,
+            context.regeneration.upload + metrics_now() - start);
+        break;
+
+    case UPLOAD_DONE:
+        context.spiral.front = !context.spiral.front;
+        context.regeneration.state = UPLOAD_IDLE;
+
+        /* Let a spiral waiting to be rendered directly be mapped */
+        SDL_CondSignal(context.regeneration.cond);
+        break;
+
+    /* Prevent compiler warning */
+    default: break;
+    }
+    SDL_mutexV(context.regeneration.mutex);
 }
 
 /**
- * Creates the spiral texture and initialises the spiral struct of context.
- *
- * If this function returns successfully, context_spiral_free must be called.
+ * Changes a parameter of the spiral in response to a key press, and requests
+ * regeneration of the spiral.
  *
- * @param viewport_width, viewport_height
- *     The dimensions of the spiral viewport.
- * @return non-zero if the spiral struct was sucessfully initialised and 0
- *     otherwise
- * @see context_spiral_free
+ * @param key
+ *     The key pressed: c changes the number of curves, a the number of
+ *     alterations, t the twist and l the line width.
+ * @param increase
+ *     Whether to increase or decrease the value.
  */
-static int
-context_spiral_init(unsigned int viewport_width, unsigned int viewport_height)
+static void
+context_spiral_retune(SDLKey key, int increase)
 {
-    /* Calculate the spiral texture size; it must be a power of two, and we
-       allow a maximum of 2^16 */
-    int i;
-    unsigned int radius, spiral_size;
-    radius = (unsigned int)hypot(viewport_width * 0.5, viewport_height * 0.5);
-    spiral_size = 2 * (radius + 1);
-    for (i = 16; i; i--) {
-        if ((1 << i) & spiral_size) {
-            if (((1 << i) - 1) & spiral_size) {
-                context.spiral.size =  1 << (i + 1);
-            }
-            else {
-                context.spiral.size = spiral_size;
-            }
-            break;
+    SpiralParameters *p = &context.spiral.parameters;
+
+    switch (key) {
+    case SDLK_c:
+        if (increase && p->curves < 30) {
+            p->curves++;
         }
-    }
+        else if (!increase && p->curves > 1) {
+            p->curves--;
+        }
+        break;
 
-    /* Create the spiral */
-    Spiral *spiral = spiral_create(context.spiral.size, context.spiral.size,
-        SPIRAL_CURVES, SPIRAL_ALTERATIONS, radius, SPIRAL_TWIST,
-        SPIRAL_LINE_WIDTH);
-    if (!spiral) {
-        printf("Failed to create spiral of size %dx%d.\n", context.spiral.size,
-            context.spiral.size);
-        return 0;
-    }
+    case SDLK_a:
+        if (increase && p->alterations < 30) {
+            p->alterations++;
+        }
+        else if (!increase && p->alterations > 1) {
+            p->alterations--;
+        }
+        break;
 
-    /* Calculate the scale factors */
-    context.spiral.scale = (GLfloat)context.spiral.size / spiral_size
-        * (2.0 * radius
-            / (viewport_width < viewport_height
-                ? viewport_width : viewport_height));
+    case SDLK_t:
+        p->twist += increase ? RETUNE_TWIST_STEP : -RETUNE_TWIST_STEP;
+        if (p->twist > 30.0) {
+            p->twist = 30.0;
+        }
+        else if (p->twist < -30.0) {
+            p->twist = -30.0;
+        }
+        break;
+
+    case SDLK_l:
+        p->line_width += increase
+            ? RETUNE_LINE_WIDTH_STEP
+            : -RETUNE_LINE_WIDTH_STEP;
+        if (p->line_width > 0.99) {
+            p->line_width = 0.99;
+        }
+        else if (p->line_width < 0.1) {
+            p->line_width = 0.1;
+        }
+        break;
 
-    /* Bind the data to a texture */
-    glEnable(GL_TEXTURE_2D);
-    glGenTextures(1, &context.spiral.texture);
-    glBindTexture(GL_TEXTURE_2D, context.spiral.texture);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, spiral_get_width(spiral),
-        spiral_get_height(spiral), 0, GL_ALPHA, GL_UNSIGNED_BYTE,
-        spiral_get_data(spiral));
-    glDisable(GL_TEXTURE_2D);
+    /* Prevent compiler warning */
+    default: return;
+    }
 
-    /* Free the spiral, since we do not need it any more */
-    spiral_free(spiral);
+    /* A distance field does not depend on the line width, which is applied
+       when the spiral is drawn */
+    if (key == SDLK_l && context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+        printf("Spiral: line width %.2f\n", p->line_width);
+        return;
+    }
 
-    return 1;
+    context_regeneration_request();
 }
 
 /**
- * Releases the resouces allocated by context_spiral_init.
+ * Calculates the parameters of the spiral at the current time.
+ *
+ * A breathing spiral swings its twist and line width around the requested
+ * values. Exported frames have no regeneration thread, so the spiral is then
+ * regenerated for every frame at full resolution instead.
+ *
+ * @param t
+ *     The current time, expressed as seconds since the first frame.
  */
 static void
-context_spiral_free(void)
+context_spiral_breathe(double t)
 {
-    glDeleteTextures(1, &context.spiral.texture);
+    SpiralParameters *p = &context.spiral.current;
+    double swing;
+
+    *p = context.spiral.parameters;
+    if (SPIRAL_BREATHE_PERIOD <= 0.0) {
+        return;
+    }
+
+    swing = sin(2 * M_PI * t / SPIRAL_BREATHE_PERIOD);
+    p->twist += SPIRAL_BREATHE_TWIST * swing;
+    if (p->twist > 30.0) {
+        p->twist = 30.0;
+    }
+    else if (p->twist < -30.0) {
+        p->twist = -30.0;
+    }
+    p->line_width += SPIRAL_BREATHE_LINE_WIDTH * swing;
+    if (p->line_width > 0.99) {
+        p->line_width = 0.99;
+    }
+    else if (p->line_width < 0.1) {
+        p->line_width = 0.1;
+    }
+
+    if (EXPORT_PATH && context.regeneration.breathing) {
+        double start = metrics_now();
+        Spiral *spiral = context_spiral_create(p, 0);
+        double middle = metrics_now();
+
+        if (!spiral) {
+            /* context_spiral_create prints its own error message */
+            return;
+        }
+        context.spiral.curves[context.spiral.front] = p->curves;
+        if (context.software.compositor) {
+            context_software_set_spiral(spiral, NULL,
+                spiral_get_width(spiral), spiral_get_height(spiral),
+                spiral_get_levels(spiral));
+        }
+        else {
+            context_spiral_upload(context.spiral.front,
+                spiral_get_data(spiral), spiral_get_width(spiral),
+                spiral_get_height(spiral), spiral_get_levels(spiral));
+            spiral_free(spiral);
+        }
+        metrics_add(context.metrics, METRICS_STAGE_GENERATION,
+            middle - start);
+        metrics_add(context.metrics, METRICS_STAGE_UPLOAD,
+            metrics_now() - middle);
+    }
 }
 
 /**
@@ -396,10 +2234,33 @@ context_spiral_render(double t)
     glPushMatrix();
 
     glEnable(GL_BLEND);
-    glEnable(GL_TEXTURE_2D);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (context.spiral.mode == SPIRAL_MODE_SHADER) {
+        glUseProgram(context.spiral.program);
+        spiral_shader_set_parameters(context.spiral.program,
+            context.spiral.size, &context.spiral.current);
+    }
+    else {
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D,
+            context.spiral.textures[context.spiral.front]);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+            context.spiral.mode == SPIRAL_MODE_TEXTURE
+                ? GL_LINEAR_MIPMAP_LINEAR
+                : GL_LINEAR);
+    }
+    if (context.spiral.mode == SPIRAL_MODE_POLAR) {
+        glUseProgram(context.spiral.program);
+        spiral_shader_set_polar_parameters(context.spiral.program,
+            context.spiral.size, context.spiral.curves[context.spiral.front],
+            context.spiral.parameters.radius);
+    }
+    else if (context.spiral.mode == SPIRAL_MODE_DISTANCE) {
+        glUseProgram(context.spiral.program);
+        spiral_shader_set_distance_parameters(context.spiral.program,
+            context.spiral.size, &context.spiral.current);
+    }
 
     /* Set the rotation relative to the current time */
     glRotated(-360 * SPIRAL_ROTATION_SPEED * t, 0.0, 0.0, 1.0);
@@ -428,6 +2289,9 @@ context_spiral_render(double t)
 
     glEnd();
 
+    if (context.spiral.program) {
+        glUseProgram(0);
+    }
     glDisable(GL_BLEND);
     glDisable(GL_TEXTURE_2D);
 
@@ -435,45 +2299,166 @@ context_spiral_render(double t)
 }
 
 /**
- * The timer callback function.
+ * Draws the animated background and the spiral with the compositor.
  *
- * This function pushes an event to SDL to make it execute in the main thread.
+ * The frame is drawn to context.software.pixels. The time spent updating the
+ * background is recorded as the animation stage, and the time spent
+ * composing the frame as the spiral stage.
  *
- * @param interval
- *     The timer interval.
- * @param dummy
- *     Not used.
- * @return the next timer interval, which is the same as the current
+ * @param t
+ *     The current time, expressed as seconds since the first frame.
  */
-static Uint32
-do_timer(Uint32 interval, void *dummy)
+static void
+context_software_render(double t)
 {
-    SDL_Event event;
+    CompositorFrame frame;
+    double start = metrics_now();
+    double middle;
+    int i;
+
+    frame.xscale = context.xscale;
+    frame.yscale = context.yscale;
+    for (i = 0; i < 3; i++) {
+        frame.background[i] = ARGUMENT_VALUE(background_color).d[i];
+        frame.spiral_color[i] = ARGUMENT_VALUE(spiral_color).d[i];
+    }
 
-    event.user.type = SDL_USEREVENT;
-    event.user.code = USER_EVENT_DISPLAY;
-    event.user.data1 = NULL;
-    event.user.data2 = NULL;
+    /* The mesh is scaled like in context_animation_render */
+    frame.mesh_width = 0;
+    frame.mesh_height = 0;
+    if (ANIMATION_OPACITY > 0.0) {
+        context_animation_update(t);
+        frame.mesh_width = context.animation.width;
+        frame.mesh_height = context.animation.height;
+        frame.positions = context.animation.vertices;
+        frame.colors = context.animation.vertices
+            + 2 * context.animation.vertex_count;
+        frame.mesh_scale[0] = context.xscale * 2.0
+            / (context.animation.width - 1.5);
+        frame.mesh_scale[1] = context.yscale * 2.0
+            / (context.animation.height - 1.5);
+    }
+    middle = metrics_now();
+
+    /* The spiral is rotated and scaled like in context_spiral_render */
+    frame.spiral = context.software.data;
+    frame.spiral_width = context.software.width;
+    frame.spiral_height = context.software.height;
+    frame.spiral_levels = context.software.levels;
+    frame.spiral_angle = -2.0 * M_PI * SPIRAL_ROTATION_SPEED * t;
+    frame.spiral_scale = context.spiral.scale;
 
-    SDL_PushEvent(&event);
+    compositor_render(context.software.compositor, &frame,
+        context.software.pixels, context.software.pitch);
 
-    return interval;
+    metrics_add(context.metrics, METRICS_STAGE_ANIMATION, middle - start);
+    metrics_add(context.metrics, METRICS_STAGE_SPIRAL, metrics_now() - middle);
 }
 
 /**
- * Updates the display.
+ * Initialises the scheduler struct of context.
+ *
+ * @param rate
+ *     The number of frames per second, or 0.0 if frames are paced by vertical
+ *     sync.
  */
 static void
-do_display(void)
+context_scheduler_init(double rate)
 {
-    static Uint32 start_ticks = 0;
-    Uint32 current_ticks = SDL_GetTicks();
+    context.scheduler.period = rate > 0.0 ? 1.0 / rate : 0.0;
+    context.scheduler.deadline = metrics_now();
+    context.scheduler.probe_start = 0.0;
+    context.scheduler.probe_frames = 0;
+}
 
-    if (!start_ticks) {
-        start_ticks = current_ticks;
+/**
+ * Waits until the next frame should be drawn.
+ *
+ * The thread sleeps until SCHEDULER_SPIN seconds before the deadline, and
+ * then polls the clock, since waking up may be delayed by the timer slack.
+ */
+static void
+context_scheduler_wait(void)
+{
+    double wake;
+
+    /* Swapping buffers waits for vertical sync */
+    if (context.scheduler.period <= 0.0) {
+        return;
+    }
+
+    /* Sleeping until an absolute time of the clock used by metrics_now does
+       not add the time spent before the call, and is simply restarted when
+       interrupted by a signal */
+    wake = context.scheduler.deadline - SCHEDULER_SPIN;
+    if (wake > metrics_now()) {
+        struct timespec ts;
+
+        ts.tv_sec = (time_t)wake;
+        ts.tv_nsec = (long)((wake - ts.tv_sec) * 1e9);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+            == EINTR);
+    }
+    while (metrics_now() < context.scheduler.deadline);
+}
+
+/**
+ * Calculates the deadline of the next frame once a frame has been presented.
+ *
+ * If drawing took longer than one period, the missed frames are skipped
+ * instead of being drawn back to back, so at most one frame is ever pending.
+ */
+static void
+context_scheduler_advance(void)
+{
+    double now = metrics_now();
+
+    /* Fall back on the clock if vertical sync does not limit the frame
+       rate */
+    if (context.scheduler.period <= 0.0) {
+        if (!context.scheduler.probe_frames++) {
+            context.scheduler.probe_start = now;
+        }
+        else if (context.scheduler.probe_frames == SCHEDULER_PROBE_FRAMES
+                && now - context.scheduler.probe_start
+                    < (SCHEDULER_PROBE_FRAMES - 1)
+                        / SCHEDULER_MAX_VSYNC_RATE) {
+            fprintf(stderr, "Vertical sync is not available; drawing %g "
+                "frames per second.\n", SCHEDULER_FALLBACK_RATE);
+            context.scheduler.period = 1.0 / SCHEDULER_FALLBACK_RATE;
+            context.scheduler.deadline = now;
+        }
+        else {
+            return;
+        }
+    }
+
+    context.scheduler.deadline += context.scheduler.period;
+    if (now > context.scheduler.deadline) {
+        unsigned long missed = (unsigned long)(
+            (now - context.scheduler.deadline) / context.scheduler.period) + 1;
+        context.scheduler.deadline += missed * context.scheduler.period;
     }
+}
+
+/**
+ * Renders one frame to the current framebuffer, or to
+ * context.software.pixels if frames are drawn by the compositor.
+ *
+ * @param t
+ *     The current time, expressed as seconds since the first frame.
+ */
+static void
+do_render(double t)
+{
+    /* Swap in a regenerated spiral if one is ready */
+    context_spiral_breathe(t);
+    context_regeneration_update();
 
-    double t = (double)(current_ticks - start_ticks) / 1000.0;
+    if (context.software.compositor) {
+        context_software_render(t);
+        return;
+    }
 
     /* Make sure the background is cleared */
     glClearColor(
@@ -488,15 +2473,111 @@ do_display(void)
     glOrtho(-context.xscale, context.xscale, -context.yscale, context.yscale,
         0.0, 1.0);
 
+    /* The durations measure the submission of the commands; the GPU may
+       still be working when they return */
+    double start = metrics_now();
     context_animation_render(t);
+    double middle = metrics_now();
     context_spiral_render(t);
+    metrics_add(context.metrics, METRICS_STAGE_ANIMATION, middle - start);
+    metrics_add(context.metrics, METRICS_STAGE_SPIRAL, metrics_now() - middle);
+}
+
+/**
+ * Updates the display.
+ */
+static void
+do_display(void)
+{
+    static Uint32 start_ticks = 0;
+    Uint32 current_ticks = SDL_GetTicks();
+    SDL_Surface *screen = context.software.screen;
+
+    if (!start_ticks) {
+        start_ticks = current_ticks;
+    }
+
+    /* The compositor draws directly to the window surface, whose top scan
+       line comes first */
+    if (context.software.compositor) {
+        if (SDL_MUSTLOCK(screen) && SDL_LockSurface(screen) < 0) {
+            return;
+        }
+        context.software.pixels = (unsigned char*)screen->pixels
+            + (screen->h - 1) * screen->pitch;
+        context.software.pitch = -screen->pitch;
+    }
+
+    do_render((double)(current_ticks - start_ticks) / 1000.0);
 
     /* Render to screen */
-    SDL_GL_SwapBuffers();
+    double start = metrics_now();
+    if (context.software.compositor) {
+        if (SDL_MUSTLOCK(screen)) {
+            SDL_UnlockSurface(screen);
+        }
+        SDL_Flip(screen);
+    }
+    else {
+        SDL_GL_SwapBuffers();
+    }
+    metrics_add(context.metrics, METRICS_STAGE_SWAP, metrics_now() - start);
+    metrics_frame(context.metrics);
+}
+
+/**
+ * Renders all frames to export and writes them to EXPORT_PATH.
+ *
+ * The time advances by a fixed step for every frame, so the result does not
+ * depend on how fast frames are rendered.
+ *
+ * @param width, height
+ *     The dimensions of the framebuffer.
+ * @return non-zero if all frames were written and 0 otherwise
+ */
+static int
+do_export(unsigned int width, unsigned int height)
+{
+    Export *export;
+    unsigned int frame;
+
+    export = export_create(EXPORT_PATH, ARGUMENT_VALUE(export_format),
+        width, height, EXPORT_RATE);
+    if (!export) {
+        /* export_create prints its own error message */
+        return 0;
+    }
+
+    for (frame = 0; frame < EXPORT_FRAMES; frame++) {
+        /* The compositor draws directly to the queue of the export */
+        if (context.software.compositor) {
+            context.software.pixels = export_frame_reserve(export);
+            context.software.pitch = 4 * width;
+            if (!context.software.pixels) {
+                break;
+            }
+            do_render((double)frame / EXPORT_RATE);
+            export_frame_commit(export);
+        }
+        else {
+            do_render((double)frame / EXPORT_RATE);
+            if (!export_frame(export)) {
+                break;
+            }
+        }
+        metrics_frame(context.metrics);
+    }
+
+    if (!export_free(export) || frame < EXPORT_FRAMES) {
+        fprintf(stderr, "Unable to write frames to %s.\n", EXPORT_PATH);
+        return 0;
+    }
+
+    return 1;
 }
 
 /**
- * Handles any pending SDL events.
+ * Handles any pending SDL events without waiting for new ones.
  *
  * @return non-zero if the application should continue running and 0 otherwise
  */
@@ -505,7 +2586,7 @@ handle_events(void)
 {
     SDL_Event event;
 
-    while (SDL_WaitEvent(&event)) {
+    while (SDL_PollEvent(&event)) {
         switch (event.type) {
         /* Exit if the window is closed */
         case SDL_QUIT:
@@ -517,16 +2598,16 @@ handle_events(void)
             case SDLK_ESCAPE:
                 return 0;
 
-            /* Prevent compiler warning */
-            default: break;
-            }
-
-        case SDL_USEREVENT:
-            switch (event.user.code) {
-            case USER_EVENT_DISPLAY:
-                do_display();
+            /* Retune the spiral; shift increases the value */
+            case SDLK_a:
+            case SDLK_c:
+            case SDLK_l:
+            case SDLK_t:
+                context_spiral_retune(event.key.keysym.sym,
+                    event.key.keysym.mod & KMOD_SHIFT);
                 break;
 
+            /* Prevent compiler warning */
             default: break;
             }
             break;
@@ -555,65 +2636,119 @@ opengl_initialize(int width, int height)
 static int
 main(int argc, char *argv[],
     window_size_t window_size,
+    double frame_rate,
     unsigned int spiral_alterations,
     unsigned int spiral_curves,
     double spiral_line_width,
     double spiral_rotation_speed,
     double spiral_twist,
     spiral_color_t spiral_color,
+    SpiralMode spiral_mode,
+    unsigned int spiral_distance_bits,
+    unsigned int spiral_samples,
+    spiral_kernel_t spiral_kernel,
+    int spiral_mipmaps,
+    double spiral_breathe_period,
+    double spiral_breathe_twist,
+    double spiral_breathe_line_width,
+    double spiral_breathe_budget,
     background_color_t background_color,
     background_animation_size_t background_animation_size,
     double background_animation_speed,
     double background_animation_turbulence,
-    double background_animation_opacity)
+    double background_animation_opacity,
+    const char *export_path,
+    ExportFormat export_format,
+    unsigned int export_frames,
+    unsigned int export_rate,
+    const char *metrics_path,
+    double metrics_interval,
+    const char *cache_directory,
+    unsigned int cache_size,
+    unsigned int threads,
+    int thread_affinity,
+    Renderer renderer)
 {
-    /* Initialize SDL */
-    if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
-        printf("Unable to init SDL: %s\n", SDL_GetError());
-        return 1;
-    }
-    atexit(SDL_Quit);
+    unsigned int viewport_width, viewport_height;
+    int result = 0;
 
-    /* Hide the mouse cursor */
-    SDL_ShowCursor(0);
+    context.software.compositor = NULL;
+    context.software.screen = NULL;
 
-    /* Get video information */
-    const SDL_VideoInfo *vinfo = SDL_GetVideoInfo();
-    if (!vinfo) {
-        printf("Unable to get video info: %s\n", SDL_GetError());
-        return 1;
-    }
+    /* Render offscreen if frames are exported */
+    if (EXPORT_PATH) {
+        if (window_size.width > 0 && window_size.height > 0) {
+            viewport_width = window_size.width;
+            viewport_height = window_size.height;
+        }
+        else {
+            viewport_width = EXPORT_DEFAULT_WIDTH;
+            viewport_height = EXPORT_DEFAULT_HEIGHT;
+        }
 
-    /* Initialise the screen */
-    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_Surface* screen;
-    unsigned int viewport_width, viewport_height;
-    if (window_size.width > 0 && window_size.height > 0) {
-        screen = SDL_SetVideoMode(window_size.width, window_size.height,
-            32, SDL_OPENGL);
-        viewport_width = window_size.width;
-        viewport_height = window_size.height;
+        /* The compositor needs no OpenGL context */
+        if (RENDERER == RENDERER_OPENGL
+                && !headless_init(viewport_width, viewport_height)) {
+            /* headless_init prints its own error message */
+            return 1;
+        }
     }
+
     else {
-        screen = SDL_SetVideoMode(vinfo->current_w, vinfo->current_h,
-            32, SDL_OPENGL | SDL_FULLSCREEN);
-        viewport_width = vinfo->current_w;
-        viewport_height = vinfo->current_h;
-    }
-    if (!screen) {
-        printf("Unable to set %dx%d video: %s\n",
-            viewport_width, viewport_height, SDL_GetError());
-        return 1;
+        /* Initialize SDL */
+        if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
+            fprintf(stderr, "Unable to init SDL: %s\n", SDL_GetError());
+            return 1;
+        }
+        atexit(SDL_Quit);
+
+        /* Hide the mouse cursor */
+        SDL_ShowCursor(0);
+
+        /* Get video information */
+        const SDL_VideoInfo *vinfo = SDL_GetVideoInfo();
+        if (!vinfo) {
+            fprintf(stderr, "Unable to get video info: %s\n", SDL_GetError());
+            return 1;
+        }
+
+        /* Initialise the screen; the compositor draws to a software
+           surface */
+        Uint32 flags = RENDERER == RENDERER_SOFTWARE
+            ? SDL_SWSURFACE
+            : SDL_OPENGL;
+        SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+        SDL_GL_SetAttribute(SDL_GL_SWAP_CONTROL, FRAME_RATE <= 0.0);
+        SDL_Surface* screen;
+        if (window_size.width > 0 && window_size.height > 0) {
+            screen = SDL_SetVideoMode(window_size.width, window_size.height,
+                32, flags);
+            viewport_width = window_size.width;
+            viewport_height = window_size.height;
+        }
+        else {
+            screen = SDL_SetVideoMode(vinfo->current_w, vinfo->current_h,
+                32, flags | SDL_FULLSCREEN);
+            viewport_width = vinfo->current_w;
+            viewport_height = vinfo->current_h;
+        }
+        if (!screen) {
+            fprintf(stderr, "Unable to set %dx%d video: %s\n",
+                viewport_width, viewport_height, SDL_GetError());
+            return 1;
+        }
+
+        if (RENDERER == RENDERER_SOFTWARE) {
+            context.software.screen = screen;
+        }
+        else {
+            opengl_load(SDL_GL_GetProcAddress);
+        }
     }
 
     /* Setup OpenGL */
-    opengl_initialize(viewport_width, viewport_height);
-
-    /* Create the timer */
-    SDL_TimerID timer = SDL_AddTimer(TIMER_INTERVAL, do_timer, NULL);
-    if (!timer) {
-        printf("Unable to add timer.\n");
-        return 1;
+    if (RENDERER == RENDERER_OPENGL) {
+        opengl_initialize(viewport_width, viewport_height);
     }
 
     /* Make sure horisontal and vertical distances are equal */
@@ -626,24 +2761,96 @@ main(int argc, char *argv[],
         context.yscale = (double)viewport_height / viewport_width;
     }
 
+    /* Exported frames are RGBA in memory, while the channels of the window
+       surface are given by its format; the padding byte of a surface
+       without alpha receives the alpha channel */
+    if (RENDERER == RENDERER_SOFTWARE) {
+        if (context.software.screen) {
+            const SDL_PixelFormat *format = context.software.screen->format;
+
+            context.software.compositor = compositor_create(viewport_width,
+                viewport_height, format->Rshift, format->Gshift,
+                format->Bshift,
+                format->Amask
+                    ? format->Ashift
+                    : 48 - format->Rshift - format->Gshift - format->Bshift);
+        }
+        else {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+            context.software.compositor = compositor_create(viewport_width,
+                viewport_height, 0, 8, 16, 24);
+#else
+            context.software.compositor = compositor_create(viewport_width,
+                viewport_height, 24, 16, 8, 0);
+#endif
+        }
+        if (!context.software.compositor) {
+            fprintf(stderr, "Failed to create compositor of size %dx%d.\n",
+                viewport_width, viewport_height);
+            return 1;
+        }
+    }
+
     if (!context_animation_init()) {
         /* context_animation_init prints its own error message */
         return 1;
     }
 
+    spiral_set_threads(THREADS, THREAD_AFFINITY);
+    spiral_set_samples(SPIRAL_SAMPLES);
+    if (!spiral_set_kernel(SPIRAL_KERNEL.kernel)) {
+        fprintf(stderr, "The kernel is not supported by this CPU.\n");
+        return 1;
+    }
     if (!context_spiral_init(viewport_width, viewport_height)) {
         /* context_spiral_init prints its own error message */
         return 1;
     }
 
-    /* Enter the main loop */
-    while (handle_events());
+    if (!context_regeneration_init()) {
+        /* context_regeneration_init prints its own error message */
+        return 1;
+    }
+
+    /* Frames are not dropped when exporting, since the time step is fixed */
+    if (ARGUMENT_VALUE(metrics_path)) {
+        context.metrics = metrics_create(ARGUMENT_VALUE(metrics_path),
+            ARGUMENT_VALUE(metrics_interval),
+            EXPORT_PATH
+                ? 0.0
+                : 1.0 / (FRAME_RATE > 0.0
+                    ? FRAME_RATE
+                    : SCHEDULER_FALLBACK_RATE));
+        if (!context.metrics) {
+            /* metrics_create prints its own error message */
+            return 1;
+        }
+    }
+
+    if (EXPORT_PATH) {
+        result = !do_export(viewport_width, viewport_height);
+    }
+    else {
+        context_scheduler_init(FRAME_RATE);
+
+        /* Enter the main loop */
+        while (handle_events()) {
+            context_scheduler_wait();
+            do_display();
+            context_scheduler_advance();
+        }
+    }
 
     /* Release resources */
+    metrics_free(context.metrics);
+    context_regeneration_free();
     context_spiral_free();
     context_animation_free();
+    compositor_free(context.software.compositor);
 
-    SDL_RemoveTimer(timer);
+    if (EXPORT_PATH && RENDERER == RENDERER_OPENGL) {
+        headless_free();
+    }
 
-    return 0;
+    return result;
 }
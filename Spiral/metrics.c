@@ -0,0 +1,333 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+/**
+ * The number of most recent frames included in the statistics.
+ */
+#define METRICS_WINDOW 1024
+
+/**
+ * The width, in seconds, of a histogram bucket.
+ */
+#define METRICS_BUCKET_WIDTH 0.0001
+
+/**
+ * The number of histogram buckets; the last bucket contains all durations
+ * that do not fit in the other ones.
+ */
+#define METRICS_BUCKETS 2500
+
+/**
+ * The names of the stages, in the order of MetricsStage.
+ */
+static const char *metrics_stage_names[] = {
+    "animation",
+    "spiral",
+    "swap",
+    "generation",
+    "upload",
+    "interval"};
+
+/**
+ * Non-zero if SIGUSR1 has been received since the last dump.
+ */
+static volatile sig_atomic_t metrics_signalled = 0;
+
+/**
+ * The durations of one stage of the most recent frames.
+ */
+typedef struct {
+    /** The durations, in seconds; this is a ring buffer, where the oldest
+        duration is at index position once the buffer is full */
+    float samples[METRICS_WINDOW];
+
+    /** The index of the next sample to write, and the number of samples */
+    unsigned int position, count;
+
+    /** The number of samples in every bucket */
+    unsigned int histogram[METRICS_BUCKETS];
+
+    /** The sum of all samples */
+    double sum;
+} MetricsSeries;
+
+struct Metrics {
+    /** The file statistics are written to */
+    FILE *file;
+
+    /** The number of seconds between dumps, or 0.0 */
+    double dump_interval;
+
+    /** The expected number of seconds between frames, or 0.0 */
+    double frame_interval;
+
+    /** The time when the collector was created, when the previous frame
+        ended and when the statistics were last written */
+    double start, previous, dumped;
+
+    /** The number of frames recorded and dropped since the collector was
+        created */
+    unsigned long frames, dropped;
+
+    /** The durations of every stage */
+    MetricsSeries series[METRICS_STAGE_COUNT];
+};
+
+/**
+ * Records that SIGUSR1 has been received.
+ */
+static void
+metrics_signal(int signal)
+{
+    metrics_signalled = 1;
+}
+
+/**
+ * Returns the histogram bucket of a duration.
+ *
+ * @param seconds
+ *     The duration.
+ * @return the index of the bucket
+ */
+static unsigned int
+metrics_bucket(float seconds)
+{
+    double bucket = seconds / METRICS_BUCKET_WIDTH;
+
+    if (bucket < 0.0) {
+        return 0;
+    }
+    else if (bucket >= METRICS_BUCKETS - 1) {
+        return METRICS_BUCKETS - 1;
+    }
+    else {
+        return (unsigned int)bucket;
+    }
+}
+
+/**
+ * Returns the number of frames dropped during an interval between two frames.
+ *
+ * @param self
+ *     The collector.
+ * @param interval
+ *     The interval, in seconds.
+ * @return the number of frames that should have been displayed during the
+ *     interval
+ */
+static unsigned int
+metrics_dropped(const Metrics *self, double interval)
+{
+    if (self->frame_interval <= 0.0
+            || interval < 1.5 * self->frame_interval) {
+        return 0;
+    }
+
+    return (unsigned int)(interval / self->frame_interval + 0.5) - 1;
+}
+
+/**
+ * Returns the duration below which a fraction of the samples of a series
+ * fall.
+ *
+ * The result is the upper bound of the histogram bucket containing the
+ * percentile.
+ *
+ * @param series
+ *     The series.
+ * @param fraction
+ *     The fraction, between 0.0 and 1.0.
+ * @return the duration, in seconds
+ */
+static double
+metrics_percentile(const MetricsSeries *series, double fraction)
+{
+    unsigned int target = (unsigned int)(fraction * series->count + 0.5);
+    unsigned int i, count = 0;
+
+    if (target < 1) {
+        target = 1;
+    }
+    for (i = 0; i < METRICS_BUCKETS - 1; i++) {
+        count += series->histogram[i];
+        if (count >= target) {
+            break;
+        }
+    }
+
+    return (i + 1) * METRICS_BUCKET_WIDTH;
+}
+
+Metrics*
+metrics_create(const char *path, double dump_interval,
+    double frame_interval)
+{
+    Metrics *self;
+    struct sigaction action;
+
+    self = malloc(sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+    memset(self, 0, sizeof(*self));
+
+    self->file = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (!self->file) {
+        fprintf(stderr, "Unable to open %s.\n", path);
+        free(self);
+        return NULL;
+    }
+
+    self->dump_interval = dump_interval;
+    self->frame_interval = frame_interval;
+    self->start = metrics_now();
+    self->dumped = self->start;
+
+    /* Restart interrupted system calls, so that the main loop is not
+       affected */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = metrics_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    return self;
+}
+
+double
+metrics_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+metrics_add(Metrics *self, MetricsStage stage, double seconds)
+{
+    MetricsSeries *series;
+
+    if (!self) {
+        return;
+    }
+    series = &self->series[stage];
+
+    /* Remove the oldest sample once the window is full */
+    if (series->count == METRICS_WINDOW) {
+        float oldest = series->samples[series->position];
+        series->histogram[metrics_bucket(oldest)]--;
+        series->sum -= oldest;
+    }
+    else {
+        series->count++;
+    }
+
+    series->samples[series->position] = (float)seconds;
+    series->histogram[metrics_bucket((float)seconds)]++;
+    series->sum += (float)seconds;
+    series->position = (series->position + 1) % METRICS_WINDOW;
+}
+
+void
+metrics_frame(Metrics *self)
+{
+    double now;
+
+    if (!self) {
+        return;
+    }
+    now = metrics_now();
+
+    /* The first frame has no interval */
+    if (self->frames) {
+        metrics_add(self, METRICS_STAGE_INTERVAL, now - self->previous);
+        self->dropped += metrics_dropped(self, now - self->previous);
+    }
+    self->previous = now;
+    self->frames++;
+
+    if (metrics_signalled || (self->dump_interval > 0.0
+            && now - self->dumped >= self->dump_interval)) {
+        metrics_dump(self);
+    }
+}
+
+void
+metrics_dump(Metrics *self)
+{
+    const MetricsSeries *interval;
+    unsigned long dropped = 0;
+    unsigned int i, j;
+    int first = 1;
+
+    if (!self) {
+        return;
+    }
+
+    metrics_signalled = 0;
+    self->dumped = metrics_now();
+
+    interval = &self->series[METRICS_STAGE_INTERVAL];
+    for (i = 0; i < interval->count; i++) {
+        dropped += metrics_dropped(self, interval->samples[i]);
+    }
+
+    fprintf(self->file, "{\"time\": %.3f, \"frames\": %lu, "
+        "\"dropped\": %lu, \"window_dropped\": %lu, \"stages\": {",
+        self->dumped - self->start, self->frames, self->dropped, dropped);
+    for (i = 0; i < METRICS_STAGE_COUNT; i++) {
+        const MetricsSeries *series = &self->series[i];
+        float max = 0.0f;
+
+        /* Stages that are never recorded, such as the swap when frames are
+           exported, are left out */
+        if (!series->count) {
+            continue;
+        }
+
+        for (j = 0; j < series->count; j++) {
+            if (series->samples[j] > max) {
+                max = series->samples[j];
+            }
+        }
+
+        fprintf(self->file, "%s\"%s\": {\"count\": %u, \"mean_ms\": %.3f, "
+            "\"p50_ms\": %.1f, \"p95_ms\": %.1f, \"p99_ms\": %.1f, "
+            "\"max_ms\": %.3f}",
+            first ? "" : ", ",
+            metrics_stage_names[i], series->count,
+            1e3 * series->sum / series->count,
+            1e3 * metrics_percentile(series, 0.50),
+            1e3 * metrics_percentile(series, 0.95),
+            1e3 * metrics_percentile(series, 0.99),
+            1e3 * max);
+        first = 0;
+    }
+    fprintf(self->file, "}}\n");
+    fflush(self->file);
+}
+
+void
+metrics_free(Metrics *self)
+{
+    if (!self) {
+        return;
+    }
+
+    metrics_dump(self);
+
+    signal(SIGUSR1, SIG_DFL);
+    if (self->file != stderr) {
+        fclose(self->file);
+    }
+    free(self);
+}
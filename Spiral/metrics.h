@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/**
+ * The parts of a frame whose durations are recorded.
+ */
+typedef enum {
+    /** The time spent drawing the animated background */
+    METRICS_STAGE_ANIMATION,
+
+    /** The time spent drawing the spiral */
+    METRICS_STAGE_SPIRAL,
+
+    /** The time spent swapping buffers, which includes waiting for the GPU
+        and for vertical sync */
+    METRICS_STAGE_SWAP,
+
+    /** The time spent generating a regenerated spiral on all threads; this
+        is recorded for the frames uploading one */
+    METRICS_STAGE_GENERATION,
+
+    /** The time spent copying a regenerated spiral to the pixel buffer and
+        uploading it to a texture */
+    METRICS_STAGE_UPLOAD,
+
+    /** The time between the ends of two consecutive frames */
+    METRICS_STAGE_INTERVAL,
+
+    /** The number of stages */
+    METRICS_STAGE_COUNT
+} MetricsStage;
+
+/**
+ * Frame time statistics.
+ *
+ * The durations of the most recent frames are kept in a histogram for every
+ * stage, from which percentiles are calculated. The statistics are written
+ * as one JSON object per line.
+ */
+typedef struct Metrics Metrics;
+
+/**
+ * Creates a statistics collector.
+ *
+ * All functions accept NULL in place of a collector and do nothing, so a
+ * collector that is disabled need not be checked by the caller.
+ *
+ * If this function returns successfully, metrics_free must be called.
+ *
+ * @param path
+ *     The file to write statistics to. If this is "-", statistics are
+ *     written to stderr.
+ * @param dump_interval
+ *     The number of seconds between dumps, or 0.0 to dump only on SIGUSR1
+ *     and when the collector is freed.
+ * @param frame_interval
+ *     The expected number of seconds between frames; longer intervals are
+ *     counted as dropped frames. If this is 0.0, no frames are counted as
+ *     dropped.
+ * @return a new collector, or NULL if an error occurred
+ * @see metrics_free
+ */
+Metrics*
+metrics_create(const char *path, double dump_interval,
+    double frame_interval);
+
+/**
+ * Returns the current time of a monotonic high resolution clock.
+ *
+ * @return the time in seconds since an unspecified point
+ */
+double
+metrics_now(void);
+
+/**
+ * Records the duration of a stage of the current frame.
+ *
+ * @param self
+ *     The collector.
+ * @param stage
+ *     The stage. METRICS_STAGE_INTERVAL is recorded by metrics_frame.
+ * @param seconds
+ *     The duration.
+ */
+void
+metrics_add(Metrics *self, MetricsStage stage, double seconds);
+
+/**
+ * Ends the current frame.
+ *
+ * The interval since the previous frame is recorded, and the statistics are
+ * written if a dump is due or SIGUSR1 has been received.
+ *
+ * @param self
+ *     The collector.
+ */
+void
+metrics_frame(Metrics *self);
+
+/**
+ * Writes the current statistics.
+ *
+ * @param self
+ *     The collector.
+ */
+void
+metrics_dump(Metrics *self);
+
+/**
+ * Writes the final statistics, and releases the resources allocated by
+ * metrics_create.
+ *
+ * @param self
+ *     The collector.
+ */
+void
+metrics_free(Metrics *self);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+
+#define OPENGL_IMPLEMENTATION
+#include "opengl.h"
+
+#define OPENGL_PROC(type, name) \
+    type opengl_##name = NULL;
+#include "opengl.def"
+#undef OPENGL_PROC
+
+void
+opengl_load(void *(*get_proc_address)(const char *name))
+{
+#define OPENGL_PROC(type, name) \
+    opengl_##name = (type)get_proc_address(#name);
+#include "opengl.def"
+#undef OPENGL_PROC
+}
+
+int
+opengl_has_extension(const char *name)
+{
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    size_t length = strlen(name);
+
+    while (extensions && (extensions = strstr(extensions, name))) {
+        /* Make sure that we do not match a prefix of another extension */
+        if (extensions[length] == ' ' || extensions[length] == '\0') {
+            return 1;
+        }
+        extensions += length;
+    }
+
+    return 0;
+}
+
+int
+opengl_has_version(int major, int minor)
+{
+    const char *version = (const char*)glGetString(GL_VERSION);
+    int context_major, context_minor;
+
+    if (!version
+            || sscanf(version, "%d.%d", &context_major, &context_minor) != 2) {
+        return 0;
+    }
+
+    return context_major > major
+        || (context_major == major && context_minor >= minor);
+}
+
+int
+opengl_has_buffers(void)
+{
+    return opengl_glGenBuffers
+        && opengl_glDeleteBuffers
+        && opengl_glBindBuffer
+        && opengl_glBufferData
+        && (opengl_has_version(1, 5)
+            || opengl_has_extension("GL_ARB_vertex_buffer_object"));
+}
+
+int
+opengl_has_pixel_buffers(void)
+{
+    return opengl_glGenBuffers
+        && opengl_glDeleteBuffers
+        && opengl_glBindBuffer
+        && opengl_glBufferData
+        && opengl_glMapBuffer
+        && opengl_glUnmapBuffer
+        && (opengl_has_version(2, 1)
+            || opengl_has_extension("GL_ARB_pixel_buffer_object"));
+}
+
+int
+opengl_has_framebuffers(void)
+{
+    return opengl_glGenFramebuffers
+        && opengl_glDeleteFramebuffers
+        && opengl_glBindFramebuffer
+        && opengl_glFramebufferRenderbuffer
+        && opengl_glCheckFramebufferStatus
+        && opengl_glGenRenderbuffers
+        && opengl_glDeleteRenderbuffers
+        && opengl_glBindRenderbuffer
+        && opengl_glRenderbufferStorage
+        && (opengl_has_version(3, 0)
+            || opengl_has_extension("GL_ARB_framebuffer_object"));
+}
+
+int
+opengl_has_shaders(void)
+{
+    return opengl_glCreateShader
+        && opengl_glDeleteShader
+        && opengl_glShaderSource
+        && opengl_glCompileShader
+        && opengl_glGetShaderiv
+        && opengl_glGetShaderInfoLog
+        && opengl_glCreateProgram
+        && opengl_glDeleteProgram
+        && opengl_glAttachShader
+        && opengl_glLinkProgram
+        && opengl_glGetProgramiv
+        && opengl_glGetProgramInfoLog
+        && opengl_glUseProgram
+        && opengl_glGetUniformLocation
+        && opengl_glUniform1f
+        && opengl_has_version(2, 0);
+}
+
+/**
+ * Compiles a shader.
+ *
+ * @param type
+ *     The type of shader.
+ * @param source
+ *     The source code.
+ * @return the shader, or 0 if it failed to compile
+ */
+static GLuint
+opengl_shader_create(GLenum type, const char *source)
+{
+    GLuint shader;
+    GLint status;
+
+    shader = opengl_glCreateShader(type);
+    opengl_glShaderSource(shader, 1, &source, NULL);
+    opengl_glCompileShader(shader);
+
+    opengl_glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+
+        opengl_glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "Failed to compile shader: %s\n", log);
+        opengl_glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+GLuint
+opengl_program_create(const char *vertex, const char *fragment)
+{
+    GLuint program, vertex_shader, fragment_shader;
+    GLint status;
+
+    vertex_shader = opengl_shader_create(GL_VERTEX_SHADER, vertex);
+    fragment_shader = opengl_shader_create(GL_FRAGMENT_SHADER, fragment);
+    if (!vertex_shader || !fragment_shader) {
+        if (vertex_shader) {
+            opengl_glDeleteShader(vertex_shader);
+        }
+        if (fragment_shader) {
+            opengl_glDeleteShader(fragment_shader);
+        }
+        return 0;
+    }
+
+    program = opengl_glCreateProgram();
+    opengl_glAttachShader(program, vertex_shader);
+    opengl_glAttachShader(program, fragment_shader);
+    opengl_glLinkProgram(program);
+
+    /* The shaders are deleted when the program is deleted */
+    opengl_glDeleteShader(vertex_shader);
+    opengl_glDeleteShader(fragment_shader);
+
+    opengl_glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+
+        opengl_glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Failed to link program: %s\n", log);
+        opengl_glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
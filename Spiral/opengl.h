@@ -0,0 +1,130 @@
+#ifndef OPENGL_H
+#define OPENGL_H
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/*
+ * Declare a pointer for every function in opengl.def, and make the function
+ * name refer to it; opengl.c defines OPENGL_IMPLEMENTATION to load the
+ * pointers by name.
+ */
+#define OPENGL_PROC(type, name) \
+    extern type opengl_##name;
+#include "opengl.def"
+#undef OPENGL_PROC
+
+#ifndef OPENGL_IMPLEMENTATION
+#define glGenBuffers opengl_glGenBuffers
+#define glDeleteBuffers opengl_glDeleteBuffers
+#define glBindBuffer opengl_glBindBuffer
+#define glBufferData opengl_glBufferData
+#define glMapBuffer opengl_glMapBuffer
+#define glUnmapBuffer opengl_glUnmapBuffer
+#define glCreateShader opengl_glCreateShader
+#define glDeleteShader opengl_glDeleteShader
+#define glShaderSource opengl_glShaderSource
+#define glCompileShader opengl_glCompileShader
+#define glGetShaderiv opengl_glGetShaderiv
+#define glGetShaderInfoLog opengl_glGetShaderInfoLog
+#define glCreateProgram opengl_glCreateProgram
+#define glDeleteProgram opengl_glDeleteProgram
+#define glAttachShader opengl_glAttachShader
+#define glLinkProgram opengl_glLinkProgram
+#define glGetProgramiv opengl_glGetProgramiv
+#define glGetProgramInfoLog opengl_glGetProgramInfoLog
+#define glUseProgram opengl_glUseProgram
+#define glGetUniformLocation opengl_glGetUniformLocation
+#define glUniform1f opengl_glUniform1f
+#define glGenFramebuffers opengl_glGenFramebuffers
+#define glDeleteFramebuffers opengl_glDeleteFramebuffers
+#define glBindFramebuffer opengl_glBindFramebuffer
+#define glFramebufferRenderbuffer opengl_glFramebufferRenderbuffer
+#define glCheckFramebufferStatus opengl_glCheckFramebufferStatus
+#define glGenRenderbuffers opengl_glGenRenderbuffers
+#define glDeleteRenderbuffers opengl_glDeleteRenderbuffers
+#define glBindRenderbuffer opengl_glBindRenderbuffer
+#define glRenderbufferStorage opengl_glRenderbufferStorage
+#endif
+
+/**
+ * Loads the functions listed in opengl.def.
+ *
+ * This must be called after the OpenGL context has been created. Functions
+ * that are not available are set to NULL. Until this is called, the
+ * opengl_has_* functions for features requiring loaded functions return 0
+ * without querying the context, so they may be called without one.
+ *
+ * @param get_proc_address
+ *     The function used to look up functions by name, such as
+ *     SDL_GL_GetProcAddress.
+ */
+void
+opengl_load(void *(*get_proc_address)(const char *name));
+
+/**
+ * Returns whether the OpenGL context supports an extension.
+ *
+ * @param name
+ *     The name of the extension, such as "GL_ARB_pixel_buffer_object".
+ * @return non-zero if the extension is supported and 0 otherwise
+ */
+int
+opengl_has_extension(const char *name);
+
+/**
+ * Returns whether the OpenGL context is at least a specific version.
+ *
+ * @param major, minor
+ *     The version.
+ * @return non-zero if the version of the context is at least major.minor and
+ *     0 otherwise
+ */
+int
+opengl_has_version(int major, int minor);
+
+/**
+ * Returns whether vertex and index data may be stored in buffer objects.
+ *
+ * @return non-zero if buffer objects are supported and 0 otherwise
+ */
+int
+opengl_has_buffers(void);
+
+/**
+ * Returns whether pixel buffer objects may be used to upload textures.
+ *
+ * @return non-zero if pixel buffer objects are supported and 0 otherwise
+ */
+int
+opengl_has_pixel_buffers(void);
+
+/**
+ * Returns whether framebuffer objects are supported.
+ *
+ * @return non-zero if framebuffer objects are supported and 0 otherwise
+ */
+int
+opengl_has_framebuffers(void);
+
+/**
+ * Returns whether GLSL shaders are supported.
+ *
+ * @return non-zero if shaders are supported and 0 otherwise
+ */
+int
+opengl_has_shaders(void);
+
+/**
+ * Compiles and links a program.
+ *
+ * Compilation and link errors are printed.
+ *
+ * @param vertex, fragment
+ *     The source code of the vertex and fragment shaders.
+ * @return the program, or 0 if it could not be created
+ */
+GLuint
+opengl_program_create(const char *vertex, const char *fragment);
+
+#endif
@@ -2,153 +2,222 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <para/para.h>
-
-#include "spiral.h"
+#include "spiral_private.h"
 
 /**
- * The width of the anti aliased border around a spiral line.
+ * The kernel used by spiral_create.
  */
-#define ANTI_ALIAS_BORDER 0.08
+static SpiralKernel spiral_kernel = SPIRAL_KERNEL_AUTO;
 
 /**
- * The minimum diameter of the centre circle.
+ * The number of samples along each axis of the pixels on edges.
  */
-#define CENTER_RADIUS 3.0
-
-struct Spiral {
-    /** The spiral data, which is an array of bytes; the size of the buffer is
-        height * width */
-    unsigned char *data;
+static unsigned int spiral_samples = 1;
 
-    /** The dimensions of the buffer */
-    unsigned int width, height;
+/**
+ * The layout of the spirals created by spiral_create.
+ */
+static SpiralLayout spiral_layout = SPIRAL_LAYOUT_ROWS;
 
-    /** The number of curves that extend from the centre **/
-    unsigned int curves;
+void
+spiral_row_scalar(const Spiral *s, int y, int start, int end,
+    unsigned char *d)
+{
+    int x;
+    double cx = 0.5 * s->width;
+    double cy = 0.5 * s->height;
+    double dy = y - cy;
+    int center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
 
-     /** The number of alterations of direction of the curves */
-    unsigned int alterations;
+    for (x = start; x < end; x++) {
+        double dx = x - cx;
+        double h = hypot(dx, dy);
 
-    /** The radius of the spiral; pixels further from the centre will be
-        black */
-    unsigned int radius;
+        /* Include one extra pixel to enable anti aliasing */
+        if (h < s->radius + 1) {
+            *d = get_alpha(s, h, atan2(dy, dx), center_radius);
+        }
+        else {
+            *d = 0;
+        }
 
-    /** The twist to apply */
-    double twist;
+        d++;
+    }
+}
 
-    /** The width of the curves; 0.5 means that half of the spiral will be
-        painted with the foreground colour and half with the background
-        colour */
-    double line_width;
-};
+Symmetry
+spiral_get_symmetry(const Spiral *s)
+{
+    if (s->width < 2 || s->height < 2 || s->curves % 2) {
+        return SYMMETRY_NONE;
+    }
+    else if (s->curves % 4 == 0 && s->width == s->height) {
+        return SYMMETRY_QUARTER;
+    }
+    else {
+        return SYMMETRY_HALF;
+    }
+}
 
 /**
- * Calculates the distance to the centre of a line.
+ * Calculates the independent part of a tile of the region.
  *
- * @param s
- *     The spiral.
- * @param h, angle
- *     The polar coordinates of the point.
- * @return the distance to the centre of a line
+ * If the spiral has a symmetry, this is only called for the top half, and for
+ * SYMMETRY_QUARTER only the left half of all scan lines above the centre is
+ * calculated.
  */
-static inline double
-get_distance_to_line(Spiral *s, double h, double angle)
+static void
+spiral_initialize_do(SpiralGeneration *g, const SpiralRegion *tile)
 {
-    double segment, t, twisted;
+    Spiral *s = g->spiral;
+    int start = tile->x;
+    int end = tile->x + tile->width;
+    int half = (s->width + 1) / 2;
+    int y;
+
+    if (g->samples <= 1) {
+        int last = end;
+        int rows = tile->height;
+
+        if (g->symmetry == SYMMETRY_QUARTER && end > half) {
+            last = half;
+
+            /* The centre scan line is not covered by the rotated copy; it
+               is the last scan line calculated */
+            y = s->height / 2;
+            if (s->height % 2 == 0 && y < tile->y + tile->height) {
+                rows--;
+                g->kernel(s, y, start, end, g->data + y * g->stride + start);
+            }
+        }
 
-    /* Calculate the current segment, and how far we have reached within it */
-    t = modf(s->alterations * h / s->radius, &segment);
+        if (start < last && rows > 0) {
+            spiral_render_classified(s, g->kernel, g->region.x + start,
+                g->region.y + tile->y, last - start, rows,
+                g->data + tile->y * g->stride + start, g->stride);
+        }
+    }
+    else if (g->symmetry == SYMMETRY_QUARTER && end > half) {
+        if (start < half) {
+            spiral_supersample_rows(g, tile->y, tile->y + tile->height,
+                start, half);
+        }
 
-    /* Calculate the twisted angle */
-    twisted = fmod(s->curves * (angle + ((int)segment % 2
-        ? t * s->twist
-        : s->twist * (1.0 - t))), 2 * M_PI);
-    if (twisted < 0.0) {
-        twisted += 2 * M_PI;
+        /* The centre scan line is not covered by the rotated copy */
+        y = s->height / 2;
+        if (s->height % 2 == 0
+                && y >= tile->y && y < tile->y + tile->height) {
+            start = start > half ? start : half;
+            spiral_supersample_span(g, y, start, end,
+                g->data + y * g->stride + start);
+        }
+    }
+    else {
+        spiral_supersample_rows(g, tile->y, tile->y + tile->height,
+            start, end);
     }
 
-    /* Return the absolute value of the distance to 0.5 */
-    return 2 * fabs((twisted / (2 * M_PI) - 0.5));
+    /* The top right quarter is only final once it has been rotated, but
+       the left half is complete */
+    if (g->reduced) {
+        spiral_mipmap_reduce_rect(g, tile->x, tile->y,
+            g->symmetry == SYMMETRY_QUARTER && end > half ? half : end,
+            tile->y + tile->height);
+    }
 }
 
+/**
+ * Fills the top right quarter of a range of scan lines by rotating the top
+ * left quarter by 90 degrees.
+ *
+ * The copy is performed in tiles, so that the transposed reads stay in the
+ * cache.
+ */
 static int
-spiral_initialize_do(Spiral *s, int start, int end, int gstart, int gend)
+spiral_rotate_do(SpiralGeneration *g, int start, int end, int gstart,
+    int gend)
 {
-    int x, y;
-    unsigned char *d;
-    double cx = 0.5 * s->width;
-    double cy = 0.5 * s->height;
-    int center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+    Spiral *s = g->spiral;
+    int x, y, tx, ty;
+    int width = s->width;
 
-    for (y = start; y < end; y++) {
-        double dy = y - cy;
-
-        /* Point d to the current scan line */
-        d = s->data + y * s->width;
-        for (x = 0; x < s->width; x++) {
-            double dx = x - cx;
-            double h = hypot(dx, dy);
-            unsigned int alpha = 0;
-
-            /* Include one extra pixel to enable anti aliasing */
-            if (h < s->radius + 1) {
-                double angle = atan2(dy, dx);
-                double distance;
-
-                distance = get_distance_to_line(s, h, angle);
-
-                /* Include the anti alias border to allow a smooth border of the
-                   spiral line */
-                if (distance < s->line_width + ANTI_ALIAS_BORDER) {
-                    if (distance > s->line_width) {
-                        alpha = (unsigned int)(255
-                            - 255 * (distance - s->line_width)
-                                / ANTI_ALIAS_BORDER);
-                    }
-                    else {
-                        alpha = 255;
-                    }
-                }
-                else {
-                    alpha = 0;
-                }
+    size_t stride = g->stride;
 
-                if ((int)h < center_radius) {
-                    alpha = 255;
-                }
-                else if ((int)h == center_radius) {
-                    double a = h - center_radius;
-                    alpha = (unsigned int)(alpha * a + 255 * (1.0 - a));
-                }
+    for (ty = start; ty < end; ty += SYMMETRY_TILE) {
+        int ty_end = ty + SYMMETRY_TILE < end ? ty + SYMMETRY_TILE : end;
+
+        for (tx = (width + 1) / 2; tx < width; tx += SYMMETRY_TILE) {
+            int tx_end = tx + SYMMETRY_TILE < width
+                ? tx + SYMMETRY_TILE
+                : width;
+
+            for (y = ty; y < ty_end; y++) {
+                unsigned char *d = g->data + y * stride;
 
-                /* If h is equal to or a fraction grater than the radius, we
-                   decrease the alpha */
-                if ((int)h == (int)s->radius) {
-                    alpha = (unsigned int)(alpha * (h - s->radius));
+                for (x = tx; x < tx_end; x++) {
+                    d[x] = g->data[(width - x) * stride + y];
                 }
             }
-            else {
-                alpha = 0;
-            }
+        }
 
-            *d = alpha;
-            d++;
+        /* The scan lines after the last range are already final */
+        if (g->reduced) {
+            spiral_mipmap_reduce_rect(g, (width + 1) / 2, ty, width,
+                ty_end < gend ? ty_end : spiral_symmetry_rows(s, g->symmetry));
         }
     }
 
     return 0;
 }
 
+/**
+ * Fills a range of scan lines of the bottom half by rotating the top half by
+ * 180 degrees.
+ *
+ * The first column has no counterpart and is calculated. The range may start
+ * with the last calculated scan line, which is left unchanged, so that it is
+ * reduced along with the next one.
+ */
+static int
+spiral_mirror_do(SpiralGeneration *g, int start, int end, int gstart,
+    int gend)
+{
+    Spiral *s = g->spiral;
+    int first = spiral_symmetry_rows(s, g->symmetry);
+    int x, y;
+
+    for (y = start > first ? start : first; y < end; y++) {
+        const unsigned char *source = g->data + (s->height - y) * g->stride;
+        unsigned char *d = g->data + y * g->stride;
+
+        if (g->samples > 1) {
+            spiral_supersample_span(g, y, 0, 1, d);
+        }
+        else {
+            g->kernel(s, y, 0, 1, d);
+        }
+        for (x = 1; x < s->width; x++) {
+            d[x] = source[s->width - x];
+        }
+    }
+
+    if (g->reduced) {
+        spiral_mipmap_reduce_rect(g, 0, start, s->width, end);
+    }
+
+    return 0;
+}
+
 Spiral*
-spiral_create(unsigned int width, unsigned int height, unsigned int curves,
-    unsigned int alterations, unsigned int radius, unsigned int twist,
-    double line_width)
+spiral_alloc(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters)
 {
     Spiral *self;
-    ParaContext *para;
 
     self = malloc(sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
     memset(self, 0, sizeof(*self));
 
     /* width or height may be too large */
@@ -161,16 +230,246 @@ spiral_create(unsigned int width, unsigned int height, unsigned int curves,
     /* Just copy the attributes */
     self->width = width;
     self->height = height;
-    self->curves = curves;
-    self->alterations = alterations;
-    self->radius = radius;
-    self->twist = twist;
-    self->line_width = line_width;
+    self->depth = 1;
+    self->levels = 1;
+    self->curves = parameters->curves;
+    self->alterations = parameters->alterations;
+    self->radius = parameters->radius;
+    self->twist = parameters->twist;
+    self->line_width = parameters->line_width;
+
+    return self;
+}
+
+int
+spiral_symmetry_rows(const Spiral *s, Symmetry symmetry)
+{
+    return symmetry == SYMMETRY_NONE
+        ? s->height
+        : s->height / 2 + 1;
+}
+
+void
+spiral_symmetry_fill(SpiralGeneration *g)
+{
+    Spiral *s = g->spiral;
+
+    int half = (s->width + 1) / 2;
+
+    /* Fill the top right quarter of the top half, and reduce the pixels
+       whose columns were split between the halves */
+    if (g->symmetry == SYMMETRY_QUARTER) {
+        spiral_pool_execute_range(g, (SpiralRangeCallback)spiral_rotate_do,
+            0, (s->height + 1) / 2, SYMMETRY_TILE);
+        if (g->reduced && half % 2) {
+            spiral_mipmap_reduce_rect(g, half - 1, 0, half + 1,
+                spiral_symmetry_rows(s, g->symmetry));
+        }
+    }
 
-    /* Create the texture */
-    para = para_create(self, (ParaCallback)spiral_initialize_do);
-    para_execute(para, 0, self->height);
-    para_free(para);
+    /* Fill the bottom half; the ranges start on even scan lines, so that no
+       reduced pixel is split between them */
+    if (g->symmetry != SYMMETRY_NONE) {
+        spiral_pool_execute_range(g, (SpiralRangeCallback)spiral_mirror_do,
+            spiral_symmetry_rows(s, g->symmetry) & ~1, s->height,
+            GENERATION_ROWS);
+    }
+}
+
+Spiral*
+spiral_create(unsigned int width, unsigned int height, unsigned int curves,
+    unsigned int alterations, unsigned int radius, unsigned int twist,
+    double line_width)
+{
+    SpiralParameters parameters;
+
+    parameters.curves = curves;
+    parameters.alterations = alterations;
+    parameters.radius = radius;
+    parameters.twist = twist;
+    parameters.line_width = line_width;
+
+    return spiral_create_with_parameters(width, height, &parameters);
+}
+
+/**
+ * Calculates a region of a spiral, as described for spiral_render_into, and
+ * optionally its second level of detail.
+ *
+ * @param reduced
+ *     The destination of the second level of detail, or NULL; if this is not
+ *     NULL, region must be NULL, and the spiral must be at least 2 x 2
+ *     pixels.
+ * @param reduced_stride
+ *     The distance, in bytes, between the starts of consecutive scan lines
+ *     of reduced.
+ */
+static int
+spiral_render(void *buffer, size_t stride, unsigned int width,
+    unsigned int height, const SpiralRegion *region,
+    const SpiralParameters *parameters, unsigned char *reduced,
+    size_t reduced_stride)
+{
+    SpiralGeneration generation;
+    Spiral s;
+
+    if (region) {
+        generation.region = *region;
+    }
+    else {
+        generation.region.x = 0;
+        generation.region.y = 0;
+        generation.region.width = width;
+        generation.region.height = height;
+    }
+    if (generation.region.x > width
+            || generation.region.width > width - generation.region.x
+            || generation.region.y > height
+            || generation.region.height > height - generation.region.y
+            || stride < generation.region.width) {
+        return 0;
+    }
+
+    /* The kernels only read the dimensions and the parameters */
+    memset(&s, 0, sizeof(s));
+    s.width = width;
+    s.height = height;
+    s.depth = 1;
+    s.levels = 1;
+    s.curves = parameters->curves;
+    s.alterations = parameters->alterations;
+    s.radius = parameters->radius;
+    s.twist = parameters->twist;
+    s.line_width = parameters->line_width;
+
+    /* Calculate only the part of the region that is not given by symmetry,
+       which is only exploited for the whole spiral */
+    generation.spiral = &s;
+    generation.kernel = spiral_kernel_get(spiral_kernel);
+    generation.symmetry = generation.region.width == width
+            && generation.region.height == height
+        ? spiral_get_symmetry(&s)
+        : SYMMETRY_NONE;
+    generation.data = buffer;
+    generation.stride = stride;
+    generation.samples = spiral_samples;
+    generation.reduced = reduced;
+    generation.reduced_stride = reduced_stride;
+
+    spiral_pool_execute(&generation, (SpiralTileCallback)spiral_initialize_do,
+        generation.region.width, generation.symmetry == SYMMETRY_NONE
+            ? generation.region.height
+            : spiral_symmetry_rows(&s, generation.symmetry),
+        GENERATION_TILE_WIDTH, GENERATION_TILE_HEIGHT);
+
+    spiral_symmetry_fill(&generation);
+
+    return 1;
+}
+
+int
+spiral_render_into(void *buffer, size_t stride, unsigned int width,
+    unsigned int height, const SpiralRegion *region,
+    const SpiralParameters *parameters)
+{
+    return spiral_render(buffer, stride, width, height, region, parameters,
+        NULL, 0);
+}
+
+/**
+ * Calculates the first level of a spiral, and the second one if the spiral
+ * has more than one level.
+ *
+ * @param s
+ *     The spiral.
+ * @return the number of levels calculated
+ */
+static unsigned int
+spiral_generate(Spiral *s)
+{
+    SpiralParameters parameters;
+
+    parameters.curves = s->curves;
+    parameters.alterations = s->alterations;
+    parameters.radius = s->radius;
+    parameters.twist = s->twist;
+    parameters.line_width = s->line_width;
+
+    /* A level with a dimension of 1 repeats the pixels of the level above,
+       and is left to spiral_mipmap_fill */
+    if (s->levels > 1 && s->width > 1 && s->height > 1) {
+        spiral_render(s->data, s->width, s->width, s->height, NULL,
+            &parameters, s->data + (size_t)s->width * s->height,
+            s->width / 2);
+        return 2;
+    }
+
+    spiral_render(s->data, s->width, s->width, s->height, NULL,
+        &parameters, NULL, 0);
+
+    return 1;
+}
+
+Spiral*
+spiral_create_with_parameters(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters)
+{
+    Spiral *self;
+
+    self = spiral_alloc(width, height, parameters);
+    if (!self) {
+        return NULL;
+    }
+
+    spiral_generate(self);
+
+    if (spiral_layout == SPIRAL_LAYOUT_TILED && !spiral_layout_tile(self)) {
+        spiral_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+int
+spiral_alloc_levels(Spiral *s)
+{
+    unsigned int levels = spiral_mipmap_levels(s->width, s->height);
+    unsigned char *data;
+    size_t size = 0;
+    unsigned int i;
+
+    /* Make room for the smaller levels after the first one */
+    for (i = 0; i < levels; i++) {
+        size += (size_t)(s->width >> i ? s->width >> i : 1)
+            * (s->height >> i ? s->height >> i : 1);
+    }
+    data = realloc(s->data, size);
+    if (!data) {
+        return 0;
+    }
+    s->data = data;
+    s->levels = levels;
+
+    return 1;
+}
+
+Spiral*
+spiral_create_with_mipmaps(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters)
+{
+    Spiral *self;
+
+    self = spiral_alloc(width, height, parameters);
+    if (!self) {
+        return NULL;
+    }
+    if (!spiral_alloc_levels(self)) {
+        spiral_free(self);
+        return NULL;
+    }
+
+    spiral_mipmap_fill(self, spiral_generate(self));
 
     return self;
 }
@@ -215,3 +514,155 @@ spiral_get_data(Spiral *self)
 
     return self->data;
 }
+
+unsigned int
+spiral_get_levels(Spiral *self)
+{
+    if (!self) {
+        return 0;
+    }
+
+    return self->levels;
+}
+
+/**
+ * Calculates the size of the data of one level of detail of a spiral.
+ *
+ * @param self
+ *     The spiral.
+ * @param level
+ *     The level, which must exist.
+ * @return the size in bytes, including the padding of the tiles if the level
+ *     is stored in tiles
+ */
+static size_t
+spiral_level_size(const Spiral *self, unsigned int level)
+{
+    size_t width = self->width >> level ? self->width >> level : 1;
+    size_t height = self->height >> level ? self->height >> level : 1;
+
+    /* Only the first level may be stored in tiles */
+    if (level == 0 && self->layout == SPIRAL_LAYOUT_TILED) {
+        width = (width + SPIRAL_TILE_SIZE - 1) / SPIRAL_TILE_SIZE
+            * SPIRAL_TILE_SIZE;
+        height = (height + SPIRAL_TILE_SIZE - 1) / SPIRAL_TILE_SIZE
+            * SPIRAL_TILE_SIZE;
+    }
+
+    return width * height * self->depth;
+}
+
+void*
+spiral_get_level_data(Spiral *self, unsigned int level)
+{
+    unsigned char *data;
+    unsigned int i;
+
+    if (!self || level >= self->levels) {
+        return NULL;
+    }
+
+    data = self->data;
+    for (i = 0; i < level; i++) {
+        data += spiral_level_size(self, i);
+    }
+
+    return data;
+}
+
+unsigned int
+spiral_get_depth(Spiral *self)
+{
+    if (!self) {
+        return 0;
+    }
+
+    return self->depth;
+}
+
+size_t
+spiral_get_size(Spiral *self)
+{
+    size_t size = 0;
+    unsigned int level;
+
+    if (!self) {
+        return 0;
+    }
+
+    for (level = 0; level < self->levels; level++) {
+        size += spiral_level_size(self, level);
+    }
+
+    return size;
+}
+
+int
+spiral_set_kernel(SpiralKernel kernel)
+{
+    if (!spiral_kernel_get(kernel)) {
+        return 0;
+    }
+
+    spiral_kernel = kernel == SPIRAL_KERNEL_AUTO
+        ? spiral_kernel_best()
+        : kernel;
+
+    return 1;
+}
+
+SpiralKernel
+spiral_get_kernel(void)
+{
+    if (spiral_kernel == SPIRAL_KERNEL_AUTO) {
+        spiral_kernel = spiral_kernel_best();
+    }
+
+    return spiral_kernel;
+}
+
+int
+spiral_set_samples(unsigned int samples)
+{
+    if (samples < 1 || samples > SPIRAL_MAX_SAMPLES) {
+        return 0;
+    }
+
+    spiral_samples = samples;
+
+    return 1;
+}
+
+unsigned int
+spiral_get_samples(void)
+{
+    return spiral_samples;
+}
+
+int
+spiral_set_layout(SpiralLayout layout)
+{
+    if (layout != SPIRAL_LAYOUT_ROWS && layout != SPIRAL_LAYOUT_TILED) {
+        return 0;
+    }
+
+    spiral_layout = layout;
+
+    return 1;
+}
+
+SpiralLayout
+spiral_get_layout(void)
+{
+    return spiral_layout;
+}
+
+SpiralLayout
+spiral_get_data_layout(Spiral *self)
+{
+    if (!self) {
+        return SPIRAL_LAYOUT_ROWS;
+    }
+
+    return self->layout;
+}
@@ -1,8 +1,123 @@
 #ifndef SPIRAL_H
 #define SPIRAL_H
 
+#include <stddef.h>
+
+/**
+ * The version of the spiral data.
+ *
+ * This is increased whenever a change makes the data created from the same
+ * parameters different, so that stored spirals may be invalidated.
+ */
+#define SPIRAL_DATA_VERSION 2
+
+/**
+ * The largest number of samples along each axis of a pixel.
+ *
+ * @see spiral_set_samples
+ */
+#define SPIRAL_MAX_SAMPLES 16
+
+/**
+ * The largest number of threads used to generate spirals.
+ *
+ * @see spiral_set_threads
+ */
+#define SPIRAL_MAX_THREADS 256
+
+/**
+ * The side, in pixels, of the tiles of a spiral stored in tiles.
+ *
+ * @see SPIRAL_LAYOUT_TILED
+ */
+#define SPIRAL_TILE_SIZE 64
+
 typedef struct Spiral Spiral;
 
+typedef struct SpiralGrid SpiralGrid;
+
+/**
+ * A rectangle of a spiral, in pixels from the top left corner.
+ */
+typedef struct {
+    /** The position of the top left pixel of the rectangle */
+    unsigned int x, y;
+
+    /** The dimensions of the rectangle */
+    unsigned int width, height;
+} SpiralRegion;
+
+/**
+ * The parameters of a spiral.
+ */
+typedef struct {
+    /** The number of curves that extend from the centre */
+    unsigned int curves;
+
+    /** The number of alterations of direction of the curves */
+    unsigned int alterations;
+
+    /** The radius of the spiral; pixels further from the centre will be
+        black */
+    unsigned int radius;
+
+    /** The twist to apply */
+    double twist;
+
+    /** The width of the curves; 0.5 means that half of the spiral will be
+        painted with the foreground colour and half with the background
+        colour */
+    double line_width;
+} SpiralParameters;
+
+/**
+ * The kinds of kernels used to calculate the spiral data.
+ */
+typedef enum {
+    /** Use the best kernel supported by the CPU */
+    SPIRAL_KERNEL_AUTO = 0,
+
+    /** The reference implementation, which uses double precision */
+    SPIRAL_KERNEL_SCALAR,
+
+    /** Calculates 4 pixels at a time using SSE2 */
+    SPIRAL_KERNEL_SSE2,
+
+    /** Calculates 8 pixels at a time using AVX2 and FMA */
+    SPIRAL_KERNEL_AVX2,
+
+    /** Calculates 16 pixels at a time using AVX-512 */
+    SPIRAL_KERNEL_AVX512,
+
+    /** Calculates one pixel at a time like the vectorised kernels, using
+        single precision and multiply and floor range reduction; this is
+        supported everywhere, and is the best kernel if no vectorised kernel
+        is */
+    SPIRAL_KERNEL_FLOAT
+} SpiralKernel;
+
+/**
+ * The arrangements of the pixels of a spiral in memory.
+ */
+typedef enum {
+    /** The scan lines are stored consecutively from the top, which is the
+        format of OpenGL textures */
+    SPIRAL_LAYOUT_ROWS = 0,
+
+    /** The spiral is split into square tiles of SPIRAL_TILE_SIZE pixels,
+        which are stored consecutively from left to right and from the top;
+        the scan lines of a tile are stored consecutively. The tiles on the
+        right and bottom edges are padded with zeros. A tile fills one page
+        of 4 kiB, so neighbouring pixels in any direction are mostly in the
+        same page, and often in the same cache line.
+
+        This only pays off when sampling spirals of 4096 pixels or more at
+        steep angles, where scan lines miss the TLB on every sample; smaller
+        spirals and shallow angles are sampled up to twice as fast from scan
+        lines, which spiral_bench measures */
+    SPIRAL_LAYOUT_TILED
+} SpiralLayout;
+
 /**
  * Initialises the data of a Spiral.
  *
@@ -25,6 +140,82 @@ spiral_create(unsigned int width, unsigned int height, unsigned int curves,
     unsigned int alterations, unsigned int radius, unsigned int twist,
     double line_width);
 
+/**
+ * Initialises the data of a Spiral from a set of parameters.
+ *
+ * This is equivalent to spiral_create, but allows a negative or fractional
+ * twist.
+ *
+ * @param width, height
+ *     The dimensions of the buffer.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return a new spiral, or NULL if memory could not be allocated
+ */
+Spiral*
+spiral_create_with_parameters(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters);
+
+/**
+ * Renders a region of a spiral into a buffer owned by the caller.
+ *
+ * This allocates no buffers, so a spiral may be rendered directly into mapped
+ * memory, and a part of it may be updated without calculating the rest. The
+ * pixels are those of the same region of a spiral created by
+ * spiral_create_with_parameters; with a vectorised kernel, pixels that the
+ * whole spiral copies from a symmetric position or calculates at the end of
+ * a vector may differ by one.
+ *
+ * @param buffer
+ *     The destination of the top left pixel of the region.
+ * @param stride
+ *     The distance, in bytes, between the starts of consecutive scan lines of
+ *     buffer; this must be at least the width of the region.
+ * @param width, height
+ *     The dimensions of the whole spiral, whose centre is the centre of this
+ *     rectangle.
+ * @param region
+ *     The region to render, or NULL to render the whole spiral.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return non-zero if the region was rendered, and 0 if it is not inside the
+ *     spiral or stride is too small
+ */
+int
+spiral_render_into(void *buffer, size_t stride, unsigned int width,
+    unsigned int height, const SpiralRegion *region,
+    const SpiralParameters *parameters);
+
+/**
+ * Initialises the data of a Spiral and a full chain of levels of detail.
+ *
+ * Level i + 1 has half the dimensions of level i, rounded down but at least
+ * 1, and every pixel is the average of the up to four pixels it covers in
+ * level i. The last level is 1x1. The levels are calculated in bands that fit
+ * in the cache.
+ *
+ * @param width, height
+ *     The dimensions of the first level.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return a new spiral, or NULL if memory could not be allocated
+ * @see spiral_get_level_data
+ */
+Spiral*
+spiral_create_with_mipmaps(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters);
+
+/**
+ * Calculates the number of levels in a full chain of levels of detail.
+ *
+ * @param width, height
+ *     The dimensions of the first level.
+ * @return the number of levels created by spiral_create_with_mipmaps, the
+ *     last of which is 1x1
+ */
+unsigned int
+spiral_mipmap_levels(unsigned int width, unsigned int height);
+
 /**
  * Frees a previously created spiral and all its data.
  *
@@ -58,7 +249,10 @@ spiral_get_height(Spiral *self);
  * Returns the data pointer of the spiral texture.
  *
  * The format of the texture is GL_ALPHA8, and its alignment is 1; thus the size
- * of the buffer is spiral_get_height(self) * spiral_get_width(self).
+ * of the buffer is spiral_get_height(self) * spiral_get_width(self). A spiral
+ * stored in tiles must instead be copied by spiral_copy_rows before it is
+ * uploaded, and the size of its buffer, which includes the padding of the
+ * tiles, is returned by spiral_get_size.
  *
  * @param self
  *     The spiral whose data to retrieve.
@@ -67,4 +261,377 @@ spiral_get_height(Spiral *self);
 void*
 spiral_get_data(Spiral *self);
 
+/**
+ * Returns the number of levels of detail of the spiral.
+ *
+ * @param self
+ *     The spiral.
+ * @return the number of levels, which is 1 unless the spiral was created by
+ *     spiral_create_with_mipmaps, or 0 if spiral is NULL
+ */
+unsigned int
+spiral_get_levels(Spiral *self);
+
+/**
+ * Returns the data pointer of one level of detail of the spiral.
+ *
+ * The levels are stored consecutively, so the data of all levels may be
+ * copied at once starting from spiral_get_data(self). A spiral stored in
+ * tiles has one level, which is the padded tiles.
+ *
+ * @param self
+ *     The spiral.
+ * @param level
+ *     The level; level 0 is the data returned by spiral_get_data.
+ * @return the data of the level, or NULL if self is NULL or the level does
+ *     not exist
+ */
+void*
+spiral_get_level_data(Spiral *self, unsigned int level);
+
+/**
+ * Returns the number of bytes per pixel of the spiral.
+ *
+ * @param self
+ *     The spiral.
+ * @return 2 for a spiral created by spiral_create_distance with a depth of 16
+ *     bits, 1 for all other spirals, or 0 if self is NULL
+ */
+unsigned int
+spiral_get_depth(Spiral *self);
+
+/**
+ * Returns the size of the data of all levels of detail of the spiral.
+ *
+ * The size of a spiral stored in tiles includes the padding of the tiles on
+ * its edges, so it is a multiple of SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE.
+ *
+ * @param self
+ *     The spiral.
+ * @return the size, in bytes, of the data starting at spiral_get_data(self),
+ *     or 0 if self is NULL
+ */
+size_t
+spiral_get_size(Spiral *self);
+
+/**
+ * Creates a table of the polar coordinates of the pixels of a buffer.
+ *
+ * The table depends only on the dimensions of the buffer, so it may be shared
+ * by any number of calls to spiral_create_batch.
+ *
+ * @param width, height
+ *     The dimensions of the buffer.
+ * @return a new grid, or NULL if memory could not be allocated
+ */
+SpiralGrid*
+spiral_grid_create(unsigned int width, unsigned int height);
+
+/**
+ * Frees a previously created grid.
+ *
+ * @param self
+ *     The grid to free. If this is NULL, no action is taken.
+ */
+void
+spiral_grid_free(SpiralGrid *self);
+
+/**
+ * Returns the width of the buffer described by a grid.
+ *
+ * @param self
+ *     The grid whose width to retrieve.
+ * @return the width of the buffer, or 0 if self is NULL
+ */
+unsigned int
+spiral_grid_get_width(const SpiralGrid *self);
+
+/**
+ * Returns the height of the buffer described by a grid.
+ *
+ * @param self
+ *     The grid whose height to retrieve.
+ * @return the height of the buffer, or 0 if self is NULL
+ */
+unsigned int
+spiral_grid_get_height(const SpiralGrid *self);
+
+/**
+ * Creates several spirals of the same size in one pass.
+ *
+ * The distance and angle of every pixel are read from grid instead of being
+ * calculated for every spiral. The phase of the lines is then the angle
+ * multiplied by a constant plus a term looked up by the distance, so changing
+ * the twist or the number of alterations of a spiral only changes that small
+ * table.
+ *
+ * @param grid
+ *     The polar coordinates of the pixels. The spirals will have the same
+ *     dimensions as the grid.
+ * @param parameters
+ *     The parameters of the spirals; this array must contain count elements.
+ * @param count
+ *     The number of spirals to create; if this is 0, nothing is done and the
+ *     call succeeds.
+ * @param spirals
+ *     The created spirals are stored here; this array must have room for
+ *     count elements. Every spiral must be freed with spiral_free.
+ * @return non-zero if the spirals were created, and 0 otherwise, in which
+ *     case spirals is filled with NULL
+ */
+int
+spiral_create_batch(const SpiralGrid *grid,
+    const SpiralParameters *parameters, unsigned int count, Spiral **spirals);
+
+/**
+ * Creates several spirals of the same size in one pass, each with a full
+ * chain of levels of detail.
+ *
+ * The first level of every spiral is calculated like by spiral_create_batch,
+ * and the other levels like by spiral_create_with_mipmaps.
+ *
+ * @param grid, parameters, count, spirals
+ *     As described for spiral_create_batch.
+ * @return non-zero if the spirals were created, and 0 otherwise, in which
+ *     case spirals is filled with NULL
+ * @see spiral_get_level_data
+ */
+int
+spiral_create_batch_with_mipmaps(const SpiralGrid *grid,
+    const SpiralParameters *parameters, unsigned int count, Spiral **spirals);
+
+/**
+ * Calculates the natural dimensions of a polar spiral.
+ *
+ * With these dimensions, the spacing of the samples along the rim and along
+ * the radius is one pixel of a spiral created by spiral_create_with_parameters.
+ *
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param width, height
+ *     The number of angles and distances are stored here.
+ */
+void
+spiral_polar_size(const SpiralParameters *parameters, unsigned int *width,
+    unsigned int *height);
+
+/**
+ * Creates one period of a spiral in polar coordinates.
+ *
+ * The pattern repeats every 2 pi / curves radians, so only one period is
+ * stored. The element at column x and row y is the alpha value at the angle
+ * (x + 0.5) / width * 2 pi / curves and the distance
+ * (y + 0.5) / height * (radius + 1) from the centre; the buffer thus wraps
+ * horisontally, and nothing is visible beyond its last row.
+ *
+ * @param width, height
+ *     The number of angles and distances to store.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return a new spiral, or NULL if memory could not be allocated
+ * @see spiral_polar_size
+ */
+Spiral*
+spiral_create_polar(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters);
+
+/**
+ * Creates a field of the distances to the curves of a spiral.
+ *
+ * The value of a pixel is the distance, as calculated before the line width
+ * is applied, from the point at which spiral_create calculates the pixel to
+ * the centre of the nearest curve; 0 is the centre of a curve, and the largest value is midway between
+ * two curves. A pixel is thus covered by a curve of width line_width if its
+ * value is less than line_width, so the field does not depend on the line
+ * width, and the signed distance to the edge of a curve is found by
+ * subtracting the line width. The value changes continuously, so the field
+ * may be magnified with linear filtering and thresholded when it is drawn.
+ *
+ * The centre disc and the rim are not part of the field, since they are
+ * simple functions of the distance to the centre.
+ *
+ * @param width, height
+ *     The dimensions of the field.
+ * @param parameters
+ *     The parameters of the spiral; the line width is ignored.
+ * @param bits
+ *     The precision of the values, which is 8 or 16. 16 bit values are stored
+ *     in the byte order of the CPU, and locate the edges of the curves more
+ *     precisely.
+ * @return a new spiral, or NULL if memory could not be allocated or bits is
+ *     not supported
+ * @see spiral_get_depth
+ */
+Spiral*
+spiral_create_distance(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters, unsigned int bits);
+
+/**
+ * Selects the kernel used by subsequent calls to spiral_create.
+ *
+ * All kernels except SPIRAL_KERNEL_SCALAR use single precision and polynomial
+ * approximations, so their output may differ slightly from that of
+ * SPIRAL_KERNEL_SCALAR, by at most 2 alpha levels on the edges of the lines;
+ * spiral_test checks this bound.
+ *
+ * @param kernel
+ *     The kernel to use.
+ * @return non-zero if the kernel is supported by the CPU and was selected,
+ *     and 0 otherwise
+ */
+int
+spiral_set_kernel(SpiralKernel kernel);
+
+/**
+ * Returns the kernel used by spiral_create.
+ *
+ * @return the kernel; this is never SPIRAL_KERNEL_AUTO
+ */
+SpiralKernel
+spiral_get_kernel(void);
+
+/**
+ * Selects the supersampling used by subsequent calls to spiral_create.
+ *
+ * The kernel calculates one sample per pixel. Where a pixel and its
+ * neighbours differ sharply, which happens on edges narrower than a pixel,
+ * and near the centre disc, the rim and the circles where the curves change
+ * direction, the pixel is instead the average of samples * samples points
+ * evenly spread over it. The cost thus depends on the number of such pixels,
+ * and grows with the square of samples.
+ *
+ * This does not apply to polar spirals, distance fields and spirals created
+ * by spiral_create_batch.
+ *
+ * @param samples
+ *     The number of samples along each axis of a pixel; 1 disables
+ *     supersampling, and the largest supported value is SPIRAL_MAX_SAMPLES.
+ * @return non-zero if the value is supported and was selected, and 0
+ *     otherwise
+ */
+int
+spiral_set_samples(unsigned int samples);
+
+/**
+ * Returns the supersampling used by spiral_create.
+ *
+ * @return the number of samples along each axis of a pixel on an edge
+ */
+unsigned int
+spiral_get_samples(void);
+
+/**
+ * Selects the layout of the spirals created by subsequent calls to
+ * spiral_create.
+ *
+ * The pixels are calculated in scan lines, and then rearranged. This does not
+ * apply to spirals with levels of detail, polar spirals, distance fields and
+ * spirals created by spiral_create_batch, which are always stored in scan
+ * lines. The default is SPIRAL_LAYOUT_ROWS, which the application always
+ * uses; see SPIRAL_LAYOUT_TILED for when tiles are worth selecting.
+ *
+ * @param layout
+ *     The layout.
+ * @return non-zero if the layout is supported and was selected, and 0
+ *     otherwise
+ * @see spiral_get_data_layout
+ */
+int
+spiral_set_layout(SpiralLayout layout);
+
+/**
+ * Returns the layout of the spirals created by spiral_create.
+ *
+ * @return the layout
+ */
+SpiralLayout
+spiral_get_layout(void);
+
+/**
+ * Returns the layout of the data of a spiral.
+ *
+ * @param self
+ *     The spiral.
+ * @return the layout, which is SPIRAL_LAYOUT_ROWS if self is NULL
+ */
+SpiralLayout
+spiral_get_data_layout(Spiral *self);
+
+/**
+ * Copies the first level of a spiral to a buffer in scan lines, whatever its
+ * layout.
+ *
+ * @param self
+ *     The spiral.
+ * @param buffer
+ *     The destination of the top left pixel.
+ * @param stride
+ *     The distance, in bytes, between the starts of consecutive scan lines of
+ *     buffer; this must be at least the width of the spiral multiplied by its
+ *     depth.
+ * @return non-zero if the spiral was copied, and 0 if self is NULL or stride
+ *     is too small
+ */
+int
+spiral_copy_rows(Spiral *self, void *buffer, size_t stride);
+
+/**
+ * Samples the first level of a spiral at evenly spaced points along a line.
+ *
+ * Every value is interpolated bilinearly from the four nearest pixels, and
+ * points outside the spiral take the value of the nearest pixel on its edge,
+ * like a texture clamped to its edges. The points are stepped in fixed point
+ * with 32 fractional bits, and the weights have 8 bits, like the texture
+ * units of GPUs. The pixels are addressed in the layout of the spiral, so a
+ * span crossing a tiled spiral at any angle reads only a few pages.
+ *
+ * @param self
+ *     The spiral; its depth must be 1.
+ * @param x, y
+ *     The first point, in pixels from the top left corner of the spiral; the
+ *     centre of the top left pixel is (0.5, 0.5).
+ * @param dx, dy
+ *     The offset from a point to the next one, in pixels.
+ * @param count
+ *     The number of points.
+ * @param d
+ *     The values are written here; this array must have room for count
+ *     elements.
+ * @return non-zero if the spiral was sampled, and 0 if self is NULL, empty
+ *     or its depth is not 1
+ */
+int
+spiral_sample(Spiral *self, double x, double y, double dx, double dy,
+    unsigned int count, unsigned char *d);
+
+/**
+ * Selects the threads used by subsequent calls to the functions generating
+ * spirals.
+ *
+ * Spirals are calculated in small tiles by a pool of workers, one of which is
+ * the calling thread. Every worker starts with a band of consecutive tiles,
+ * so that it touches the pages of the buffer it calculates first, and takes
+ * tiles from the other workers once its own are done. The threads are
+ * started by the next spiral generated.
+ *
+ * @param threads
+ *     The number of workers, or 0 for one per CPU the process may run on; the
+ *     largest supported value is SPIRAL_MAX_THREADS.
+ * @param pin
+ *     Whether to bind every thread of the pool to one CPU. The calling thread
+ *     is not bound, but the first CPU is left to it.
+ * @return non-zero if the value is supported and was selected, and 0
+ *     otherwise
+ */
+int
+spiral_set_threads(unsigned int threads, int pin);
+
+/**
+ * Returns the number of workers generating spirals.
+ *
+ * @return the number of workers, including the calling thread
+ */
+unsigned int
+spiral_get_threads(void);
+
 #endif
@@ -0,0 +1,1253 @@
+/*
+ * A benchmark of spiral generation.
+ *
+ * Spirals are generated for a matrix of sizes, parameters and thread counts,
+ * and the results are written to stdout as JSON, so that results from
+ * different builds can be compared.
+ *
+ * The thread count is selected by spiral_set_threads, and is measured for
+ * powers of two up to the number of CPUs the process may run on.
+ *
+ * Spirals stored in scan lines and in tiles are then sampled along rotated
+ * spans, like a rotated view of them, and the time and the cache and TLB
+ * misses per sample are reported; the misses are counted by the performance
+ * counters of the CPU when the kernel makes them available, and by a
+ * software model of a cache and a TLB, which does not depend on the machine.
+ *
+ * Spirals calculated from a separable phase by spiral_create_batch are timed
+ * against the kernel, and compared to the reference kernel.
+ *
+ * The error of every single precision kernel supported by the CPU is finally
+ * measured against the reference kernel, which uses double precision.
+ */
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spiral.h"
+
+/**
+ * The maximum number of timed repetitions of every case.
+ */
+#define BENCH_MAX_REPETITIONS 100
+
+/**
+ * The maximum number of thread counts measured.
+ */
+#define BENCH_MAX_THREAD_COUNTS 32
+
+/**
+ * The size, and the parameters, used when another dimension of the matrix is
+ * varied.
+ */
+#define BENCH_BASE_SIZE 4096
+#define BENCH_BASE_CURVES 10
+#define BENCH_BASE_ALTERATIONS 10
+#define BENCH_BASE_TWIST 5.0
+#define BENCH_BASE_LINE_WIDTH 0.2
+
+/**
+ * The size of the spirals compared to the reference kernel.
+ */
+#define BENCH_ERROR_SIZE 1024
+
+/**
+ * The events counted while spirals are sampled.
+ */
+typedef enum {
+    /** Memory accesses that miss the last level cache */
+    BENCH_COUNTER_CACHE_MISSES,
+
+    /** Data reads that miss the TLB */
+    BENCH_COUNTER_TLB_MISSES,
+
+    /** The number of counters */
+    BENCH_COUNTER_COUNT
+} BenchCounter;
+
+/**
+ * The cache simulated while spirals are sampled: 32 kiB of 64 byte lines,
+ * 8 way set associative, like the first level data cache of most x86 CPUs.
+ */
+#define BENCH_CACHE_LINE_SHIFT 6
+#define BENCH_CACHE_SETS 64
+#define BENCH_CACHE_WAYS 8
+
+/**
+ * The TLB simulated while spirals are sampled: 64 entries of 4 kiB pages,
+ * 4 way set associative, like the first level data TLB of most x86 CPUs.
+ */
+#define BENCH_TLB_PAGE_SHIFT 12
+#define BENCH_TLB_SETS 16
+#define BENCH_TLB_WAYS 4
+
+/**
+ * The number of fractional bits of the positions of samples, as used by
+ * spiral_sample.
+ */
+#define BENCH_POSITION_BITS 32
+
+/**
+ * A set associative cache with least recently used replacement, which counts
+ * the accesses that miss it.
+ */
+typedef struct {
+    /** The base 2 logarithm of the size of a line */
+    unsigned int shift;
+
+    /** The number of sets, which is a power of two, and of lines per set */
+    unsigned int sets, ways;
+
+    /** The line stored in every way of every set, plus 1, or 0 for an empty
+        way, and the time it was last used */
+    unsigned long long *lines, *used;
+
+    /** The time of the last access */
+    unsigned long long clock;
+
+    /** The number of accesses that missed */
+    double misses;
+} BenchLru;
+
+/**
+ * One case of the benchmark matrix.
+ */
+typedef struct {
+    /** The dimensions of the spiral; the spiral is square */
+    unsigned int size;
+
+    /** The parameters of the spiral; the radius is given by the size */
+    SpiralParameters parameters;
+
+    /** The number of threads generating the spiral */
+    int threads;
+
+    /** The side of a centred square region rendered into a buffer allocated
+        in advance, or 0 to create the whole spiral */
+    unsigned int region;
+
+    /** The number of samples along each axis of the pixels on edges */
+    unsigned int samples;
+} BenchCase;
+
+/**
+ * The timings of one case.
+ */
+typedef struct {
+    /** The fastest, median and mean times, and the standard deviation, all
+        expressed in seconds */
+    double min, median, mean, stddev;
+} BenchResult;
+
+/**
+ * The difference between the output of a kernel and the reference kernel.
+ */
+typedef struct {
+    /** The number of pixels compared */
+    double pixels;
+
+    /** The number of pixels that differ, and the sum of the absolute
+        differences */
+    double differing, sum;
+
+    /** The largest absolute difference */
+    int max;
+} BenchError;
+
+static struct {
+    /** The number of untimed runs before every case */
+    int warmup;
+
+    /** The number of timed runs of every case */
+    int repetitions;
+
+    /** The largest size to measure */
+    unsigned int max_size;
+
+    /** Whether the threads generating spirals are bound to CPUs */
+    int pin;
+
+    /** The thread counts to measure, in ascending order */
+    int thread_counts[BENCH_MAX_THREAD_COUNTS];
+    int thread_count_count;
+
+    /** Non-zero once the first result has been written */
+    int has_results;
+
+    /** The performance counters of the calling thread, or -1 for the
+        counters that are not available */
+    int counters[BENCH_COUNTER_COUNT];
+} bench;
+
+/**
+ * Returns the current time of a monotonic clock.
+ *
+ * @return the time in seconds
+ */
+static double
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Compares two doubles for qsort.
+ */
+static int
+bench_compare(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+
+    return (da > db) - (da < db);
+}
+
+/**
+ * Generates a spiral once.
+ *
+ * @param c
+ *     The case to run.
+ * @return the time taken in seconds, or a negative value if the spiral could
+ *     not be created
+ */
+static double
+bench_run_once(const BenchCase *c)
+{
+    Spiral *spiral;
+    double start, end;
+
+    if (!spiral_set_samples(c->samples)) {
+        return -1.0;
+    }
+
+    if (c->region) {
+        SpiralRegion region;
+        unsigned char *buffer;
+        int result;
+
+        region.x = (c->size - c->region) / 2;
+        region.y = (c->size - c->region) / 2;
+        region.width = c->region;
+        region.height = c->region;
+        buffer = malloc((size_t)c->region * c->region);
+        if (!buffer) {
+            return -1.0;
+        }
+        memset(buffer, 0, (size_t)c->region * c->region);
+
+        start = bench_now();
+        result = spiral_render_into(buffer, c->region, c->size, c->size,
+            &region, &c->parameters);
+        end = bench_now();
+        free(buffer);
+
+        return result ? end - start : -1.0;
+    }
+
+    start = bench_now();
+    spiral = spiral_create_with_parameters(c->size, c->size, &c->parameters);
+    end = bench_now();
+    if (!spiral) {
+        return -1.0;
+    }
+    spiral_free(spiral);
+
+    return end - start;
+}
+
+/**
+ * Calculates the statistics of the timed runs of a case.
+ *
+ * @param times
+ *     The times of the bench.repetitions runs; this is sorted.
+ * @param result
+ *     Receives the timings.
+ */
+static void
+bench_statistics(double *times, BenchResult *result)
+{
+    double sum = 0.0, squares = 0.0;
+    int i;
+
+    for (i = 0; i < bench.repetitions; i++) {
+        sum += times[i];
+    }
+
+    qsort(times, bench.repetitions, sizeof(*times), bench_compare);
+    result->min = times[0];
+    result->median = bench.repetitions % 2
+        ? times[bench.repetitions / 2]
+        : 0.5 * (times[bench.repetitions / 2 - 1]
+            + times[bench.repetitions / 2]);
+    result->mean = sum / bench.repetitions;
+    for (i = 0; i < bench.repetitions; i++) {
+        squares += (times[i] - result->mean) * (times[i] - result->mean);
+    }
+    result->stddev = bench.repetitions > 1
+        ? sqrt(squares / (bench.repetitions - 1))
+        : 0.0;
+}
+
+/**
+ * Runs one case of the matrix.
+ *
+ * @param c
+ *     The case to run.
+ * @param result
+ *     Receives the timings.
+ * @return non-zero if the case was run and 0 otherwise
+ */
+static int
+bench_run(const BenchCase *c, BenchResult *result)
+{
+    double times[BENCH_MAX_REPETITIONS];
+    int i;
+
+    if (!spiral_set_threads(c->threads, bench.pin)) {
+        return 0;
+    }
+
+    for (i = 0; i < bench.warmup; i++) {
+        if (bench_run_once(c) < 0.0) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < bench.repetitions; i++) {
+        times[i] = bench_run_once(c);
+        if (times[i] < 0.0) {
+            return 0;
+        }
+    }
+
+    bench_statistics(times, result);
+
+    return 1;
+}
+
+/**
+ * Writes the result of one case as a JSON object.
+ *
+ * @param group
+ *     The name of the dimension of the matrix being varied.
+ * @param c
+ *     The case.
+ * @param result
+ *     The timings of the case.
+ * @param single
+ *     The median time of the same case run on one thread, or 0.0 if it is
+ *     not known.
+ * @param unsampled
+ *     The median time of the same case without supersampling, or 0.0 if it
+ *     is not known.
+ */
+static void
+bench_print(const char *group, const BenchCase *c, const BenchResult *result,
+    double single, double unsampled)
+{
+    double pixels = c->region
+        ? (double)c->region * c->region
+        : (double)c->size * c->size;
+
+    printf("%s\n    {\"group\": \"%s\", \"size\": %u, \"region\": %u, "
+        "\"curves\": %u, \"alterations\": %u, \"twist\": %g, "
+        "\"line_width\": %g, \"samples\": %u, \"threads\": %d,\n"
+        "     \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, "
+        "\"stddev_ms\": %.3f, \"cv\": %.4f,\n"
+        "     \"mpixels_per_second\": %.2f",
+        bench.has_results ? "," : "",
+        group, c->size, c->region, c->parameters.curves,
+        c->parameters.alterations, c->parameters.twist,
+        c->parameters.line_width, c->samples, c->threads,
+        1e3 * result->min, 1e3 * result->median, 1e3 * result->mean,
+        1e3 * result->stddev,
+        result->mean > 0.0 ? result->stddev / result->mean : 0.0,
+        pixels / result->median * 1e-6);
+    if (single > 0.0) {
+        printf(", \"speedup\": %.3f, \"efficiency\": %.3f",
+            single / result->median,
+            single / result->median / c->threads);
+    }
+    if (unsampled > 0.0) {
+        printf(", \"cost\": %.3f", result->median / unsampled);
+    }
+    printf("}");
+    fflush(stdout);
+
+    bench.has_results = 1;
+}
+
+/**
+ * Runs a case for every thread count, and reports the scaling relative to
+ * the first thread count.
+ *
+ * @param group
+ *     The name of the dimension of the matrix being varied.
+ * @param c
+ *     The case to run; the thread count is ignored.
+ */
+static void
+bench_run_threads(const char *group, BenchCase c)
+{
+    BenchResult result;
+    double single = 0.0;
+    int i;
+
+    for (i = 0; i < bench.thread_count_count; i++) {
+        c.threads = bench.thread_counts[i];
+        if (!bench_run(&c, &result)) {
+            fprintf(stderr, "Failed to run case of size %u on %d threads\n",
+                c.size, c.threads);
+            continue;
+        }
+        if (c.threads == 1) {
+            single = result.median;
+        }
+        bench_print(group, &c, &result, single, 0.0);
+    }
+}
+
+/**
+ * Runs a case on all CPUs.
+ *
+ * @param group
+ *     The name of the dimension of the matrix being varied.
+ * @param c
+ *     The case to run; the thread count is ignored.
+ */
+static void
+bench_run_all(const char *group, BenchCase c)
+{
+    BenchResult result;
+
+    c.threads = bench.thread_counts[bench.thread_count_count - 1];
+    if (!bench_run(&c, &result)) {
+        fprintf(stderr, "Failed to run case of size %u\n", c.size);
+        return;
+    }
+    bench_print(group, &c, &result, 0.0, 0.0);
+}
+
+/**
+ * Runs a case on all CPUs for every number of samples, and reports the cost
+ * relative to no supersampling.
+ *
+ * @param group
+ *     The name of the dimension of the matrix being varied.
+ * @param c
+ *     The case to run; the thread count and the number of samples are
+ *     ignored.
+ * @param samples, count
+ *     The numbers of samples to measure; the first must be 1.
+ */
+static void
+bench_run_samples(const char *group, BenchCase c,
+    const unsigned int *samples, unsigned int count)
+{
+    BenchResult result;
+    double unsampled = 0.0;
+    unsigned int i;
+
+    c.threads = bench.thread_counts[bench.thread_count_count - 1];
+    for (i = 0; i < count; i++) {
+        c.samples = samples[i];
+        if (!bench_run(&c, &result)) {
+            fprintf(stderr, "Failed to run case of size %u with %u samples\n",
+                c.size, c.samples);
+            continue;
+        }
+        if (c.samples == 1) {
+            unsampled = result.median;
+        }
+        bench_print(group, &c, &result, 0.0, unsampled);
+    }
+}
+
+/**
+ * Compares two spirals of the same size.
+ *
+ * @param reference, spiral
+ *     The spirals.
+ * @param error
+ *     The difference is added to this.
+ */
+static void
+bench_difference(Spiral *reference, Spiral *spiral, BenchError *error)
+{
+    const unsigned char *a = spiral_get_data(reference);
+    const unsigned char *b = spiral_get_data(spiral);
+    size_t i, size = spiral_get_size(spiral);
+
+    for (i = 0; i < size; i++) {
+        int difference = abs(a[i] - b[i]);
+
+        if (difference) {
+            error->differing++;
+            error->sum += difference;
+            if (difference > error->max) {
+                error->max = difference;
+            }
+        }
+    }
+    error->pixels += size;
+}
+
+/**
+ * Compares a spiral generated by a kernel to one generated by the reference
+ * kernel.
+ *
+ * @param kernel
+ *     The kernel to measure; this must be supported.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param error
+ *     The difference is added to this.
+ * @return non-zero if the spirals were compared and 0 otherwise
+ */
+static int
+bench_error(SpiralKernel kernel, const SpiralParameters *parameters,
+    BenchError *error)
+{
+    Spiral *reference, *spiral;
+
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    reference = spiral_create_with_parameters(BENCH_ERROR_SIZE,
+        BENCH_ERROR_SIZE, parameters);
+    spiral_set_kernel(kernel);
+    spiral = spiral_create_with_parameters(BENCH_ERROR_SIZE,
+        BENCH_ERROR_SIZE, parameters);
+    if (!reference || !spiral) {
+        if (reference) {
+            spiral_free(reference);
+        }
+        if (spiral) {
+            spiral_free(spiral);
+        }
+        return 0;
+    }
+
+    bench_difference(reference, spiral, error);
+
+    spiral_free(reference);
+    spiral_free(spiral);
+
+    return 1;
+}
+
+/**
+ * Returns the case with the base parameters.
+ *
+ * @param size
+ *     The size of the spiral.
+ * @return the case
+ */
+static BenchCase
+bench_case(unsigned int size)
+{
+    BenchCase result;
+
+    result.size = size;
+    result.parameters.curves = BENCH_BASE_CURVES;
+    result.parameters.alterations = BENCH_BASE_ALTERATIONS;
+    result.parameters.radius = size / 2 - 1;
+    result.parameters.twist = BENCH_BASE_TWIST;
+    result.parameters.line_width = BENCH_BASE_LINE_WIDTH;
+    result.threads = 1;
+    result.region = 0;
+    result.samples = 1;
+
+    return result;
+}
+
+/**
+ * Opens a performance counter of the calling thread.
+ *
+ * The counter is disabled until it is enabled by bench_counters_start.
+ *
+ * @param type, config
+ *     The event, as described by perf_event_open(2).
+ * @return the file descriptor of the counter, or -1 if the event cannot be
+ *     counted
+ */
+static int
+bench_counter_open(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Resets and enables the available performance counters.
+ */
+static void
+bench_counters_start(void)
+{
+    int i;
+
+    for (i = 0; i < BENCH_COUNTER_COUNT; i++) {
+        if (bench.counters[i] >= 0) {
+            ioctl(bench.counters[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(bench.counters[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/**
+ * Disables the available performance counters, and adds their values.
+ *
+ * @param counts
+ *     The value of every counter is added to the element with its index.
+ */
+static void
+bench_counters_stop(double *counts)
+{
+    unsigned long long value;
+    int i;
+
+    for (i = 0; i < BENCH_COUNTER_COUNT; i++) {
+        if (bench.counters[i] >= 0) {
+            ioctl(bench.counters[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(bench.counters[i], &value, sizeof(value))
+                    == sizeof(value)) {
+                counts[i] += value;
+            }
+        }
+    }
+}
+
+/**
+ * Releases the memory of a simulated cache.
+ *
+ * @param lru
+ *     The cache.
+ */
+static void
+bench_lru_free(BenchLru *lru)
+{
+    free(lru->lines);
+    free(lru->used);
+    lru->lines = lru->used = NULL;
+}
+
+/**
+ * Initialises an empty simulated cache.
+ *
+ * @param lru
+ *     The cache.
+ * @param shift
+ *     The base 2 logarithm of the size of a line.
+ * @param sets, ways
+ *     The number of sets, which must be a power of two, and of lines per
+ *     set.
+ * @return non-zero if the cache was initialised, and 0 if memory could not
+ *     be allocated
+ */
+static int
+bench_lru_init(BenchLru *lru, unsigned int shift, unsigned int sets,
+    unsigned int ways)
+{
+    lru->shift = shift;
+    lru->sets = sets;
+    lru->ways = ways;
+    lru->lines = calloc((size_t)sets * ways, sizeof(*lru->lines));
+    lru->used = calloc((size_t)sets * ways, sizeof(*lru->used));
+    lru->clock = 0;
+    lru->misses = 0.0;
+    if (!lru->lines || !lru->used) {
+        bench_lru_free(lru);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Accesses a byte through a simulated cache; on a miss, the least recently
+ * used line of its set is replaced.
+ *
+ * @param lru
+ *     The cache.
+ * @param address
+ *     The address of the byte.
+ */
+static inline void
+bench_lru_access(BenchLru *lru, size_t address)
+{
+    unsigned long long line = (address >> lru->shift) + 1;
+    unsigned long long *lines = lru->lines
+        + (size_t)(line & (lru->sets - 1)) * lru->ways;
+    unsigned long long *used = lru->used + (lines - lru->lines);
+    unsigned int way, oldest = 0;
+
+    lru->clock++;
+    for (way = 0; way < lru->ways; way++) {
+        if (lines[way] == line) {
+            used[way] = lru->clock;
+            return;
+        }
+        if (used[way] < used[oldest]) {
+            oldest = way;
+        }
+    }
+
+    lines[oldest] = line;
+    used[oldest] = lru->clock;
+    lru->misses++;
+}
+
+/**
+ * Returns the offset of a pixel in the data of a spiral of depth 1.
+ *
+ * @param size
+ *     The dimensions of the spiral, which is square.
+ * @param tiled
+ *     Whether the spiral is stored in tiles.
+ * @param x, y
+ *     The pixel.
+ * @return the offset
+ */
+static inline size_t
+bench_offset(unsigned int size, int tiled, unsigned int x, unsigned int y)
+{
+    size_t columns = (size + SPIRAL_TILE_SIZE - 1) / SPIRAL_TILE_SIZE;
+
+    if (!tiled) {
+        return (size_t)y * size + x;
+    }
+
+    return ((y / SPIRAL_TILE_SIZE) * columns + x / SPIRAL_TILE_SIZE)
+            * SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE
+        + (y % SPIRAL_TILE_SIZE) * SPIRAL_TILE_SIZE + x % SPIRAL_TILE_SIZE;
+}
+
+/**
+ * Replays the pixels read by bench_sample_once through a simulated cache and
+ * TLB.
+ *
+ * The points are stepped in fixed point and clamped like by spiral_sample,
+ * and the four pixels around every point are accessed in the order it reads
+ * them. The addresses are the offsets of the pixels, as if the data started
+ * on a page.
+ *
+ * @param spiral
+ *     The spiral, which is square.
+ * @param angle
+ *     The angle of the view, in radians.
+ * @param cache, tlb
+ *     The simulated cache and TLB.
+ */
+static void
+bench_simulate_once(Spiral *spiral, double angle, BenchLru *cache,
+    BenchLru *tlb)
+{
+    const double one = 1LL << BENCH_POSITION_BITS;
+    unsigned int size = spiral_get_width(spiral);
+    int tiled = spiral_get_data_layout(spiral) == SPIRAL_LAYOUT_TILED;
+    const long long max = (long long)(size - 1) << BENCH_POSITION_BITS;
+    double c = cos(angle), s = sin(angle), half = 0.5 * size;
+    long long dx = llround(c * one), dy = llround(s * one);
+    unsigned int y, i, j;
+
+    for (y = 0; y < size; y++) {
+        double vx = 0.5 - half, vy = y + 0.5 - half;
+        long long px = llround((half + c * vx - s * vy - 0.5) * one);
+        long long py = llround((half + s * vx + c * vy - 0.5) * one);
+
+        for (i = 0; i < size; i++, px += dx, py += dy) {
+            long long cx = px < 0 ? 0 : px > max ? max : px;
+            long long cy = py < 0 ? 0 : py > max ? max : py;
+            unsigned int x0 = (unsigned int)(cx >> BENCH_POSITION_BITS);
+            unsigned int y0 = (unsigned int)(cy >> BENCH_POSITION_BITS);
+            size_t offsets[4];
+
+            offsets[0] = bench_offset(size, tiled, x0, y0);
+            offsets[1] = bench_offset(size, tiled, x0 + (x0 < size - 1), y0);
+            offsets[2] = bench_offset(size, tiled, x0, y0 + (y0 < size - 1));
+            offsets[3] = bench_offset(size, tiled, x0 + (x0 < size - 1),
+                y0 + (y0 < size - 1));
+            for (j = 0; j < 4; j++) {
+                bench_lru_access(cache, offsets[j]);
+                bench_lru_access(tlb, offsets[j]);
+            }
+        }
+    }
+}
+
+/**
+ * Samples a spiral like a view of it rotated about its centre, with one
+ * sample per pixel.
+ *
+ * @param spiral
+ *     The spiral, which is square.
+ * @param angle
+ *     The angle of the view, in radians.
+ * @param buffer
+ *     Receives the samples of a scan line of the view.
+ */
+static void
+bench_sample_once(Spiral *spiral, double angle, unsigned char *buffer)
+{
+    unsigned int size = spiral_get_width(spiral);
+    double c = cos(angle), s = sin(angle), half = 0.5 * size;
+    unsigned int y;
+
+    for (y = 0; y < size; y++) {
+        /* The centre of the first pixel of the scan line, relative to the
+           centre of the view */
+        double vx = 0.5 - half, vy = y + 0.5 - half;
+
+        spiral_sample(spiral, half + c * vx - s * vy, half + s * vx + c * vy,
+            c, s, size, buffer);
+    }
+}
+
+/**
+ * Samples a spiral stored in a layout at an angle, and writes the result as a
+ * JSON object.
+ *
+ * @param size
+ *     The dimensions of the spiral, which is square.
+ * @param layout
+ *     The layout of the spiral.
+ * @param angle
+ *     The angle of the view, in degrees.
+ * @param rows
+ *     The median time of the same case with the spiral stored in scan lines,
+ *     or 0.0 if it is not known.
+ * @return the median time, or a negative value if the spiral could not be
+ *     created
+ */
+static double
+bench_run_sampling(unsigned int size, SpiralLayout layout, double angle,
+    double rows)
+{
+    static const char *layout_names[] = {"rows", "tiled"};
+    double times[BENCH_MAX_REPETITIONS];
+    double counts[BENCH_COUNTER_COUNT] = {0.0};
+    double simulated[BENCH_COUNTER_COUNT] = {-1.0, -1.0};
+    double samples = (double)size * size;
+    BenchCase c = bench_case(size);
+    BenchResult result;
+    BenchLru cache = {0}, tlb = {0};
+    unsigned char *buffer;
+    Spiral *spiral;
+    int i;
+
+    spiral_set_layout(layout);
+    spiral = spiral_create_with_parameters(size, size, &c.parameters);
+    spiral_set_layout(SPIRAL_LAYOUT_ROWS);
+    buffer = malloc(size);
+    if (!spiral || !buffer) {
+        spiral_free(spiral);
+        free(buffer);
+        return -1.0;
+    }
+
+    for (i = 0; i < bench.warmup; i++) {
+        bench_sample_once(spiral, angle * M_PI / 180.0, buffer);
+    }
+    for (i = 0; i < bench.repetitions; i++) {
+        double start;
+
+        bench_counters_start();
+        start = bench_now();
+        bench_sample_once(spiral, angle * M_PI / 180.0, buffer);
+        times[i] = bench_now() - start;
+        bench_counters_stop(counts);
+    }
+    bench_statistics(times, &result);
+
+    /* The caches are warmed up by one pass, like by the untimed runs */
+    if (bench_lru_init(&cache, BENCH_CACHE_LINE_SHIFT, BENCH_CACHE_SETS,
+                BENCH_CACHE_WAYS)
+            && bench_lru_init(&tlb, BENCH_TLB_PAGE_SHIFT, BENCH_TLB_SETS,
+                BENCH_TLB_WAYS)) {
+        bench_simulate_once(spiral, angle * M_PI / 180.0, &cache, &tlb);
+        cache.misses = tlb.misses = 0.0;
+        bench_simulate_once(spiral, angle * M_PI / 180.0, &cache, &tlb);
+        simulated[0] = cache.misses / samples;
+        simulated[1] = tlb.misses / samples;
+    }
+    bench_lru_free(&cache);
+    bench_lru_free(&tlb);
+
+    spiral_free(spiral);
+    free(buffer);
+
+    printf("%s\n    {\"size\": %u, \"layout\": \"%s\", \"angle\": %g,\n"
+        "     \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, "
+        "\"stddev_ms\": %.3f, \"ns_per_sample\": %.3f",
+        bench.has_results ? "," : "",
+        size, layout_names[layout], angle,
+        1e3 * result.min, 1e3 * result.median, 1e3 * result.mean,
+        1e3 * result.stddev, result.median / samples * 1e9);
+    if (rows > 0.0) {
+        printf(", \"speedup\": %.3f", rows / result.median);
+    }
+    for (i = 0; i < BENCH_COUNTER_COUNT; i++) {
+        static const char *counter_names[] = {
+            "cache_misses_per_sample", "tlb_misses_per_sample"};
+
+        if (bench.counters[i] >= 0) {
+            printf(", \"%s\": %.4f", counter_names[i],
+                counts[i] / bench.repetitions / samples);
+        }
+        else {
+            printf(", \"%s\": null", counter_names[i]);
+        }
+    }
+    for (i = 0; i < BENCH_COUNTER_COUNT; i++) {
+        static const char *simulated_names[] = {
+            "simulated_cache_misses_per_sample",
+            "simulated_tlb_misses_per_sample"};
+
+        if (simulated[i] >= 0.0) {
+            printf(", \"%s\": %.4f", simulated_names[i], simulated[i]);
+        }
+        else {
+            printf(", \"%s\": null", simulated_names[i]);
+        }
+    }
+    printf("}");
+    fflush(stdout);
+
+    bench.has_results = 1;
+
+    return result.median;
+}
+
+/**
+ * Times the creation of a spiral from a separable phase against the kernel,
+ * and writes the result as a JSON object.
+ *
+ * The grid is created once and shared by the timed spirals, like when the
+ * parameters of a spiral change; the time to create it is reported
+ * separately. The spiral is compared to the reference kernel.
+ *
+ * @param size
+ *     The dimensions of the spiral, which is square.
+ * @return non-zero if the case was run and 0 otherwise
+ */
+static int
+bench_run_batch(unsigned int size)
+{
+    double times[BENCH_MAX_REPETITIONS];
+    BenchCase c = bench_case(size);
+    BenchResult kernel, batch, grid;
+    BenchError error;
+    SpiralKernel selected = spiral_get_kernel();
+    SpiralGrid *g = NULL;
+    Spiral *spiral, *reference;
+    int i;
+
+    c.threads = bench.thread_counts[bench.thread_count_count - 1];
+    if (!bench_run(&c, &kernel)) {
+        return 0;
+    }
+
+    for (i = 0; i < bench.warmup + bench.repetitions; i++) {
+        double start;
+
+        spiral_grid_free(g);
+        start = bench_now();
+        g = spiral_grid_create(size, size);
+        if (i >= bench.warmup) {
+            times[i - bench.warmup] = bench_now() - start;
+        }
+        if (!g) {
+            return 0;
+        }
+    }
+    bench_statistics(times, &grid);
+
+    for (i = 0; i < bench.warmup + bench.repetitions; i++) {
+        double start = bench_now();
+
+        if (!spiral_create_batch(g, &c.parameters, 1, &spiral)) {
+            spiral_grid_free(g);
+            return 0;
+        }
+        if (i >= bench.warmup) {
+            times[i - bench.warmup] = bench_now() - start;
+        }
+        spiral_free(spiral);
+    }
+    bench_statistics(times, &batch);
+
+    /* The separable phase is exact, but the grid stores the coordinates in
+       single precision */
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    reference = spiral_create_with_parameters(size, size, &c.parameters);
+    spiral_set_kernel(selected);
+    if (!reference || !spiral_create_batch(g, &c.parameters, 1, &spiral)) {
+        spiral_free(reference);
+        spiral_grid_free(g);
+        return 0;
+    }
+    memset(&error, 0, sizeof(error));
+    bench_difference(reference, spiral, &error);
+    spiral_free(reference);
+    spiral_free(spiral);
+    spiral_grid_free(g);
+
+    printf("%s\n    {\"size\": %u, \"threads\": %d, \"kernel_ms\": %.3f, "
+        "\"batch_ms\": %.3f, \"grid_ms\": %.3f, \"speedup\": %.3f,\n"
+        "     \"identical\": %s, \"max_error\": %d, \"differing\": %.6f}",
+        bench.has_results ? "," : "",
+        size, c.threads, 1e3 * kernel.median, 1e3 * batch.median,
+        1e3 * grid.median, kernel.median / batch.median,
+        error.differing > 0.0 ? "false" : "true", error.max,
+        error.differing / error.pixels);
+    fflush(stdout);
+
+    bench.has_results = 1;
+
+    return 1;
+}
+
+/**
+ * Prints the usage of the benchmark.
+ *
+ * @param name
+ *     The name of the executable.
+ */
+static void
+bench_usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [--warmup N] [--repetitions N] [--max-size SIZE] "
+        "[--kernel scalar|sse2|avx2|avx512|float] [--pin]\n",
+        name);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const char *kernel_names[] = {
+        "auto", "scalar", "sse2", "avx2", "avx512", "float"};
+    static const unsigned int curves[] = {3, 10, 12, 30};
+    static const unsigned int alterations[] = {1, 10, 30};
+    static const double twists[] = {0.0, 5.0, -30.0};
+    static const unsigned int samples[] = {1, 2, 3, 4, 8};
+    static const double angles[] = {0.0, 30.0, 90.0};
+    unsigned int size, base_size, i, j, k;
+    SpiralKernel kernel, selected;
+    cpu_set_t cpus;
+    int threads, cpu_count, printed = 0;
+
+    bench.warmup = 1;
+    bench.repetitions = 5;
+    bench.max_size = 16384;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--warmup") == 0) {
+            bench.warmup = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--repetitions") == 0) {
+            bench.repetitions = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--max-size") == 0) {
+            bench.max_size = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--kernel") == 0) {
+            i++;
+            for (kernel = SPIRAL_KERNEL_AUTO;
+                    kernel <= SPIRAL_KERNEL_FLOAT; kernel++) {
+                if (strcmp(argv[i], kernel_names[kernel]) == 0) {
+                    break;
+                }
+            }
+            if (kernel > SPIRAL_KERNEL_FLOAT || !spiral_set_kernel(kernel)) {
+                fprintf(stderr, "Unsupported kernel: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--pin") == 0) {
+            bench.pin = 1;
+        }
+        else {
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench.warmup < 0
+            || bench.repetitions < 1
+            || bench.repetitions > BENCH_MAX_REPETITIONS
+            || bench.max_size < 1024) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    /* Measure powers of two up to the number of CPUs, and the number of
+       CPUs */
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+        fprintf(stderr, "Unable to get CPU affinity\n");
+        return 1;
+    }
+    cpu_count = CPU_COUNT(&cpus);
+    for (threads = 1; threads < cpu_count
+            && bench.thread_count_count < BENCH_MAX_THREAD_COUNTS - 1;
+            threads *= 2) {
+        bench.thread_counts[bench.thread_count_count++] = threads;
+    }
+    bench.thread_counts[bench.thread_count_count++] = cpu_count;
+
+    printf("{\"kernel\": \"%s\", \"cpus\": %d, \"pin\": %s, "
+        "\"warmup\": %d, \"repetitions\": %d,\n \"results\": [",
+        kernel_names[spiral_get_kernel()], cpu_count,
+        bench.pin ? "true" : "false", bench.warmup, bench.repetitions);
+
+    base_size = bench.max_size < BENCH_BASE_SIZE
+        ? bench.max_size
+        : BENCH_BASE_SIZE;
+
+    /* Vary one dimension at a time around the base case, since the full
+       matrix would take hours; sizes are measured for every thread count */
+    for (size = 1024; size <= bench.max_size; size *= 2) {
+        bench_run_threads("size", bench_case(size));
+    }
+    for (i = 0; i < sizeof(curves) / sizeof(*curves); i++) {
+        BenchCase c = bench_case(base_size);
+        c.parameters.curves = curves[i];
+        bench_run_all("curves", c);
+    }
+    for (i = 0; i < sizeof(alterations) / sizeof(*alterations); i++) {
+        BenchCase c = bench_case(base_size);
+        c.parameters.alterations = alterations[i];
+        bench_run_all("alterations", c);
+    }
+    for (i = 0; i < sizeof(twists) / sizeof(*twists); i++) {
+        BenchCase c = bench_case(base_size);
+        c.parameters.twist = twists[i];
+        bench_run_all("twist", c);
+    }
+
+    /* Rendering into a caller buffer, for the whole spiral and for regions
+       too small to use its symmetry */
+    for (size = base_size; size >= 256; size /= 4) {
+        BenchCase c = bench_case(base_size);
+        c.region = size;
+        bench_run_all("region", c);
+    }
+
+    /* Supersampling the edges, for twists ranging from smooth ramps away
+       from the centre to edges sharper than a pixel everywhere */
+    for (i = 0; i < sizeof(twists) / sizeof(*twists); i++) {
+        BenchCase c = bench_case(base_size);
+        c.parameters.twist = twists[i];
+        bench_run_samples("samples", c, samples,
+            sizeof(samples) / sizeof(*samples));
+    }
+
+    /* Spirals from a separable phase, whose grid is shared when the
+       parameters change */
+    printf("\n ],\n \"batch\": [");
+    bench.has_results = 0;
+    spiral_set_samples(1);
+    for (size = 1024; size <= base_size; size *= 2) {
+        if (!bench_run_batch(size)) {
+            fprintf(stderr, "Failed to create batched spiral of size %u\n",
+                size);
+        }
+    }
+
+    /* Sampling along rotated spans, which reads a page per sample from a
+       large spiral stored in scan lines at steep angles; the spirals are
+       generated on all CPUs, and sampled on the calling thread */
+    printf("\n ],\n \"sampling\": [");
+    bench.has_results = 0;
+    spiral_set_threads(bench.thread_counts[bench.thread_count_count - 1],
+        bench.pin);
+    bench.counters[BENCH_COUNTER_CACHE_MISSES] = bench_counter_open(
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    bench.counters[BENCH_COUNTER_TLB_MISSES] = bench_counter_open(
+        PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+            | PERF_COUNT_HW_CACHE_OP_READ << 8
+            | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    for (size = 1024; size <= bench.max_size; size *= 2) {
+        for (i = 0; i < sizeof(angles) / sizeof(*angles); i++) {
+            double rows = bench_run_sampling(size, SPIRAL_LAYOUT_ROWS,
+                angles[i], 0.0);
+
+            if (rows < 0.0
+                    || bench_run_sampling(size, SPIRAL_LAYOUT_TILED,
+                        angles[i], rows) < 0.0) {
+                fprintf(stderr, "Failed to sample spiral of size %u\n",
+                    size);
+            }
+        }
+    }
+    for (i = 0; i < BENCH_COUNTER_COUNT; i++) {
+        if (bench.counters[i] >= 0) {
+            close(bench.counters[i]);
+        }
+    }
+
+    /* The error of the single precision kernels over the parameters varied
+       above, at a size where the reference kernel is fast enough */
+    printf("\n ],\n \"errors\": [");
+    selected = spiral_get_kernel();
+    spiral_set_samples(1);
+    for (kernel = SPIRAL_KERNEL_SSE2; kernel <= SPIRAL_KERNEL_FLOAT;
+            kernel++) {
+        BenchError error;
+
+        if (!spiral_set_kernel(kernel)) {
+            continue;
+        }
+        memset(&error, 0, sizeof(error));
+        for (i = 0; i < sizeof(curves) / sizeof(*curves); i++) {
+            for (j = 0; j < sizeof(alterations) / sizeof(*alterations); j++) {
+                for (k = 0; k < sizeof(twists) / sizeof(*twists); k++) {
+                    SpiralParameters parameters =
+                        bench_case(BENCH_ERROR_SIZE).parameters;
+
+                    parameters.curves = curves[i];
+                    parameters.alterations = alterations[j];
+                    parameters.twist = twists[k];
+                    if (!bench_error(kernel, &parameters, &error)) {
+                        fprintf(stderr, "Failed to compare kernel %s\n",
+                            kernel_names[kernel]);
+                    }
+                }
+            }
+        }
+
+        printf("%s\n    {\"kernel\": \"%s\", \"size\": %u, "
+            "\"max_error\": %d, \"mean_error\": %.6f, "
+            "\"differing\": %.6f}",
+            printed ? "," : "",
+            kernel_names[kernel], BENCH_ERROR_SIZE, error.max,
+            error.pixels > 0.0 ? error.sum / error.pixels : 0.0,
+            error.pixels > 0.0 ? error.differing / error.pixels : 0.0);
+        fflush(stdout);
+        printed = 1;
+    }
+    spiral_set_kernel(selected);
+
+    printf("\n]}\n");
+
+    return 0;
+}
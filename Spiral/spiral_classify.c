@@ -0,0 +1,250 @@
+#include <math.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/**
+ * The side of the blocks a tile is split into when it is not uniform.
+ */
+#define CLASSIFY_BLOCK 16
+
+/**
+ * The distance to the centre of a line by which the bounds of a uniform
+ * rectangle must clear the edges of the anti aliased line.
+ *
+ * This covers the rounding errors of the kernels, which calculate the
+ * distance in single precision; one alpha level is a distance of about
+ * 0.0003.
+ */
+#define CLASSIFY_MARGIN 0.01
+
+/**
+ * The number of blocks a uniform run between spans calculated by the kernel
+ * must have to be skipped; shorter runs are cheaper to calculate than to
+ * skip, since every call of the kernel has a cost.
+ */
+#define CLASSIFY_RUN 2
+
+/**
+ * A span of a scan line of a row of blocks.
+ */
+typedef struct {
+    /** The first and one past the last column, relative to the rectangle */
+    int start, end;
+
+    /** The value of all pixels, or -1 if they are calculated by the kernel */
+    int value;
+} ClassifySpan;
+
+/**
+ * Calculates the range of the twist offset over a range of distances to the
+ * centre.
+ *
+ * The offset is a zigzag between 0 and twist with corners where a new
+ * segment starts; see get_distance_to_line.
+ *
+ * @param s
+ *     The spiral.
+ * @param h0, h1
+ *     The smallest and largest distance to the centre.
+ * @param low, high
+ *     Receive the smallest and largest offset.
+ */
+static void
+classify_offset(const Spiral *s, double h0, double h1, double *low,
+    double *high)
+{
+    double scale = (double)s->alterations / s->radius;
+    double t0 = h0 * scale, t1 = h1 * scale;
+    double segment, corner;
+    double a = modf(t0, &segment);
+    double b;
+
+    a = (int)segment % 2 ? a * s->twist : (1.0 - a) * s->twist;
+    b = modf(t1, &segment);
+    b = (int)segment % 2 ? b * s->twist : (1.0 - b) * s->twist;
+    *low = a < b ? a : b;
+    *high = a > b ? a : b;
+
+    /* Every corner in between is either 0 or twist */
+    for (corner = floor(t0) + 1.0; corner <= t1 && corner < floor(t0) + 3.0;
+            corner += 1.0) {
+        double value = (long long)corner % 2 ? 0.0 : s->twist;
+
+        *low = value < *low ? value : *low;
+        *high = value > *high ? value : *high;
+    }
+}
+
+int
+spiral_classify(const Spiral *s, int x, int y, int width, int height)
+{
+    int center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+    double u0, u1, v0, v1, qmin, qmax, du, dv;
+    double angles[4], amin, amax, omin, omax, tmin, tmax, dmin, dmax;
+    int i;
+
+    if (s->radius == 0 || width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    /* Twice the offsets of the pixels from the centre, which are integers,
+       so that squared distances are compared exactly like the kernels do */
+    u0 = 2.0 * x - s->width;
+    u1 = 2.0 * (x + width - 1) - s->width;
+    v0 = 2.0 * y - s->height;
+    v1 = 2.0 * (y + height - 1) - s->height;
+
+    du = u0 > 0.0 ? u0 : u1 < 0.0 ? u1 : 0.0;
+    dv = v0 > 0.0 ? v0 : v1 < 0.0 ? v1 : 0.0;
+    qmin = du * du + dv * dv;
+    du = fabs(u0) > fabs(u1) ? u0 : u1;
+    dv = fabs(v0) > fabs(v1) ? v0 : v1;
+    qmax = du * du + dv * dv;
+
+    /* Outside of the spiral, and inside of the centre disc; the rim fades
+       the centre disc too when it is as large as the spiral */
+    if (qmin > 4.0 * (s->radius + 1) * (s->radius + 1)) {
+        return 0;
+    }
+    if (qmax < 4.0 * center_radius * center_radius
+            && qmax < 4.0 * s->radius * s->radius) {
+        return 255;
+    }
+
+    /* The rim and the border of the centre disc are never uniform */
+    if (qmin <= 4.0 * (center_radius + 1) * (center_radius + 1)
+            || qmax >= 4.0 * s->radius * s->radius) {
+        return -1;
+    }
+
+    /* Where the lines are denser than one per rectangle, estimated from the
+       growth of the number of turns along and across the radius at the
+       nearest point, it cannot be uniform; this saves the atan2 calls */
+    if (0.5 * s->curves / M_PI
+            * (2.0 / sqrt(qmin) + fabs(s->twist) * s->alterations / s->radius)
+            * (width > height ? width : height) >= 1.0) {
+        return -1;
+    }
+
+    /* The angles of a rectangle that does not contain the centre are
+       bounded by its corners; across the negative x axis, the negative
+       angles are continued past pi */
+    if (u0 <= 0.0 && u1 >= 0.0 && v0 <= 0.0 && v1 >= 0.0) {
+        return -1;
+    }
+    angles[0] = atan2(v0, u0);
+    angles[1] = atan2(v0, u1);
+    angles[2] = atan2(v1, u0);
+    angles[3] = atan2(v1, u1);
+    amin = amax = angles[0] < 0.0 && u1 < 0.0 && v0 < 0.0 && v1 >= 0.0
+        ? angles[0] + 2 * M_PI
+        : angles[0];
+    for (i = 1; i < 4; i++) {
+        double angle = angles[i] < 0.0 && u1 < 0.0 && v0 < 0.0 && v1 >= 0.0
+            ? angles[i] + 2 * M_PI
+            : angles[i];
+
+        amin = angle < amin ? angle : amin;
+        amax = angle > amax ? angle : amax;
+    }
+
+    /* Bound the distance to the centre of a line; it is 0 where the number
+       of turns is half an integer, and 1 where it is an integer */
+    classify_offset(s, 0.5 * sqrt(qmin), 0.5 * sqrt(qmax), &omin, &omax);
+    tmin = s->curves * (amin + omin) / (2 * M_PI);
+    tmax = s->curves * (amax + omax) / (2 * M_PI);
+    if (tmax - tmin >= 1.0) {
+        return -1;
+    }
+    dmin = 2 * fabs(tmin - floor(tmin) - 0.5);
+    dmax = 2 * fabs(tmax - floor(tmax) - 0.5);
+    if (dmin > dmax) {
+        double d = dmin;
+
+        dmin = dmax;
+        dmax = d;
+    }
+    if (floor(tmin - 0.5) != floor(tmax - 0.5)) {
+        dmin = 0.0;
+    }
+    if (floor(tmin) != floor(tmax)) {
+        dmax = 1.0;
+    }
+
+    if (dmin > s->line_width + ANTI_ALIAS_BORDER + CLASSIFY_MARGIN) {
+        return 0;
+    }
+    if (dmax < s->line_width - CLASSIFY_MARGIN) {
+        return 255;
+    }
+
+    return -1;
+}
+
+void
+spiral_render_classified(const Spiral *s, SpiralRowKernel kernel, int x,
+    int y, int width, int height, unsigned char *d, size_t stride)
+{
+    ClassifySpan spans[(GENERATION_TILE_WIDTH + CLASSIFY_BLOCK - 1)
+        / CLASSIFY_BLOCK];
+    int value = spiral_classify(s, x, y, width, height);
+    int bx, by, row, i, count;
+
+    if (value >= 0) {
+        for (row = 0; row < height; row++) {
+            memset(d + row * stride, value, width);
+        }
+        return;
+    }
+
+    for (by = 0; by < height; by += CLASSIFY_BLOCK) {
+        int rows = height - by < CLASSIFY_BLOCK
+            ? height - by
+            : CLASSIFY_BLOCK;
+
+        /* Join adjacent blocks with the same value into spans */
+        count = 0;
+        for (bx = 0; bx < width; bx += CLASSIFY_BLOCK) {
+            int end = width - bx < CLASSIFY_BLOCK
+                ? width
+                : bx + CLASSIFY_BLOCK;
+
+            value = spiral_classify(s, x + bx, y + by, end - bx, rows);
+            if (count > 0 && spans[count - 1].value == value) {
+                spans[count - 1].end = end;
+                continue;
+            }
+
+            /* A short uniform run between runs that are not is calculated
+               by the kernel */
+            if (count > 1 && value < 0 && spans[count - 2].value < 0
+                    && spans[count - 1].end - spans[count - 1].start
+                        < CLASSIFY_RUN * CLASSIFY_BLOCK) {
+                count--;
+                spans[count - 1].end = end;
+                continue;
+            }
+
+            spans[count].start = bx;
+            spans[count].end = end;
+            spans[count].value = value;
+            count++;
+        }
+
+        for (row = by; row < by + rows; row++) {
+            unsigned char *line = d + row * stride;
+
+            for (i = 0; i < count; i++) {
+                if (spans[i].value >= 0) {
+                    memset(line + spans[i].start, spans[i].value,
+                        spans[i].end - spans[i].start);
+                }
+                else {
+                    kernel(s, y + row, x + spans[i].start, x + spans[i].end,
+                        line + spans[i].start);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "spiral_private.h"
+
+/**
+ * Calculates the distance to the nearest curve of a pixel.
+ *
+ * @param s
+ *     The spiral.
+ * @param x, y
+ *     The pixel.
+ * @return the distance, in the range [0, 1]
+ */
+static double
+spiral_distance_get(const Spiral *s, int x, int y)
+{
+    double dx = x - 0.5 * s->width;
+    double dy = y - 0.5 * s->height;
+
+    return get_distance_to_line(s, hypot(dx, dy), atan2(dy, dx));
+}
+
+/**
+ * Calculates a range of scan lines of a field.
+ */
+static int
+spiral_distance_do(Spiral *s, int start, int end, int gstart, int gend)
+{
+    int x, y;
+
+    for (y = start; y < end; y++) {
+        if (s->depth == sizeof(uint16_t)) {
+            uint16_t *d = (uint16_t*)s->data + y * s->width;
+
+            for (x = 0; x < s->width; x++) {
+                d[x] = (uint16_t)(spiral_distance_get(s, x, y) * UINT16_MAX
+                    + 0.5);
+            }
+        }
+        else {
+            uint8_t *d = (uint8_t*)s->data + y * s->width;
+
+            for (x = 0; x < s->width; x++) {
+                d[x] = (uint8_t)(spiral_distance_get(s, x, y) * UINT8_MAX
+                    + 0.5);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Fills a range of scan lines of the bottom half of a field by rotating the
+ * top half by 180 degrees.
+ *
+ * Like the pixels of spiral_create, the distances are calculated at integer
+ * offsets from the centre, so pixel (x, y) is the rotation of pixel
+ * (width - x, height - y); the first column has no counterpart, and is
+ * calculated.
+ */
+static int
+spiral_distance_mirror_do(Spiral *s, int start, int end, int gstart,
+    int gend)
+{
+    int x, y;
+
+    for (y = start; y < end; y++) {
+        int source = s->height - y;
+
+        if (s->depth == sizeof(uint16_t)) {
+            const uint16_t *a = (uint16_t*)s->data + source * s->width;
+            uint16_t *d = (uint16_t*)s->data + y * s->width;
+
+            d[0] = (uint16_t)(spiral_distance_get(s, 0, y) * UINT16_MAX
+                + 0.5);
+            for (x = 1; x < s->width; x++) {
+                d[x] = a[s->width - x];
+            }
+        }
+        else {
+            const uint8_t *a = (uint8_t*)s->data + source * s->width;
+            uint8_t *d = (uint8_t*)s->data + y * s->width;
+
+            d[0] = (uint8_t)(spiral_distance_get(s, 0, y) * UINT8_MAX + 0.5);
+            for (x = 1; x < s->width; x++) {
+                d[x] = a[s->width - x];
+            }
+        }
+    }
+
+    return 0;
+}
+
+Spiral*
+spiral_create_distance(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters, unsigned int bits)
+{
+    Spiral *self;
+    unsigned int rows;
+
+    if (bits != 8 && bits != 16) {
+        return NULL;
+    }
+
+    self = spiral_alloc(width, height, parameters);
+    if (!self) {
+        return NULL;
+    }
+
+    if (bits == 16) {
+        unsigned char *data = realloc(self->data,
+            (size_t)width * height * sizeof(uint16_t));
+        if (!data) {
+            spiral_free(self);
+            return NULL;
+        }
+        self->data = data;
+        self->depth = sizeof(uint16_t);
+    }
+
+    /* An even number of curves makes the field invariant under rotation by
+       180 degrees; the scan lines up to the centre are calculated, and the
+       first one has no counterpart */
+    rows = parameters->curves % 2 || height < 2 ? height : height / 2 + 1;
+    spiral_pool_execute_range(self, (SpiralRangeCallback)spiral_distance_do,
+        0, rows, GENERATION_ROWS);
+
+    if (rows < height) {
+        spiral_pool_execute_range(self,
+            (SpiralRangeCallback)spiral_distance_mirror_do, rows, height,
+            GENERATION_ROWS);
+    }
+
+    return self;
+}
@@ -0,0 +1,445 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/**
+ * The phase of a spiral, in turns, split into a term of the angle and a term
+ * of the distance to the centre.
+ *
+ * The distance to the centre of a line is given by the fractional part of
+ * curves * (angle + offset) / 2 pi, where the offset depends only on the
+ * distance to the centre; see get_distance_to_line. The offset is a zigzag
+ * that is linear within every segment and repeats every two segments, so
+ * its term is looked up in a table of the value at the start of, and the
+ * slope within, even and odd segments. This is exact, and only the table
+ * depends on the twist and the number of alterations.
+ */
+typedef struct {
+    /** Spiral::curves / 2 pi; the term of the angle is angle * curves */
+    double curves;
+
+    /** Spiral::alterations / Spiral::radius; the segment of a distance is
+        the integral part of distance * alterations */
+    double alterations;
+
+    /** The term of the distance at the start of even and odd segments, and
+        its slope in them */
+    double start[2], slope[2];
+
+    /** The spiral attributes */
+    double line_width, radius;
+
+    /** The slope of the anti aliasing ramp */
+    double ramp;
+
+    /** The radius of the centre disc */
+    double center_radius;
+} SpiralPhase;
+
+/**
+ * The state shared by the threads generating a batch of spirals.
+ */
+typedef struct {
+    /** The polar coordinates of the pixels */
+    const SpiralGrid *grid;
+
+    /** The spirals being generated */
+    Spiral **spirals;
+
+    /** The number of spirals */
+    unsigned int count;
+
+    /** The symmetries exploited for every spiral */
+    Symmetry *symmetries;
+
+    /** The phases of every spiral */
+    SpiralPhase *phases;
+} SpiralBatch;
+
+/**
+ * Initialises the phase of a spiral.
+ *
+ * @param p
+ *     The phase to initialise.
+ * @param s
+ *     The spiral.
+ */
+static void
+spiral_phase_init(SpiralPhase *p, const Spiral *s)
+{
+    double curves = s->curves / (2 * M_PI);
+
+    p->curves = curves;
+    p->alterations = s->radius ? (double)s->alterations / s->radius : 0.0;
+
+    /* The offset falls from twist to 0 in even segments, and rises from 0
+       to twist in odd segments */
+    p->start[0] = curves * s->twist;
+    p->slope[0] = -curves * s->twist;
+    p->start[1] = 0.0;
+    p->slope[1] = curves * s->twist;
+
+    p->line_width = s->line_width;
+    p->radius = s->radius;
+    p->ramp = -255.0 / ANTI_ALIAS_BORDER;
+    p->center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+}
+
+/**
+ * Calculates one scan line of a spiral from the polar coordinates of its
+ * pixels.
+ *
+ * @param p
+ *     The phase of the spiral.
+ * @param distance, angle
+ *     The polar coordinates of the pixels, as expanded by spiral_grid_row.
+ * @param width
+ *     The number of pixels.
+ * @param d
+ *     The destination.
+ */
+static void
+spiral_phase_row(const SpiralPhase *p, const float *distance,
+    const float *angle, int width, unsigned char *d)
+{
+    int x;
+
+    for (x = 0; x < width; x++) {
+        double h = distance[x];
+        double t, phase, alpha;
+        int segment, turns;
+
+        /* Include one extra pixel to enable anti aliasing */
+        if (h >= p->radius + 1.0) {
+            d[x] = 0;
+            continue;
+        }
+
+        t = h * p->alterations;
+        segment = (int)t;
+        phase = angle[x] * p->curves
+            + p->start[segment & 1] + (t - segment) * p->slope[segment & 1];
+
+        /* The distance to the centre of a line is the distance of the
+           fractional part of the phase to 0.5 */
+        turns = (int)phase;
+        turns -= turns > phase;
+        phase = fabs(2.0 * (phase - turns) - 1.0);
+
+        /* The anti aliased line, clamped instead of branching */
+        alpha = (phase - p->line_width) * p->ramp + 255.0;
+        alpha = alpha < 0.0 ? 0.0 : alpha > 255.0 ? 255.0 : alpha;
+
+        /* The centre disc and the rim, just like get_alpha; the radii are
+           integers */
+        if (h < p->center_radius) {
+            alpha = 255.0;
+        }
+        else if (h < p->center_radius + 1.0) {
+            double a = h - p->center_radius;
+            alpha = (unsigned int)alpha * a + 255.0 * (1.0 - a);
+        }
+        if (h >= p->radius) {
+            alpha = (unsigned int)alpha * (h - p->radius);
+        }
+
+        d[x] = (unsigned char)alpha;
+    }
+}
+
+/**
+ * Calculates a range of rows of a grid.
+ */
+static int
+spiral_grid_initialize_do(SpiralGrid *g, int start, int end, int gstart,
+    int gend)
+{
+    int i, j;
+    double ox = 0.5 * (g->width % 2);
+    double oy = 0.5 * (g->height % 2);
+
+    for (j = start; j < end; j++) {
+        float *distance = g->distance + j * g->columns;
+        float *angle = g->angle + j * g->columns;
+        double dy = j + oy;
+
+        for (i = 0; i < g->columns; i++) {
+            double dx = i + ox;
+            double h = hypot(dx, dy);
+            float hf = (float)h;
+
+            /* Rounding to single precision must not move the distance to the
+               next integer, since the centre disc and the rim depend on
+               the integral part */
+            if (floorf(hf) > floor(h)) {
+                hf = nextafterf(floorf(hf), 0.0f);
+            }
+
+            distance[i] = hf;
+            angle[i] = (float)atan2(dy, dx);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Expands one scan line of a grid.
+ *
+ * @param g
+ *     The grid.
+ * @param y
+ *     The scan line.
+ * @param distance, angle
+ *     Buffers for the polar coordinates of the scan line; these must have room
+ *     for g->width elements. The angle is in the range [-pi, pi], just like
+ *     atan2.
+ */
+static void
+spiral_grid_row(const SpiralGrid *g, int y, float *distance, float *angle)
+{
+    int x;
+    int v = 2 * y - (int)g->height;
+    const float *distance_row = g->distance + (abs(v) >> 1) * g->columns;
+    const float *angle_row = g->angle + (abs(v) >> 1) * g->columns;
+    float sign = v < 0 ? -1.0f : 1.0f;
+
+    for (x = 0; x < g->width; x++) {
+        int u = 2 * x - (int)g->width;
+        int i = abs(u) >> 1;
+
+        distance[x] = distance_row[i];
+        angle[x] = sign * (u < 0
+            ? (float)M_PI - angle_row[i]
+            : angle_row[i]);
+    }
+}
+
+/**
+ * Calculates a range of scan lines of all spirals in a batch.
+ *
+ * The polar coordinates of a scan line are expanded once into a buffer that
+ * stays in the cache while the scan line of every spiral is calculated.
+ */
+static int
+spiral_batch_do(SpiralBatch *b, int start, int end, int gstart, int gend)
+{
+    const SpiralGrid *g = b->grid;
+    float *distance;
+    float *angle;
+    int y;
+    unsigned int i;
+
+    distance = malloc(2 * sizeof(*distance) * g->width);
+    angle = distance ? distance + g->width : NULL;
+
+    for (y = start; y < end; y++) {
+        if (distance) {
+            spiral_grid_row(g, y, distance, angle);
+        }
+
+        for (i = 0; i < b->count; i++) {
+            Spiral *s = b->spirals[i];
+            unsigned char *d = s->data + y * s->width;
+
+            if (y >= spiral_symmetry_rows(s, b->symmetries[i])) {
+                continue;
+            }
+
+            /* Fall back on calculating the coordinates if we failed to
+               allocate the buffer */
+            if (!distance) {
+                spiral_row_scalar(s, y, 0, s->width, d);
+                continue;
+            }
+
+            spiral_phase_row(&b->phases[i], distance, angle, s->width, d);
+        }
+    }
+
+    free(distance);
+
+    return 0;
+}
+
+SpiralGrid*
+spiral_grid_create(unsigned int width, unsigned int height)
+{
+    SpiralGrid *self;
+    size_t size;
+
+    self = malloc(sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+    memset(self, 0, sizeof(*self));
+
+    self->width = width;
+    self->height = height;
+    self->columns = width / 2 + 1;
+    self->rows = height / 2 + 1;
+
+    /* width or height may be too large */
+    size = sizeof(*self->distance) * self->columns * self->rows;
+    self->distance = malloc(size);
+    self->angle = malloc(size);
+    if (!self->distance || !self->angle) {
+        spiral_grid_free(self);
+        return NULL;
+    }
+
+    spiral_pool_execute_range(self,
+        (SpiralRangeCallback)spiral_grid_initialize_do, 0, self->rows,
+        GENERATION_ROWS);
+
+    return self;
+}
+
+void
+spiral_grid_free(SpiralGrid *self)
+{
+    if (!self) {
+        return;
+    }
+
+    free(self->distance);
+    free(self->angle);
+    free(self);
+}
+
+unsigned int
+spiral_grid_get_width(const SpiralGrid *self)
+{
+    if (!self) {
+        return 0;
+    }
+
+    return self->width;
+}
+
+unsigned int
+spiral_grid_get_height(const SpiralGrid *self)
+{
+    if (!self) {
+        return 0;
+    }
+
+    return self->height;
+}
+
+/**
+ * Creates several spirals of the same size in one pass, as described for
+ * spiral_create_batch.
+ *
+ * @param grid, parameters, count, spirals
+ *     As described for spiral_create_batch.
+ * @param mipmaps
+ *     Whether to calculate a full chain of levels of detail for every
+ *     spiral.
+ * @return non-zero if the spirals were created, and 0 otherwise, in which
+ *     case spirals is filled with NULL
+ */
+static int
+spiral_batch_create(const SpiralGrid *grid,
+    const SpiralParameters *parameters, unsigned int count, Spiral **spirals,
+    int mipmaps)
+{
+    SpiralBatch batch;
+    unsigned int i;
+    int rows = 0;
+
+    /* There is nothing to allocate for an empty batch */
+    if (count == 0) {
+        return 1;
+    }
+
+    memset(spirals, 0, sizeof(*spirals) * count);
+    batch.grid = grid;
+    batch.spirals = spirals;
+    batch.count = count;
+    batch.symmetries = malloc(sizeof(*batch.symmetries) * count);
+    batch.phases = malloc(sizeof(*batch.phases) * count);
+    if (!batch.symmetries || !batch.phases) {
+        free(batch.symmetries);
+        free(batch.phases);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        spirals[i] = spiral_alloc(grid->width, grid->height, &parameters[i]);
+        if (!spirals[i] || (mipmaps && !spiral_alloc_levels(spirals[i]))) {
+            break;
+        }
+
+        /* Rotating by 90 degrees is not supported by the grid, since a
+           quarter of a scan line cannot be calculated separately */
+        batch.symmetries[i] = spiral_get_symmetry(spirals[i]);
+        if (batch.symmetries[i] == SYMMETRY_QUARTER) {
+            batch.symmetries[i] = SYMMETRY_HALF;
+        }
+
+        if (spiral_symmetry_rows(spirals[i], batch.symmetries[i]) > rows) {
+            rows = spiral_symmetry_rows(spirals[i], batch.symmetries[i]);
+        }
+
+        spiral_phase_init(&batch.phases[i], spirals[i]);
+    }
+
+    /* Release all spirals if an allocation failed */
+    if (i < count) {
+        for (i = 0; i < count; i++) {
+            spiral_free(spirals[i]);
+            spirals[i] = NULL;
+        }
+        free(batch.symmetries);
+        free(batch.phases);
+        return 0;
+    }
+
+    /* Calculate the independent scan lines of all spirals in one pass */
+    spiral_pool_execute_range(&batch, (SpiralRangeCallback)spiral_batch_do,
+        0, rows, GENERATION_ROWS);
+
+    for (i = 0; i < count; i++) {
+        SpiralGeneration generation;
+
+        generation.spiral = spirals[i];
+        generation.kernel = spiral_row_scalar;
+        generation.symmetry = batch.symmetries[i];
+        generation.region.x = 0;
+        generation.region.y = 0;
+        generation.region.width = spirals[i]->width;
+        generation.region.height = spirals[i]->height;
+        generation.data = spirals[i]->data;
+        generation.stride = spirals[i]->width;
+        generation.samples = 1;
+        generation.reduced = NULL;
+        generation.reduced_stride = 0;
+        spiral_symmetry_fill(&generation);
+
+        if (mipmaps) {
+            spiral_mipmap_fill(spirals[i], 1);
+        }
+    }
+
+    free(batch.symmetries);
+    free(batch.phases);
+
+    return 1;
+}
+
+int
+spiral_create_batch(const SpiralGrid *grid,
+    const SpiralParameters *parameters, unsigned int count, Spiral **spirals)
+{
+    return spiral_batch_create(grid, parameters, count, spirals, 0);
+}
+
+int
+spiral_create_batch_with_mipmaps(const SpiralGrid *grid,
+    const SpiralParameters *parameters, unsigned int count, Spiral **spirals)
+{
+    return spiral_batch_create(grid, parameters, count, spirals, 1);
+}
@@ -0,0 +1,228 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/**
+ * The base 2 logarithm of SPIRAL_TILE_SIZE.
+ */
+#define LAYOUT_TILE_SHIFT 6
+
+/**
+ * The number of fractional bits of the positions of samples.
+ */
+#define LAYOUT_POSITION_BITS 32
+
+/**
+ * The state shared by the threads rearranging a spiral into tiles.
+ */
+typedef struct {
+    /** The spiral; its data is still stored in scan lines */
+    const Spiral *spiral;
+
+    /** The tiles */
+    unsigned char *tiles;
+
+    /** The number of tiles in a row of tiles */
+    unsigned int columns;
+} SpiralTiling;
+
+/**
+ * Rearranges a range of rows of tiles.
+ */
+static int
+spiral_layout_tile_do(SpiralTiling *t, int start, int end, int gstart,
+    int gend)
+{
+    const Spiral *s = t->spiral;
+    unsigned int row, column, y;
+
+    for (row = start; row < end; row++) {
+        for (column = 0; column < t->columns; column++) {
+            unsigned char *d = t->tiles + ((size_t)row * t->columns + column)
+                * SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE;
+            unsigned int x = column * SPIRAL_TILE_SIZE;
+            unsigned int width = s->width - x < SPIRAL_TILE_SIZE
+                ? s->width - x
+                : SPIRAL_TILE_SIZE;
+
+            for (y = row * SPIRAL_TILE_SIZE;
+                    y < (row + 1) * SPIRAL_TILE_SIZE;
+                    y++, d += SPIRAL_TILE_SIZE) {
+                if (y < s->height) {
+                    memcpy(d, s->data + (size_t)y * s->width + x, width);
+                    memset(d + width, 0, SPIRAL_TILE_SIZE - width);
+                }
+                else {
+                    memset(d, 0, SPIRAL_TILE_SIZE);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+spiral_layout_tile(Spiral *s)
+{
+    SpiralTiling tiling;
+    unsigned int rows;
+
+    tiling.spiral = s;
+    tiling.columns = (s->width + SPIRAL_TILE_SIZE - 1) / SPIRAL_TILE_SIZE;
+    rows = (s->height + SPIRAL_TILE_SIZE - 1) / SPIRAL_TILE_SIZE;
+    tiling.tiles = malloc((size_t)tiling.columns * rows
+        * SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE);
+    if (!tiling.tiles) {
+        return 0;
+    }
+
+    spiral_pool_execute_range(&tiling,
+        (SpiralRangeCallback)spiral_layout_tile_do, 0, rows, 1);
+
+    free(s->data);
+    s->data = tiling.tiles;
+    s->layout = SPIRAL_LAYOUT_TILED;
+
+    return 1;
+}
+
+int
+spiral_copy_rows(Spiral *self, void *buffer, size_t stride)
+{
+    unsigned char *d = buffer;
+    size_t row_size;
+    unsigned int x, y;
+
+    if (!self || stride < (size_t)self->width * self->depth) {
+        return 0;
+    }
+
+    row_size = (size_t)self->width * self->depth;
+    for (y = 0; y < self->height; y++, d += stride) {
+        if (self->layout == SPIRAL_LAYOUT_ROWS) {
+            memcpy(d, self->data + y * row_size, row_size);
+            continue;
+        }
+
+        /* The tiles only store spirals with a depth of 1 */
+        for (x = 0; x < self->width; x += SPIRAL_TILE_SIZE) {
+            memcpy(d + x, self->data
+                + ((size_t)(y >> LAYOUT_TILE_SHIFT)
+                        * ((self->width + SPIRAL_TILE_SIZE - 1)
+                            / SPIRAL_TILE_SIZE)
+                    + (x >> LAYOUT_TILE_SHIFT))
+                    * SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE
+                + (y & (SPIRAL_TILE_SIZE - 1)) * SPIRAL_TILE_SIZE,
+                self->width - x < SPIRAL_TILE_SIZE
+                    ? self->width - x
+                    : SPIRAL_TILE_SIZE);
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Samples a spiral along a line.
+ *
+ * The offset of a pixel is the sum of an offset given by its column and one
+ * given by its scan line, so the four pixels around a point are read from
+ * the sums of two column and two scan line offsets. This is inlined with a
+ * constant layout, so that the layout is not tested for every point.
+ *
+ * @param s
+ *     The spiral.
+ * @param tiled
+ *     Whether the spiral is stored in tiles.
+ * @param x, y
+ *     The first point, in fixed point, relative to the centre of the top left
+ *     pixel.
+ * @param dx, dy
+ *     The offset from a point to the next one, in fixed point.
+ * @param count
+ *     The number of points.
+ * @param d
+ *     The destination of the values.
+ */
+static inline void
+spiral_sample_line(const Spiral *s, int tiled, long long x, long long y,
+    long long dx, long long dy, unsigned int count, unsigned char *d)
+{
+    const long long x_max = (long long)(s->width - 1) << LAYOUT_POSITION_BITS;
+    const long long y_max = (long long)(s->height - 1) << LAYOUT_POSITION_BITS;
+    const size_t tile_row = (size_t)(s->width + SPIRAL_TILE_SIZE - 1)
+        / SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE * SPIRAL_TILE_SIZE;
+    unsigned int i;
+
+    for (i = 0; i < count; i++, x += dx, y += dy) {
+        /* Clamping the point to the centres of the pixels on the edges
+           gives the values of a texture clamped to its edges */
+        long long px = x < 0 ? 0 : x > x_max ? x_max : x;
+        long long py = y < 0 ? 0 : y > y_max ? y_max : y;
+        unsigned int x0 = (unsigned int)(px >> LAYOUT_POSITION_BITS);
+        unsigned int y0 = (unsigned int)(py >> LAYOUT_POSITION_BITS);
+        unsigned int x1 = x0 + (x0 < s->width - 1);
+        unsigned int y1 = y0 + (y0 < s->height - 1);
+        unsigned int fx = (unsigned int)(px >> (LAYOUT_POSITION_BITS - 8))
+            & 0xff;
+        unsigned int fy = (unsigned int)(py >> (LAYOUT_POSITION_BITS - 8))
+            & 0xff;
+        size_t c0, c1, r0, r1;
+        unsigned int top, bottom;
+
+        if (tiled) {
+            c0 = ((size_t)(x0 >> LAYOUT_TILE_SHIFT)
+                    << (2 * LAYOUT_TILE_SHIFT))
+                + (x0 & (SPIRAL_TILE_SIZE - 1));
+            c1 = ((size_t)(x1 >> LAYOUT_TILE_SHIFT)
+                    << (2 * LAYOUT_TILE_SHIFT))
+                + (x1 & (SPIRAL_TILE_SIZE - 1));
+            r0 = (y0 >> LAYOUT_TILE_SHIFT) * tile_row
+                + ((y0 & (SPIRAL_TILE_SIZE - 1)) << LAYOUT_TILE_SHIFT);
+            r1 = (y1 >> LAYOUT_TILE_SHIFT) * tile_row
+                + ((y1 & (SPIRAL_TILE_SIZE - 1)) << LAYOUT_TILE_SHIFT);
+        }
+        else {
+            c0 = x0;
+            c1 = x1;
+            r0 = (size_t)y0 * s->width;
+            r1 = (size_t)y1 * s->width;
+        }
+
+        top = s->data[r0 + c0] * (256 - fx) + s->data[r0 + c1] * fx;
+        bottom = s->data[r1 + c0] * (256 - fx) + s->data[r1 + c1] * fx;
+        d[i] = (unsigned char)((top * (256 - fy) + bottom * fy + 32768)
+            >> 16);
+    }
+}
+
+int
+spiral_sample(Spiral *self, double x, double y, double dx, double dy,
+    unsigned int count, unsigned char *d)
+{
+    const double one = 1LL << LAYOUT_POSITION_BITS;
+    long long fixed_x, fixed_y, fixed_dx, fixed_dy;
+
+    if (!self || self->depth != 1 || !self->width || !self->height) {
+        return 0;
+    }
+
+    fixed_x = llround((x - 0.5) * one);
+    fixed_y = llround((y - 0.5) * one);
+    fixed_dx = llround(dx * one);
+    fixed_dy = llround(dy * one);
+
+    if (self->layout == SPIRAL_LAYOUT_TILED) {
+        spiral_sample_line(self, 1, fixed_x, fixed_y, fixed_dx, fixed_dy,
+            count, d);
+    }
+    else {
+        spiral_sample_line(self, 0, fixed_x, fixed_y, fixed_dx, fixed_dy,
+            count, d);
+    }
+
+    return 1;
+}
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "spiral_private.h"
+
+/**
+ * The base 2 logarithm of the number of scan lines of the base level in a
+ * band.
+ *
+ * The base level is the second one unless it was not reduced during the
+ * generation of the first one. A band of the base level is reduced through
+ * this many levels before the next band is read, so that every level is
+ * calculated from scan lines that are still in the cache. With 32 scan
+ * lines, a band of the second level of a 8192 pixels wide spiral is 128 kiB.
+ */
+#define MIPMAP_BAND_LEVELS 5
+
+/**
+ * A level of detail of a spiral.
+ */
+typedef struct {
+    /** The data of the level */
+    unsigned char *data;
+
+    /** The dimensions of the level */
+    unsigned int width, height;
+} SpiralLevel;
+
+/**
+ * The state shared by the threads calculating levels of detail.
+ */
+typedef struct {
+    /** The levels of the spiral */
+    SpiralLevel *levels;
+
+    /** The number of levels */
+    unsigned int count;
+
+    /** The level from which the bands are reduced */
+    unsigned int base;
+} SpiralMipmap;
+
+/**
+ * Reduces two scan lines of a level to a scan line of the level below it.
+ *
+ * @param a, b
+ *     The scan lines of the level above.
+ * @param d
+ *     The scan line of the level below.
+ * @param start, end
+ *     The first and one past the last pixel of d to calculate; the pixels of
+ *     a and b up to 2 * end must exist.
+ */
+static void
+spiral_mipmap_reduce_row(const unsigned char *a, const unsigned char *b,
+    unsigned char *d, unsigned int start, unsigned int end)
+{
+    unsigned int x = start;
+
+#ifdef __SSE2__
+    /* The sums of four pixels are calculated in 16 bit lanes, from the even
+       pixels masked and the odd pixels shifted down */
+    const __m128i low = _mm_set1_epi16(0xff);
+    const __m128i two = _mm_set1_epi16(2);
+
+    for (; x + 16 <= end; x += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(a + 2 * x));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(a + 2 * x + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(b + 2 * x));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(b + 2 * x + 16));
+        __m128i s0 = _mm_add_epi16(
+            _mm_add_epi16(_mm_and_si128(a0, low), _mm_srli_epi16(a0, 8)),
+            _mm_add_epi16(_mm_and_si128(b0, low), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(
+            _mm_add_epi16(_mm_and_si128(a1, low), _mm_srli_epi16(a1, 8)),
+            _mm_add_epi16(_mm_and_si128(b1, low), _mm_srli_epi16(b1, 8)));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(s0, s1));
+    }
+#endif
+
+    for (; x < end; x++) {
+        d[x] = (a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2;
+    }
+}
+
+/**
+ * Calculates a range of scan lines of a level from the level above it.
+ *
+ * If a dimension of the level above is odd and greater than 1, its last
+ * column or scan line is dropped; if it is 1, the column or scan line is
+ * repeated.
+ *
+ * @param source
+ *     The level above.
+ * @param destination
+ *     The level to calculate.
+ * @param start, end
+ *     The first and one past the last scan line to calculate.
+ */
+static void
+spiral_mipmap_reduce(const SpiralLevel *source, SpiralLevel *destination,
+    unsigned int start, unsigned int end)
+{
+    unsigned int y;
+    unsigned int last_row = source->height - 1;
+
+    for (y = start; y < end; y++) {
+        const unsigned char *a = source->data
+            + (2 * y < last_row ? 2 * y : last_row) * source->width;
+        const unsigned char *b = source->data
+            + (2 * y + 1 < last_row ? 2 * y + 1 : last_row) * source->width;
+        unsigned char *d = destination->data + y * destination->width;
+
+        if (source->width > 1) {
+            spiral_mipmap_reduce_row(a, b, d, 0, destination->width);
+        }
+        else {
+            d[0] = (2 * a[0] + 2 * b[0] + 2) >> 2;
+        }
+    }
+}
+
+/**
+ * Calculates the levels of detail of a range of bands.
+ *
+ * Every band covers 1 << MIPMAP_BAND_LEVELS scan lines of the base level,
+ * and the scan lines they reduce to in the following MIPMAP_BAND_LEVELS
+ * levels.
+ */
+static int
+spiral_mipmap_do(SpiralMipmap *m, int start, int end, int gstart, int gend)
+{
+    int band;
+    unsigned int level;
+
+    for (band = start; band < end; band++) {
+        for (level = m->base + 1; level <= m->base + MIPMAP_BAND_LEVELS
+                && level < m->count; level++) {
+            SpiralLevel *l = &m->levels[level];
+            unsigned int first = (band << MIPMAP_BAND_LEVELS)
+                >> (level - m->base);
+            unsigned int last = ((band + 1) << MIPMAP_BAND_LEVELS)
+                >> (level - m->base);
+
+            /* The last band also covers the scan lines given by rounding */
+            if (band == gend - 1 || last > l->height) {
+                last = l->height;
+            }
+            if (first < last) {
+                spiral_mipmap_reduce(&m->levels[level - 1], l, first, last);
+            }
+        }
+    }
+
+    return 0;
+}
+
+unsigned int
+spiral_mipmap_levels(unsigned int width, unsigned int height)
+{
+    unsigned int levels = 1;
+
+    while (width > 1 || height > 1) {
+        width /= 2;
+        height /= 2;
+        levels++;
+    }
+
+    return levels;
+}
+
+void
+spiral_mipmap_reduce_rect(SpiralGeneration *g, int x0, int y0, int x1,
+    int y1)
+{
+    int y;
+
+    for (y = (y0 + 1) / 2; y < y1 / 2; y++) {
+        const unsigned char *a = g->data + 2 * y * g->stride;
+
+        spiral_mipmap_reduce_row(a, a + g->stride,
+            g->reduced + y * g->reduced_stride, (x0 + 1) / 2, x1 / 2);
+    }
+}
+
+void
+spiral_mipmap_fill(Spiral *s, unsigned int first)
+{
+    SpiralMipmap mipmap;
+    unsigned int i;
+    int bands;
+
+    mipmap.count = s->levels;
+    mipmap.base = first - 1;
+    mipmap.levels = malloc(sizeof(*mipmap.levels) * mipmap.count);
+    if (!mipmap.levels) {
+        /* Leave a single level rather than undefined data */
+        s->levels = 1;
+        return;
+    }
+
+    mipmap.levels[0].data = s->data;
+    mipmap.levels[0].width = s->width;
+    mipmap.levels[0].height = s->height;
+    for (i = 1; i < mipmap.count; i++) {
+        SpiralLevel *previous = &mipmap.levels[i - 1];
+
+        mipmap.levels[i].data = previous->data
+            + previous->width * previous->height;
+        mipmap.levels[i].width = previous->width > 1
+            ? previous->width / 2
+            : 1;
+        mipmap.levels[i].height = previous->height > 1
+            ? previous->height / 2
+            : 1;
+    }
+
+    /* Reduce the following levels band by band */
+    bands = (mipmap.levels[mipmap.base].height + (1 << MIPMAP_BAND_LEVELS)
+        - 1) >> MIPMAP_BAND_LEVELS;
+    spiral_pool_execute_range(&mipmap, (SpiralRangeCallback)spiral_mipmap_do,
+        0, bands, 1);
+
+    /* The remaining levels are small enough to stay in the cache */
+    for (i = mipmap.base + MIPMAP_BAND_LEVELS + 1; i < mipmap.count; i++) {
+        spiral_mipmap_reduce(&mipmap.levels[i - 1], &mipmap.levels[i], 0,
+            mipmap.levels[i].height);
+    }
+
+    free(mipmap.levels);
+}
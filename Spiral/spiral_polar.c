@@ -0,0 +1,56 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "spiral_private.h"
+
+/**
+ * Calculates a range of rows of a polar spiral.
+ *
+ * Every row is a circle of constant distance to the centre.
+ */
+static int
+spiral_polar_do(Spiral *s, int start, int end, int gstart, int gend)
+{
+    int x, y;
+    int center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+    double period = 2.0 * M_PI / s->curves;
+
+    for (y = start; y < end; y++) {
+        unsigned char *d = s->data + y * s->width;
+        double h = (y + 0.5) * (s->radius + 1) / s->height;
+
+        for (x = 0; x < s->width; x++) {
+            d[x] = get_alpha(s, h, (x + 0.5) * period / s->width,
+                center_radius);
+        }
+    }
+
+    return 0;
+}
+
+void
+spiral_polar_size(const SpiralParameters *parameters, unsigned int *width,
+    unsigned int *height)
+{
+    /* The outermost row is as long as the arc of one period at the rim */
+    *width = (unsigned int)ceil(2.0 * M_PI * (parameters->radius + 1)
+        / parameters->curves);
+    *height = parameters->radius + 1;
+}
+
+Spiral*
+spiral_create_polar(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters)
+{
+    Spiral *self;
+
+    self = spiral_alloc(width, height, parameters);
+    if (!self) {
+        return NULL;
+    }
+
+    spiral_pool_execute_range(self, (SpiralRangeCallback)spiral_polar_do, 0,
+        height, GENERATION_ROWS);
+
+    return self;
+}
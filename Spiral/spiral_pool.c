@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spiral_private.h"
+
+/**
+ * The size, in bytes, of a cache line.
+ */
+#define POOL_CACHE_LINE 64
+
+/**
+ * The tiles of the current job that a worker has not yet started.
+ *
+ * The tiles are numbered in row-major order, and the deque holds a range of
+ * consecutive numbers. The owner takes tiles from the front, in the order in
+ * which they were distributed, and other workers steal from the back.
+ */
+typedef struct {
+    /** Protects next and end */
+    pthread_mutex_t mutex;
+
+    /** The first tile not yet taken, and one past the last one */
+    unsigned int next, end;
+} PoolDeque;
+
+/**
+ * A deque padded to whole cache lines, so that workers taking tiles from
+ * their own deques do not contend for the same cache lines.
+ */
+typedef union {
+    PoolDeque deque;
+    char padding[(sizeof(PoolDeque) + POOL_CACHE_LINE - 1)
+        / POOL_CACHE_LINE * POOL_CACHE_LINE];
+} PoolSlot;
+
+/**
+ * The range job adapted to tiles by spiral_pool_execute_range.
+ */
+typedef struct {
+    void *context;
+    SpiralRangeCallback callback;
+    int start, end;
+} PoolRange;
+
+static struct {
+    /** Serialises jobs and changes of the configuration */
+    pthread_mutex_t job_mutex;
+
+    /** Protects job, busy and quit */
+    pthread_mutex_t mutex;
+
+    /** Signalled when a job is started or the workers should quit, and when
+        the last worker has finished a job */
+    pthread_cond_t start, done;
+
+    /** The number of workers requested, or 0 for one per CPU */
+    unsigned int requested;
+
+    /** Whether the threads are bound to CPUs */
+    int pin;
+
+    /** The number of workers, including the thread calling
+        spiral_pool_execute, or 0 if the threads are not running */
+    unsigned int count;
+
+    /** The threads of workers 1 to count - 1 */
+    pthread_t *threads;
+
+    /** The deques of all workers */
+    PoolSlot *slots;
+
+    /** The number of the current job; workers wait for this to change */
+    unsigned long job;
+
+    /** The number of threads that have not yet finished the current job */
+    unsigned int busy;
+
+    /** Non-zero when the threads should quit */
+    int quit;
+
+    /** The current job */
+    void *context;
+    SpiralTileCallback callback;
+    unsigned int width, height, tile_width, tile_height, columns;
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * Returns the CPUs the process may run on.
+ *
+ * @param cpus
+ *     The CPUs, in ascending order. This must have room for
+ *     SPIRAL_MAX_THREADS elements.
+ * @return the number of CPUs, at most SPIRAL_MAX_THREADS
+ */
+static unsigned int
+pool_cpus(int cpus[SPIRAL_MAX_THREADS])
+{
+    cpu_set_t set;
+    unsigned int count = 0;
+    int cpu;
+    long online;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (cpu = 0; cpu < CPU_SETSIZE && count < SPIRAL_MAX_THREADS;
+                cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus[count++] = cpu;
+            }
+        }
+    }
+    if (count > 0) {
+        return count;
+    }
+
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (count = 0; count < (online > 0 ? (unsigned long)online : 1)
+            && count < SPIRAL_MAX_THREADS; count++) {
+        cpus[count] = count;
+    }
+
+    return count;
+}
+
+/**
+ * Returns the number of workers started for the current configuration.
+ *
+ * @return the number of workers
+ */
+static unsigned int
+pool_size(void)
+{
+    int cpus[SPIRAL_MAX_THREADS];
+
+    return pool.requested ? pool.requested : pool_cpus(cpus);
+}
+
+/**
+ * Takes the next tile of a worker.
+ *
+ * If the deque of the worker is empty, half of the remaining tiles of
+ * another worker are moved to it.
+ *
+ * @param index
+ *     The worker.
+ * @param tile
+ *     The number of the tile taken.
+ * @return non-zero if a tile was taken, and 0 if all tiles have been taken
+ */
+static int
+pool_take(unsigned int index, unsigned int *tile)
+{
+    PoolDeque *own = &pool.slots[index].deque;
+    unsigned int i;
+
+    pthread_mutex_lock(&own->mutex);
+    if (own->next < own->end) {
+        *tile = own->next++;
+        pthread_mutex_unlock(&own->mutex);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->mutex);
+
+    for (i = 1; i < pool.count; i++) {
+        PoolDeque *victim = &pool.slots[(index + i) % pool.count].deque;
+        unsigned int first, end;
+
+        pthread_mutex_lock(&victim->mutex);
+        end = victim->end;
+        first = victim->end - (victim->end - victim->next) / 2;
+        if (first == end && victim->next < end) {
+            first--;
+        }
+        victim->end = first;
+        pthread_mutex_unlock(&victim->mutex);
+        if (first == end) {
+            continue;
+        }
+
+        /* Keep the first stolen tile, and let others steal the rest */
+        pthread_mutex_lock(&own->mutex);
+        own->next = first + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->mutex);
+        *tile = first;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Calculates tiles of the current job until all have been taken.
+ *
+ * @param index
+ *     The worker.
+ */
+static void
+pool_work(unsigned int index)
+{
+    unsigned int tile;
+
+    while (pool_take(index, &tile)) {
+        SpiralRegion region;
+
+        region.x = tile % pool.columns * pool.tile_width;
+        region.y = tile / pool.columns * pool.tile_height;
+        region.width = pool.width - region.x < pool.tile_width
+            ? pool.width - region.x
+            : pool.tile_width;
+        region.height = pool.height - region.y < pool.tile_height
+            ? pool.height - region.y
+            : pool.tile_height;
+        pool.callback(pool.context, &region);
+    }
+}
+
+/**
+ * The function of the threads of workers 1 to count - 1.
+ *
+ * @param data
+ *     The worker.
+ */
+static void*
+pool_run(void *data)
+{
+    unsigned int index = (uintptr_t)data;
+    unsigned long job = 0;
+
+    pthread_mutex_lock(&pool.mutex);
+    for (;;) {
+        while (pool.job == job && !pool.quit) {
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        }
+        if (pool.quit) {
+            break;
+        }
+        job = pool.job;
+        pthread_mutex_unlock(&pool.mutex);
+
+        pool_work(index);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (--pool.busy == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    return NULL;
+}
+
+/**
+ * Stops the threads started by pool_start.
+ *
+ * pool.job_mutex must be held.
+ */
+static void
+pool_stop(void)
+{
+    unsigned int i;
+
+    if (!pool.count) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    for (i = 1; i < pool.count; i++) {
+        pthread_join(pool.threads[i - 1], NULL);
+    }
+    for (i = 0; i < pool.count; i++) {
+        pthread_mutex_destroy(&pool.slots[i].deque.mutex);
+    }
+    free(pool.threads);
+    free(pool.slots);
+    pool.count = 0;
+    pool.quit = 0;
+}
+
+/**
+ * Starts the threads of the configured number of workers.
+ *
+ * Worker 0 is the thread calling spiral_pool_execute. If the threads are
+ * bound to CPUs, worker n runs on the n-th CPU the process may run on, so
+ * that the first one is left to the calling thread.
+ *
+ * pool.job_mutex must be held.
+ *
+ * @return non-zero if at least the calling thread may run jobs, and 0 if
+ *     memory could not be allocated
+ */
+static int
+pool_start(void)
+{
+    int cpus[SPIRAL_MAX_THREADS];
+    unsigned int cpu_count = pool_cpus(cpus);
+    unsigned int count = pool.requested ? pool.requested : cpu_count;
+    void *slots;
+    unsigned int i;
+
+    if (posix_memalign(&slots, POOL_CACHE_LINE, sizeof(PoolSlot) * count)) {
+        return 0;
+    }
+    pool.slots = slots;
+    pool.threads = malloc(sizeof(*pool.threads) * count);
+    if (!pool.threads) {
+        free(pool.slots);
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        pthread_mutex_init(&pool.slots[i].deque.mutex, NULL);
+    }
+
+    /* The threads wait for the job number to change */
+    pool.job = 0;
+    for (pool.count = 1; pool.count < count; pool.count++) {
+        pthread_t *thread = &pool.threads[pool.count - 1];
+
+        if (pthread_create(thread, NULL, pool_run,
+                (void*)(uintptr_t)pool.count)) {
+            break;
+        }
+        if (pool.pin) {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(cpus[pool.count % cpu_count], &set);
+            pthread_setaffinity_np(*thread, sizeof(set), &set);
+        }
+    }
+
+    /* Continue with the threads that could be started */
+    for (i = pool.count; i < count; i++) {
+        pthread_mutex_destroy(&pool.slots[i].deque.mutex);
+    }
+
+    return 1;
+}
+
+void
+spiral_pool_execute(void *context, SpiralTileCallback callback,
+    unsigned int width, unsigned int height, unsigned int tile_width,
+    unsigned int tile_height)
+{
+    unsigned int rows, tiles, i;
+
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool.job_mutex);
+    if (!pool.count && !pool_start()) {
+        SpiralRegion region;
+
+        /* Calculate the tiles in order on the calling thread */
+        for (region.y = 0; region.y < height; region.y += tile_height) {
+            region.height = height - region.y < tile_height
+                ? height - region.y
+                : tile_height;
+            for (region.x = 0; region.x < width; region.x += tile_width) {
+                region.width = width - region.x < tile_width
+                    ? width - region.x
+                    : tile_width;
+                callback(context, &region);
+            }
+        }
+
+        pthread_mutex_unlock(&pool.job_mutex);
+        return;
+    }
+
+    pool.context = context;
+    pool.callback = callback;
+    pool.width = width;
+    pool.height = height;
+    pool.tile_width = tile_width;
+    pool.tile_height = tile_height;
+    pool.columns = (width + tile_width - 1) / tile_width;
+    rows = (height + tile_height - 1) / tile_height;
+    tiles = pool.columns * rows;
+
+    /* Give every worker a band of consecutive tiles, so that the pages of a
+       new buffer are first touched, and thus placed in the memory of the
+       NUMA node of, the worker that calculates most of them */
+    for (i = 0; i < pool.count; i++) {
+        PoolDeque *deque = &pool.slots[i].deque;
+
+        deque->next = (unsigned long)tiles * i / pool.count;
+        deque->end = (unsigned long)tiles * (i + 1) / pool.count;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.busy = pool.count - 1;
+    pool.job++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    pool_work(0);
+
+    pthread_mutex_lock(&pool.mutex);
+    while (pool.busy > 0) {
+        pthread_cond_wait(&pool.done, &pool.mutex);
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    pthread_mutex_unlock(&pool.job_mutex);
+}
+
+/**
+ * Calculates one tile of a range job.
+ *
+ * @param range
+ *     The range job.
+ * @param tile
+ *     The tile; its scan lines are the indices relative to the start of the
+ *     range.
+ */
+static void
+pool_range_do(PoolRange *range, const SpiralRegion *tile)
+{
+    range->callback(range->context, range->start + tile->y,
+        range->start + tile->y + tile->height, range->start, range->end);
+}
+
+void
+spiral_pool_execute_range(void *context, SpiralRangeCallback callback,
+    int start, int end, unsigned int size)
+{
+    PoolRange range;
+
+    if (start >= end) {
+        return;
+    }
+
+    range.context = context;
+    range.callback = callback;
+    range.start = start;
+    range.end = end;
+    spiral_pool_execute(&range, (SpiralTileCallback)pool_range_do, 1,
+        end - start, 1, size);
+}
+
+int
+spiral_set_threads(unsigned int threads, int pin)
+{
+    if (threads > SPIRAL_MAX_THREADS) {
+        return 0;
+    }
+
+    /* The threads are started again by the next job */
+    pthread_mutex_lock(&pool.job_mutex);
+    pool_stop();
+    pool.requested = threads;
+    pool.pin = pin;
+    pthread_mutex_unlock(&pool.job_mutex);
+
+    return 1;
+}
+
+unsigned int
+spiral_get_threads(void)
+{
+    unsigned int count;
+
+    pthread_mutex_lock(&pool.job_mutex);
+    count = pool.count ? pool.count : pool_size();
+    pthread_mutex_unlock(&pool.job_mutex);
+
+    return count;
+}
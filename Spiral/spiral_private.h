@@ -0,0 +1,532 @@
+#ifndef SPIRAL_PRIVATE_H
+#define SPIRAL_PRIVATE_H
+
+#include <math.h>
+
+#include "spiral.h"
+
+/**
+ * The width of the anti aliased border around a spiral line.
+ */
+#define ANTI_ALIAS_BORDER 0.08
+
+/**
+ * The minimum diameter of the centre circle.
+ */
+#define CENTER_RADIUS 3.0
+
+struct Spiral {
+    /** The spiral data, which is an array of bytes; the size of the first
+        level is height * width */
+    unsigned char *data;
+
+    /** The dimensions of the buffer */
+    unsigned int width, height;
+
+    /** The number of bytes per pixel */
+    unsigned int depth;
+
+    /** The number of levels of detail in data; every level directly follows
+        the previous one, and has half its dimensions */
+    unsigned int levels;
+
+    /** The arrangement of the pixels of the first level; only a spiral with
+        one level may be stored in tiles */
+    SpiralLayout layout;
+
+    /** The number of curves that extend from the centre **/
+    unsigned int curves;
+
+     /** The number of alterations of direction of the curves */
+    unsigned int alterations;
+
+    /** The radius of the spiral; pixels further from the centre will be
+        black */
+    unsigned int radius;
+
+    /** The twist to apply */
+    double twist;
+
+    /** The width of the curves; 0.5 means that half of the spiral will be
+        painted with the foreground colour and half with the background
+        colour */
+    double line_width;
+};
+
+/**
+ * A table of the polar coordinates of the pixels of a buffer.
+ *
+ * Only one quadrant is stored, since the other quadrants are mirror images of
+ * it.
+ */
+struct SpiralGrid {
+    /** The dimensions of the buffer */
+    unsigned int width, height;
+
+    /** The dimensions of the tables; the element at (i, j) describes the
+        pixels i + (width % 2) / 2 pixels from the centre horisontally and
+        j + (height % 2) / 2 pixels vertically */
+    unsigned int columns, rows;
+
+    /** The distances to the centre; this array contains columns * rows
+        elements */
+    float *distance;
+
+    /** The angles to the positive x axis, in the range [0, pi / 2]; this
+        array contains columns * rows elements */
+    float *angle;
+};
+
+/**
+ * The size of the tiles used when copying rotated pixels.
+ */
+#define SYMMETRY_TILE 64
+
+/**
+ * The size of the tiles in which the independent part of a spiral is
+ * calculated.
+ *
+ * The width is a multiple of the number of pixels per vector of all kernels,
+ * so that tiles get the same values as whole scan lines.
+ */
+#define GENERATION_TILE_WIDTH 256
+#define GENERATION_TILE_HEIGHT 32
+
+/**
+ * The number of scan lines calculated by one call when a job is split into
+ * scan lines instead of tiles.
+ */
+#define GENERATION_ROWS 16
+
+/**
+ * The rotational symmetries of a spiral that are exact on the pixel grid.
+ */
+typedef enum {
+    /** All pixels must be calculated */
+    SYMMETRY_NONE,
+
+    /** The spiral is invariant under rotation by 180 degrees */
+    SYMMETRY_HALF,
+
+    /** The spiral is invariant under rotation by 90 degrees */
+    SYMMETRY_QUARTER
+} Symmetry;
+
+/**
+ * A function that calculates a span of one scan line of a spiral.
+ *
+ * @param s
+ *     The spiral.
+ * @param y
+ *     The scan line to calculate.
+ * @param start, end
+ *     The first and one past the last column to calculate.
+ * @param d
+ *     The destination; the value for column start is written to d[0].
+ */
+typedef void (*SpiralRowKernel)(const Spiral *s, int y, int start, int end,
+    unsigned char *d);
+
+/**
+ * Calculates the distance to the centre of a line.
+ *
+ * @param s
+ *     The spiral.
+ * @param h, angle
+ *     The polar coordinates of the point.
+ * @return the distance to the centre of a line
+ */
+static inline double
+get_distance_to_line(const Spiral *s, double h, double angle)
+{
+    double segment, t, twisted;
+
+    /* Calculate the current segment, and how far we have reached within it */
+    t = modf(s->alterations * h / s->radius, &segment);
+
+    /* Calculate the twisted angle */
+    twisted = fmod(s->curves * (angle + ((int)segment % 2
+        ? t * s->twist
+        : s->twist * (1.0 - t))), 2 * M_PI);
+    if (twisted < 0.0) {
+        twisted += 2 * M_PI;
+    }
+
+    /* Return the absolute value of the distance to 0.5 */
+    return 2 * fabs((twisted / (2 * M_PI) - 0.5));
+}
+
+/**
+ * Calculates the alpha value of a point inside the radius of a spiral.
+ *
+ * @param s
+ *     The spiral.
+ * @param h, angle
+ *     The polar coordinates of the point; h must be less than s->radius + 1.
+ * @param center_radius
+ *     The radius of the centre disc.
+ * @return the alpha value of the point
+ */
+static inline unsigned int
+get_alpha(const Spiral *s, double h, double angle, int center_radius)
+{
+    unsigned int alpha;
+    double distance;
+
+    distance = get_distance_to_line(s, h, angle);
+
+    /* Include the anti alias border to allow a smooth border of the spiral
+       line */
+    if (distance < s->line_width + ANTI_ALIAS_BORDER) {
+        if (distance > s->line_width) {
+            alpha = (unsigned int)(255
+                - 255 * (distance - s->line_width) / ANTI_ALIAS_BORDER);
+        }
+        else {
+            alpha = 255;
+        }
+    }
+    else {
+        alpha = 0;
+    }
+
+    if ((int)h < center_radius) {
+        alpha = 255;
+    }
+    else if ((int)h == center_radius) {
+        double a = h - center_radius;
+        alpha = (unsigned int)(alpha * a + 255 * (1.0 - a));
+    }
+
+    /* If h is equal to or a fraction grater than the radius, we decrease the
+       alpha */
+    if ((int)h == (int)s->radius) {
+        alpha = (unsigned int)(alpha * (h - s->radius));
+    }
+
+    return alpha;
+}
+
+/**
+ * The state shared by the threads generating a spiral.
+ */
+typedef struct {
+    /** The spiral being generated */
+    Spiral *spiral;
+
+    /** The kernel used to calculate pixels */
+    SpiralRowKernel kernel;
+
+    /** The symmetry exploited; this is SYMMETRY_NONE unless region covers
+        the whole spiral */
+    Symmetry symmetry;
+
+    /** The region of the spiral to calculate */
+    SpiralRegion region;
+
+    /** The destination of the top left pixel of the region */
+    unsigned char *data;
+
+    /** The distance, in bytes, between the starts of consecutive scan lines
+        of data */
+    size_t stride;
+
+    /** The number of samples along each axis of a pixel on an edge; 1
+        disables supersampling */
+    unsigned int samples;
+
+    /** The destination of the second level of detail, which is reduced from
+        the first one while it is still in the cache, or NULL; if this is not
+        NULL, the region must cover the whole spiral, which must be at least
+        2 x 2 pixels */
+    unsigned char *reduced;
+
+    /** The distance, in bytes, between the starts of consecutive scan lines
+        of reduced */
+    size_t reduced_stride;
+} SpiralGeneration;
+
+/**
+ * The reference implementation of SpiralRowKernel.
+ *
+ * All other kernels are approximations of this one.
+ */
+void
+spiral_row_scalar(const Spiral *s, int y, int start, int end,
+    unsigned char *d);
+
+/**
+ * Returns the row kernel of a specific kind.
+ *
+ * @param kernel
+ *     The kind of kernel. If this is SPIRAL_KERNEL_AUTO, the best kernel
+ *     supported by the CPU is returned.
+ * @return the kernel, or NULL if it is not supported by the CPU or by the
+ *     compiler
+ */
+SpiralRowKernel
+spiral_kernel_get(SpiralKernel kernel);
+
+/**
+ * Returns the best kind of kernel supported by the CPU.
+ *
+ * @return the best supported kernel; this is never SPIRAL_KERNEL_AUTO
+ */
+SpiralKernel
+spiral_kernel_best(void);
+
+/**
+ * Allocates a spiral and its buffer without calculating its data.
+ *
+ * @param width, height
+ *     The dimensions of the buffer.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return a new spiral, or NULL if memory could not be allocated
+ */
+Spiral*
+spiral_alloc(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters);
+
+/**
+ * Enlarges the buffer of a spiral allocated by spiral_alloc to hold a full
+ * chain of levels of detail, as described for spiral_create_with_mipmaps.
+ *
+ * @param s
+ *     The spiral.
+ * @return non-zero if the buffer was enlarged, and 0 if memory could not be
+ *     allocated, in which case the spiral is unchanged
+ */
+int
+spiral_alloc_levels(Spiral *s);
+
+/**
+ * Rearranges the data of a spiral from scan lines into tiles.
+ *
+ * @param s
+ *     The spiral; its data must be stored in scan lines, and it must have one
+ *     level and a depth of 1.
+ * @return non-zero if the spiral was rearranged, and 0 if memory could not be
+ *     allocated, in which case the spiral is unchanged
+ */
+int
+spiral_layout_tile(Spiral *s);
+
+/**
+ * Calculates the levels of detail of a spiral from a level on.
+ *
+ * @param s
+ *     The spiral. The buffer must have room for all levels, and the levels
+ *     before first must have been calculated.
+ * @param first
+ *     The first level to calculate; this must be at least 1.
+ */
+void
+spiral_mipmap_fill(Spiral *s, unsigned int first);
+
+/**
+ * Calculates the pixels of the second level of detail whose four pixels of
+ * the first level lie in a rectangle.
+ *
+ * This is called for every rectangle of the first level as soon as it is
+ * final, so that it is reduced while it is still in the cache. Pixels that
+ * are calculated more than once get the same value every time.
+ *
+ * @param g
+ *     The spiral generation; reduced must not be NULL.
+ * @param x0, y0
+ *     The top left pixel of the rectangle.
+ * @param x1, y1
+ *     One past the bottom right pixel of the rectangle.
+ */
+void
+spiral_mipmap_reduce_rect(SpiralGeneration *g, int x0, int y0, int x1,
+    int y1);
+
+/**
+ * Determines the symmetry of a spiral.
+ *
+ * The pattern repeats every 2 pi / curves radians, and the centre of the
+ * spiral is the centre of the buffer, so an even number of curves makes the
+ * spiral invariant under rotation by 180 degrees, and a number of curves
+ * divisible by four makes a square spiral invariant under rotation by 90
+ * degrees.
+ *
+ * @param s
+ *     The spiral.
+ * @return the symmetry of the spiral
+ */
+Symmetry
+spiral_get_symmetry(const Spiral *s);
+
+/**
+ * Returns the number of scan lines, counted from the top, that must be
+ * calculated for a symmetry.
+ *
+ * @param s
+ *     The spiral.
+ * @param symmetry
+ *     The symmetry to exploit.
+ * @return the number of scan lines to calculate
+ */
+int
+spiral_symmetry_rows(const Spiral *s, Symmetry symmetry);
+
+/**
+ * Fills the parts of a spiral given by its symmetry.
+ *
+ * The scan lines returned by spiral_symmetry_rows must already have been
+ * calculated; for SYMMETRY_QUARTER only their left half is required, except
+ * for the centre scan line.
+ *
+ * @param g
+ *     The spiral generation; the region must cover the whole spiral.
+ */
+void
+spiral_symmetry_fill(SpiralGeneration *g);
+
+/**
+ * Determines whether all pixels of a rectangle of a spiral have the same
+ * value.
+ *
+ * The distance to the centre of a line is bounded from the ranges of the
+ * distances to the centre and the angles over the rectangle. This never
+ * reports a rectangle as uniform unless every kernel calculates the same
+ * value for all of its pixels, but rectangles on which the bounds are not
+ * tight enough are reported as not uniform.
+ *
+ * @param s
+ *     The spiral.
+ * @param x, y
+ *     The top left pixel of the rectangle.
+ * @param width, height
+ *     The dimensions of the rectangle.
+ * @return the value of all pixels, or -1 if the rectangle may not be
+ *     uniform
+ */
+int
+spiral_classify(const Spiral *s, int x, int y, int width, int height);
+
+/**
+ * Calculates a rectangle of a spiral, and fills the parts on which it is
+ * uniform without calculating their pixels.
+ *
+ * The rectangle is classified as a whole, and otherwise in blocks of 16 x 16
+ * pixels. The blocks that are not uniform are calculated by the kernel, and
+ * get the same values as when the whole rectangle is calculated.
+ *
+ * @param s
+ *     The spiral.
+ * @param kernel
+ *     The kernel.
+ * @param x, y
+ *     The top left pixel of the rectangle.
+ * @param width, height
+ *     The dimensions of the rectangle; width must not be greater than
+ *     GENERATION_TILE_WIDTH.
+ * @param d
+ *     The destination of the top left pixel.
+ * @param stride
+ *     The distance, in bytes, between the starts of consecutive scan lines of
+ *     d.
+ */
+void
+spiral_render_classified(const Spiral *s, SpiralRowKernel kernel, int x,
+    int y, int width, int height, unsigned char *d, size_t stride);
+
+/**
+ * Calculates a rectangle of the region, and supersamples the pixels on edges.
+ *
+ * @param g
+ *     The spiral generation; g->samples must be greater than 1.
+ * @param start, end
+ *     The first and one past the last scan line, relative to the region.
+ * @param first, last
+ *     The first and one past the last column, relative to the region.
+ */
+void
+spiral_supersample_rows(const SpiralGeneration *g, int start, int end,
+    int first, int last);
+
+/**
+ * Calculates a span of one scan line, and supersamples the pixels on edges.
+ *
+ * This calculates the neighbouring scan lines of the span, so
+ * spiral_supersample_rows should be used for whole scan lines.
+ *
+ * @param g
+ *     The spiral generation; g->samples must be greater than 1.
+ * @param y
+ *     The scan line, relative to the spiral.
+ * @param start, end
+ *     The first and one past the last column, relative to the spiral.
+ * @param d
+ *     The destination; the value for column start is written to d[0].
+ */
+void
+spiral_supersample_span(const SpiralGeneration *g, int y, int start, int end,
+    unsigned char *d);
+
+/**
+ * A function calculating one tile of a job of the thread pool.
+ *
+ * @param context
+ *     The context passed to spiral_pool_execute.
+ * @param tile
+ *     The tile, relative to the top left corner of the job.
+ */
+typedef void (*SpiralTileCallback)(void *context, const SpiralRegion *tile);
+
+/**
+ * A function calculating part of a range job of the thread pool; this has the
+ * signature of a libpara callback.
+ *
+ * @param context
+ *     The context passed to spiral_pool_execute_range.
+ * @param start, end
+ *     The first and one past the last index to calculate.
+ * @param gstart, gend
+ *     The range of the whole job.
+ * @return ignored
+ */
+typedef int (*SpiralRangeCallback)(void *context, int start, int end,
+    int gstart, int gend);
+
+/**
+ * Calculates a job in tiles on the thread pool selected by
+ * spiral_set_threads, and waits for all tiles to be calculated.
+ *
+ * Jobs are run one at a time, so this must not be called by a callback.
+ *
+ * @param context
+ *     The context passed to callback.
+ * @param callback
+ *     The function calculating a tile.
+ * @param width, height
+ *     The dimensions of the job.
+ * @param tile_width, tile_height
+ *     The dimensions of a tile; tiles on the right and bottom edges may be
+ *     smaller.
+ */
+void
+spiral_pool_execute(void *context, SpiralTileCallback callback,
+    unsigned int width, unsigned int height, unsigned int tile_width,
+    unsigned int tile_height);
+
+/**
+ * Calculates a range of indices, such as scan lines, on the thread pool.
+ *
+ * @param context
+ *     The context passed to callback.
+ * @param callback
+ *     The function calculating part of the range.
+ * @param start, end
+ *     The range to calculate.
+ * @param size
+ *     The number of consecutive indices passed to one call of callback.
+ */
+void
+spiral_pool_execute_range(void *context, SpiralRangeCallback callback,
+    int start, int end, unsigned int size);
+
+#endif
@@ -0,0 +1,285 @@
+#include <math.h>
+
+#include "spiral_private.h"
+#include "spiral_shader.h"
+
+#define STRINGIFY(value) #value
+#define TO_STRING(value) STRINGIFY(value)
+
+/**
+ * The vertex shader.
+ *
+ * The position passed on is the position relative to the centre, in pixels of
+ * the texture, of the texel that would be sampled.
+ */
+static const char *vertex_shader =
+    "#version 120\n"
+    "uniform float size;\n"
+    "varying vec2 position;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = ftransform();\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    position = gl_MultiTexCoord0.xy * size - vec2(0.5 * size + 0.5);\n"
+    "}\n";
+
+/**
+ * The fragment shader.
+ *
+ * This is a port of get_distance_to_line and get_alpha.
+ */
+static const char *fragment_shader =
+    "#version 120\n"
+    "#define ANTI_ALIAS_BORDER " TO_STRING(ANTI_ALIAS_BORDER) "\n"
+    "#define PI 3.14159265358979\n"
+    "uniform float curves;\n"
+    "uniform float alterations;\n"
+    "uniform float radius;\n"
+    "uniform float twist;\n"
+    "uniform float line_width;\n"
+    "uniform float center_radius;\n"
+    "varying vec2 position;\n"
+    "float get_distance_to_line(float h, float angle)\n"
+    "{\n"
+    "    float segment_t = alterations * h / radius;\n"
+    "    float segment = floor(segment_t);\n"
+    "    float t = segment_t - segment;\n"
+    "    float twisted = mod(curves * (angle + (mod(segment, 2.0) >= 1.0\n"
+    "        ? t * twist\n"
+    "        : twist * (1.0 - t))), 2.0 * PI);\n"
+    "    return 2.0 * abs(twisted / (2.0 * PI) - 0.5);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    float h = length(position);\n"
+    "    float alpha = 0.0;\n"
+    "    if (h < radius + 1.0) {\n"
+    "        float distance = get_distance_to_line(h,\n"
+    "            atan(position.y, position.x));\n"
+    "        if (distance < line_width + ANTI_ALIAS_BORDER) {\n"
+    "            alpha = distance > line_width\n"
+    "                ? floor(255.0 - 255.0 * (distance - line_width)\n"
+    "                    / ANTI_ALIAS_BORDER)\n"
+    "                : 255.0;\n"
+    "        }\n"
+    "        if (floor(h) < center_radius) {\n"
+    "            alpha = 255.0;\n"
+    "        }\n"
+    "        else if (floor(h) == center_radius) {\n"
+    "            float a = h - center_radius;\n"
+    "            alpha = floor(alpha * a + 255.0 * (1.0 - a));\n"
+    "        }\n"
+    "        if (floor(h) == radius) {\n"
+    "            alpha = floor(alpha * (h - radius));\n"
+    "        }\n"
+    "    }\n"
+    "    gl_FragColor = vec4(gl_Color.rgb, alpha / 255.0);\n"
+    "}\n";
+
+/**
+ * The fragment shader used with polar spirals.
+ *
+ * The polar coordinates of the fragment are used to look up the texture
+ * created by spiral_create_polar; the texture must repeat horisontally.
+ */
+static const char *polar_fragment_shader =
+    "#version 120\n"
+    "#define PI 3.14159265358979\n"
+    "uniform sampler2D spiral;\n"
+    "uniform float curves;\n"
+    "uniform float radius;\n"
+    "varying vec2 position;\n"
+    "void main()\n"
+    "{\n"
+    "    float h = length(position);\n"
+    "    float alpha = 0.0;\n"
+    "    if (h < radius + 1.0) {\n"
+    "        alpha = texture2D(spiral, vec2(\n"
+    "            curves * atan(position.y, position.x) / (2.0 * PI),\n"
+    "            h / (radius + 1.0))).a;\n"
+    "    }\n"
+    "    gl_FragColor = vec4(gl_Color.rgb, alpha);\n"
+    "}\n";
+
+/**
+ * The fragment shader used with distance fields.
+ *
+ * The edge of a curve is placed in the middle of the anti aliased border of
+ * the texture, and is smoothed over one pixel of the screen, whatever the
+ * resolution of the field.
+ */
+static const char *distance_fragment_shader =
+    "#version 120\n"
+    "#define ANTI_ALIAS_BORDER " TO_STRING(ANTI_ALIAS_BORDER) "\n"
+    "uniform sampler2D spiral;\n"
+    "uniform float size;\n"
+    "uniform float radius;\n"
+    "uniform float line_width;\n"
+    "uniform float center_radius;\n"
+    "varying vec2 position;\n"
+    "void main()\n"
+    "{\n"
+    "    float h = length(position);\n"
+    "    float distance = texture2D(spiral,\n"
+    "        (position + vec2(0.5 * size + 0.5)) / size).a;\n"
+    "    float edge = line_width + 0.5 * ANTI_ALIAS_BORDER - distance;\n"
+    "    float alpha = clamp(edge / max(fwidth(distance), 1e-6) + 0.5,\n"
+    "        0.0, 1.0);\n"
+    "    alpha = max(alpha, clamp(center_radius + 1.0 - h, 0.0, 1.0));\n"
+    "    alpha *= clamp(radius + 1.0 - h, 0.0, 1.0);\n"
+    "    gl_FragColor = vec4(gl_Color.rgb, alpha);\n"
+    "}\n";
+
+/**
+ * The kinds of program created by this module.
+ */
+typedef enum {
+    SPIRAL_SHADER_SPIRAL,
+    SPIRAL_SHADER_POLAR,
+    SPIRAL_SHADER_DISTANCE,
+    SPIRAL_SHADER_COUNT
+} SpiralShaderKind;
+
+/**
+ * The locations of the uniforms of a program; a uniform that the program
+ * does not use has location -1, which glUniform ignores.
+ */
+typedef struct {
+    /** The program the locations belong to, or 0 */
+    GLuint program;
+
+    GLint size;
+    GLint curves;
+    GLint alterations;
+    GLint radius;
+    GLint twist;
+    GLint line_width;
+    GLint center_radius;
+} SpiralShaderUniforms;
+
+/**
+ * The uniform locations of the most recently linked program of every kind.
+ */
+static SpiralShaderUniforms spiral_shader_uniforms[SPIRAL_SHADER_COUNT];
+
+/**
+ * Returns the uniform locations of a program.
+ *
+ * The locations are looked up when a program is linked, so that setting the
+ * parameters every frame does not query them by name; they are looked up
+ * again only if the parameters are set for another program of the same kind.
+ *
+ * @param kind
+ *     The kind of program.
+ * @param program
+ *     The program.
+ * @return the locations
+ */
+static const SpiralShaderUniforms*
+spiral_shader_locate(SpiralShaderKind kind, GLuint program)
+{
+    SpiralShaderUniforms *u = &spiral_shader_uniforms[kind];
+
+    if (u->program != program) {
+        u->program = program;
+        u->size = glGetUniformLocation(program, "size");
+        u->curves = glGetUniformLocation(program, "curves");
+        u->alterations = glGetUniformLocation(program, "alterations");
+        u->radius = glGetUniformLocation(program, "radius");
+        u->twist = glGetUniformLocation(program, "twist");
+        u->line_width = glGetUniformLocation(program, "line_width");
+        u->center_radius = glGetUniformLocation(program, "center_radius");
+    }
+
+    return u;
+}
+
+/**
+ * Creates a program and looks up its uniform locations.
+ *
+ * @param kind
+ *     The kind of program.
+ * @param fragment
+ *     The source of the fragment shader.
+ * @return the program, or 0 if shaders are not supported or the program
+ *     failed to compile
+ */
+static GLuint
+spiral_shader_link(SpiralShaderKind kind, const char *fragment)
+{
+    GLuint program;
+
+    if (!opengl_has_shaders()) {
+        return 0;
+    }
+
+    program = opengl_program_create(vertex_shader, fragment);
+    if (program) {
+        spiral_shader_uniforms[kind].program = 0;
+        spiral_shader_locate(kind, program);
+    }
+
+    return program;
+}
+
+GLuint
+spiral_shader_create(void)
+{
+    return spiral_shader_link(SPIRAL_SHADER_SPIRAL, fragment_shader);
+}
+
+void
+spiral_shader_set_parameters(GLuint program, unsigned int size,
+    const SpiralParameters *parameters)
+{
+    const SpiralShaderUniforms *u = spiral_shader_locate(
+        SPIRAL_SHADER_SPIRAL, program);
+
+    glUniform1f(u->size, size);
+    glUniform1f(u->curves, parameters->curves);
+    glUniform1f(u->alterations, parameters->alterations);
+    glUniform1f(u->radius, parameters->radius);
+    glUniform1f(u->twist, parameters->twist);
+    glUniform1f(u->line_width, parameters->line_width);
+    glUniform1f(u->center_radius,
+        (int)sqrt(parameters->curves * CENTER_RADIUS));
+}
+
+GLuint
+spiral_shader_create_polar(void)
+{
+    return spiral_shader_link(SPIRAL_SHADER_POLAR, polar_fragment_shader);
+}
+
+void
+spiral_shader_set_polar_parameters(GLuint program, unsigned int size,
+    unsigned int curves, unsigned int radius)
+{
+    const SpiralShaderUniforms *u = spiral_shader_locate(
+        SPIRAL_SHADER_POLAR, program);
+
+    glUniform1f(u->size, size);
+    glUniform1f(u->curves, curves);
+    glUniform1f(u->radius, radius);
+}
+
+GLuint
+spiral_shader_create_distance(void)
+{
+    return spiral_shader_link(SPIRAL_SHADER_DISTANCE,
+        distance_fragment_shader);
+}
+
+void
+spiral_shader_set_distance_parameters(GLuint program, unsigned int size,
+    const SpiralParameters *parameters)
+{
+    const SpiralShaderUniforms *u = spiral_shader_locate(
+        SPIRAL_SHADER_DISTANCE, program);
+
+    glUniform1f(u->size, size);
+    glUniform1f(u->radius, parameters->radius);
+    glUniform1f(u->line_width, parameters->line_width);
+    glUniform1f(u->center_radius,
+        (int)sqrt(parameters->curves * CENTER_RADIUS));
+}
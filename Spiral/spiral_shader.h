@@ -0,0 +1,100 @@
+#ifndef SPIRAL_SHADER_H
+#define SPIRAL_SHADER_H
+
+#include "opengl.h"
+#include "spiral.h"
+
+/**
+ * Creates a program that calculates the spiral per fragment.
+ *
+ * The program replaces the spiral texture: it expects the texture coordinates
+ * that would be used to draw the texture, and uses the primary colour with
+ * the alpha value of the spiral.
+ *
+ * @return the program, or 0 if shaders are not supported or the program
+ *     failed to compile
+ */
+GLuint
+spiral_shader_create(void);
+
+/**
+ * Sets the parameters of the spiral calculated by a program.
+ *
+ * The program must be in use.
+ *
+ * @param program
+ *     A program created by spiral_shader_create.
+ * @param size
+ *     The size, in pixels, of the texture the program replaces.
+ * @param parameters
+ *     The parameters of the spiral.
+ */
+void
+spiral_shader_set_parameters(GLuint program, unsigned int size,
+    const SpiralParameters *parameters);
+
+/**
+ * Creates a program that draws a spiral from a polar texture.
+ *
+ * The program expects the same texture coordinates as the program created by
+ * spiral_shader_create, and the texture created by spiral_create_polar bound
+ * to texture unit 0, with GL_REPEAT as horisontal wrap mode.
+ *
+ * @return the program, or 0 if shaders are not supported or the program
+ *     failed to compile
+ */
+GLuint
+spiral_shader_create_polar(void);
+
+/**
+ * Sets the parameters of a program created by spiral_shader_create_polar.
+ *
+ * The program must be in use.
+ *
+ * @param program
+ *     A program created by spiral_shader_create_polar.
+ * @param size
+ *     The size, in pixels, of the square texture the program replaces.
+ * @param curves
+ *     The number of curves of the spiral in the bound texture.
+ * @param radius
+ *     The radius of the spiral.
+ */
+void
+spiral_shader_set_polar_parameters(GLuint program, unsigned int size,
+    unsigned int curves, unsigned int radius);
+
+/**
+ * Creates a program that draws a spiral from a distance field.
+ *
+ * The program expects the same texture coordinates as the program created by
+ * spiral_shader_create, and the texture created by spiral_create_distance
+ * bound to texture unit 0 with linear filtering. The curves are thresholded
+ * at the line width, so the line width may change without recreating the
+ * field.
+ *
+ * @return the program, or 0 if shaders are not supported or the program
+ *     failed to compile
+ */
+GLuint
+spiral_shader_create_distance(void);
+
+/**
+ * Sets the parameters of a program created by spiral_shader_create_distance.
+ *
+ * The program must be in use.
+ *
+ * @param program
+ *     A program created by spiral_shader_create_distance.
+ * @param size
+ *     The size, in pixels, of the texture the program replaces; the field
+ *     may be smaller.
+ * @param parameters
+ *     The parameters of the spiral; the radius is that of a spiral of the
+ *     size of the replaced texture.
+ */
+void
+spiral_shader_set_distance_parameters(GLuint program, unsigned int size,
+    const SpiralParameters *parameters);
+
+#endif
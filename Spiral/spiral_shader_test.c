@@ -0,0 +1,450 @@
+/*
+ * A test of the programs that draw the spiral.
+ *
+ * A headless OpenGL context is created, and every spiral of a matrix of
+ * parameters is drawn into a framebuffer with one fragment per texel: once
+ * from a texture created by the reference kernel, and once by each program;
+ * the shader that calculates the spiral per fragment, the program that maps
+ * a polar texture and the program that thresholds a distance field. The
+ * alpha values read back are compared, and the test fails if any pixel
+ * differs by more than the bound of the program, or if more than
+ * TEST_MAX_COVERAGE percent of the pixels are covered by a curve in only one
+ * of the spirals.
+ *
+ * Unless LIBGL_ALWAYS_SOFTWARE is already set, it is set to 1, so that the
+ * test runs on Mesa's llvmpipe rasteriser even on machines with a GPU.
+ *
+ * The result of every spiral is written to stdout, and the exit status is 0
+ * if all spirals are within the bound, 1 if any is not, and 77 if no
+ * context supporting shaders could be created.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "headless.h"
+#include "opengl.h"
+#include "spiral.h"
+#include "spiral_shader.h"
+
+/**
+ * The dimensions of the framebuffer and of the spiral textures.
+ */
+#define TEST_SIZE 512
+
+/**
+ * The largest difference, in alpha levels, allowed between a pixel drawn by
+ * the shader and by the texture.
+ *
+ * The shader runs in single precision, which moves the edges of the lines by
+ * a small fraction of a pixel.
+ */
+#define TEST_MAX_ERROR 3
+
+/**
+ * The bound of programs that approximate the anti aliased edges.
+ *
+ * The polar texture is resampled by linear filtering, and the edges of a
+ * distance field are smoothed over one fragment instead of over
+ * ANTI_ALIAS_BORDER, so a pixel on an edge may differ by any amount.
+ */
+#define TEST_MAX_ERROR_EDGES 255
+
+/**
+ * The largest percentage of pixels that may be covered, with an alpha value
+ * of at least one half, in only one of the spirals compared.
+ *
+ * This places the edges of the curves drawn by all programs, even those whose
+ * anti aliasing differs from that of the texture.
+ */
+#define TEST_MAX_COVERAGE 0.5
+
+/**
+ * The exit status reporting that the test could not run.
+ */
+#define TEST_SKIPPED 77
+
+/**
+ * The parameters compared: curves, alterations, twist and line width.
+ */
+static const double test_parameters[][4] = {
+    {3, 1, 0.0, 0.2},
+    {10, 10, 5.0, 0.2},
+    {12, 10, -5.0, 0.45},
+    {30, 30, 30.0, 0.2},
+    {5, 2, 1.0, 0.3},
+    {8, 3, -1.0, 0.45},
+    {30, 1, 0.0, 0.2}};
+
+/**
+ * The parameters compared for polar textures.
+ *
+ * The polar texture stores one sample per pixel along the radius, so the
+ * curves of spirals that twist by a large part of a period per pixel, like
+ * the second to fourth of test_parameters, alias; those are left out.
+ */
+static const double test_polar_parameters[][4] = {
+    {3, 1, 0.0, 0.2},
+    {5, 2, 1.0, 0.3},
+    {8, 3, -1.0, 0.45},
+    {30, 1, 0.0, 0.2}};
+
+/**
+ * A program to compare to the texture.
+ */
+typedef struct {
+    /** The name of the program */
+    const char *name;
+
+    /** Creates the program */
+    GLuint (*create)(void);
+
+    /** Draws a spiral by the program as described for test_draw, and
+        returns non-zero if it was drawn and 0 otherwise */
+    int (*draw)(GLuint program, const SpiralParameters *parameters,
+        unsigned char *alpha);
+
+    /** The largest difference allowed, in alpha levels */
+    int max_error;
+
+    /** The parameters compared */
+    const double (*parameters)[4];
+
+    /** The number of elements of parameters */
+    unsigned int count;
+} TestProgram;
+
+/**
+ * Draws a square covering the framebuffer, with texture coordinates covering
+ * the texture, and reads back the alpha values.
+ *
+ * @param alpha
+ *     The alpha values, from the bottom scan line up; this array must have
+ *     room for TEST_SIZE * TEST_SIZE elements.
+ */
+static void
+test_draw(unsigned char *alpha)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    glColor4f(1.0, 1.0, 1.0, 1.0);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 0.0);
+    glVertex2f(0.0, 0.0);
+    glTexCoord2f(1.0, 0.0);
+    glVertex2f(1.0, 0.0);
+    glTexCoord2f(1.0, 1.0);
+    glVertex2f(1.0, 1.0);
+    glTexCoord2f(0.0, 1.0);
+    glVertex2f(0.0, 1.0);
+    glEnd();
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, TEST_SIZE, TEST_SIZE, GL_ALPHA, GL_UNSIGNED_BYTE,
+        alpha);
+}
+
+/**
+ * Uploads a spiral to a new texture, which is left bound.
+ *
+ * @param spiral
+ *     The spiral.
+ * @param filter
+ *     The minification and magnification filter.
+ * @param wrap
+ *     The horisontal wrap mode; the texture is clamped vertically.
+ * @return the texture
+ */
+static GLuint
+test_upload(Spiral *spiral, GLint filter, GLint wrap)
+{
+    int wide = spiral_get_depth(spiral) == 2;
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, wide ? GL_ALPHA16 : GL_ALPHA8,
+        spiral_get_width(spiral), spiral_get_height(spiral), 0, GL_ALPHA,
+        wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+        spiral_get_data(spiral));
+
+    return texture;
+}
+
+/**
+ * Draws a spiral from a texture created by the reference kernel.
+ *
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param alpha
+ *     Receives the alpha values, as described for test_draw.
+ * @return non-zero if the spiral was drawn and 0 otherwise
+ */
+static int
+test_draw_texture(const SpiralParameters *parameters, unsigned char *alpha)
+{
+    Spiral *spiral;
+    GLuint texture;
+
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    spiral = spiral_create_with_parameters(TEST_SIZE, TEST_SIZE, parameters);
+    if (!spiral) {
+        return 0;
+    }
+
+    /* One texel per fragment, sampled at its centre */
+    texture = test_upload(spiral, GL_NEAREST, GL_CLAMP_TO_EDGE);
+    spiral_free(spiral);
+
+    glEnable(GL_TEXTURE_2D);
+    test_draw(alpha);
+    glDisable(GL_TEXTURE_2D);
+    glDeleteTextures(1, &texture);
+
+    return 1;
+}
+
+/**
+ * Draws a spiral by the shader.
+ *
+ * @param program
+ *     The program created by spiral_shader_create.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param alpha
+ *     Receives the alpha values, as described for test_draw.
+ * @return 1
+ */
+static int
+test_draw_shader(GLuint program, const SpiralParameters *parameters,
+    unsigned char *alpha)
+{
+    glUseProgram(program);
+    spiral_shader_set_parameters(program, TEST_SIZE, parameters);
+    test_draw(alpha);
+    glUseProgram(0);
+
+    return 1;
+}
+
+/**
+ * Draws a spiral from a polar texture of its natural size.
+ *
+ * @param program
+ *     The program created by spiral_shader_create_polar.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param alpha
+ *     Receives the alpha values, as described for test_draw.
+ * @return non-zero if the spiral was drawn and 0 otherwise
+ */
+static int
+test_draw_polar(GLuint program, const SpiralParameters *parameters,
+    unsigned char *alpha)
+{
+    unsigned int width, height;
+    Spiral *spiral;
+    GLuint texture;
+
+    spiral_polar_size(parameters, &width, &height);
+    spiral = spiral_create_polar(width, height, parameters);
+    if (!spiral) {
+        return 0;
+    }
+    texture = test_upload(spiral, GL_LINEAR, GL_REPEAT);
+    spiral_free(spiral);
+
+    glUseProgram(program);
+    spiral_shader_set_polar_parameters(program, TEST_SIZE,
+        parameters->curves, parameters->radius);
+    test_draw(alpha);
+    glUseProgram(0);
+    glDeleteTextures(1, &texture);
+
+    return 1;
+}
+
+/**
+ * Draws a spiral from a distance field of 16 bits with one texel per
+ * fragment.
+ *
+ * @param program
+ *     The program created by spiral_shader_create_distance.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param alpha
+ *     Receives the alpha values, as described for test_draw.
+ * @return non-zero if the spiral was drawn and 0 otherwise
+ */
+static int
+test_draw_distance(GLuint program, const SpiralParameters *parameters,
+    unsigned char *alpha)
+{
+    Spiral *spiral;
+    GLuint texture;
+
+    spiral = spiral_create_distance(TEST_SIZE, TEST_SIZE, parameters, 16);
+    if (!spiral) {
+        return 0;
+    }
+    texture = test_upload(spiral, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    spiral_free(spiral);
+
+    glUseProgram(program);
+    spiral_shader_set_distance_parameters(program, TEST_SIZE, parameters);
+    test_draw(alpha);
+    glUseProgram(0);
+    glDeleteTextures(1, &texture);
+
+    return 1;
+}
+
+/**
+ * The programs compared.
+ */
+static const TestProgram test_programs[] = {
+    {"shader", spiral_shader_create, test_draw_shader, TEST_MAX_ERROR,
+        test_parameters,
+        sizeof(test_parameters) / sizeof(*test_parameters)},
+    {"polar", spiral_shader_create_polar, test_draw_polar,
+        TEST_MAX_ERROR_EDGES, test_polar_parameters,
+        sizeof(test_polar_parameters) / sizeof(*test_polar_parameters)},
+    {"distance", spiral_shader_create_distance, test_draw_distance,
+        TEST_MAX_ERROR_EDGES, test_parameters,
+        sizeof(test_parameters) / sizeof(*test_parameters)}};
+
+/**
+ * Compares the spirals drawn by a program to those drawn from textures.
+ *
+ * The result of every spiral is written to stdout.
+ *
+ * @param test
+ *     The program.
+ * @param texture, drawn
+ *     Buffers for the alpha values, as described for test_draw.
+ * @return non-zero if all spirals were drawn within the bounds and 0
+ *     otherwise
+ */
+static int
+test_program(const TestProgram *test, unsigned char *texture,
+    unsigned char *drawn)
+{
+    GLuint program = test->create();
+    unsigned int i;
+    int passed = 1;
+
+    if (!program) {
+        fprintf(stderr, "Unable to create the %s program.\n", test->name);
+        return 0;
+    }
+
+    for (i = 0; i < test->count; i++) {
+        SpiralParameters parameters;
+        int j, max = 0, differing = 0, covered = 0, ok;
+
+        parameters.curves = (unsigned int)test->parameters[i][0];
+        parameters.alterations = (unsigned int)test->parameters[i][1];
+        parameters.radius = TEST_SIZE / 2 - 1;
+        parameters.twist = test->parameters[i][2];
+        parameters.line_width = test->parameters[i][3];
+
+        if (!test_draw_texture(&parameters, texture)
+                || !test->draw(program, &parameters, drawn)) {
+            fprintf(stderr, "Unable to create spiral.\n");
+            passed = 0;
+            continue;
+        }
+
+        for (j = 0; j < TEST_SIZE * TEST_SIZE; j++) {
+            int difference = abs(texture[j] - drawn[j]);
+
+            if (difference) {
+                differing++;
+                if (difference > max) {
+                    max = difference;
+                }
+            }
+            if ((texture[j] >= 128) != (drawn[j] >= 128)) {
+                covered++;
+            }
+        }
+
+        ok = max <= test->max_error
+            && 100.0 * covered / (TEST_SIZE * TEST_SIZE) <= TEST_MAX_COVERAGE;
+        printf("%-8s curves %2u, alterations %2u, twist %5.1f, "
+            "line width %.2f: %s, max error %d (bound %d), "
+            "%.4f%% of pixels differ, %.4f%% covered differently "
+            "(bound %.2f%%)\n",
+            test->name, parameters.curves, parameters.alterations,
+            parameters.twist, parameters.line_width, ok ? "ok" : "FAILED",
+            max, test->max_error,
+            100.0 * differing / (TEST_SIZE * TEST_SIZE),
+            100.0 * covered / (TEST_SIZE * TEST_SIZE), TEST_MAX_COVERAGE);
+        if (!ok) {
+            passed = 0;
+        }
+    }
+
+    glDeleteProgram(program);
+
+    return passed;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned char *texture, *drawn;
+    GLuint program;
+    unsigned int i;
+    int failed = 0;
+
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    if (!headless_init(TEST_SIZE, TEST_SIZE)) {
+        fprintf(stderr, "Skipped: no headless OpenGL context.\n");
+        return TEST_SKIPPED;
+    }
+    program = spiral_shader_create();
+    if (!program) {
+        fprintf(stderr, "Skipped: shaders are not supported.\n");
+        headless_free();
+        return TEST_SKIPPED;
+    }
+    glDeleteProgram(program);
+    printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+    texture = malloc(TEST_SIZE * TEST_SIZE);
+    drawn = malloc(TEST_SIZE * TEST_SIZE);
+    if (!texture || !drawn) {
+        fprintf(stderr, "Unable to allocate memory.\n");
+        free(texture);
+        free(drawn);
+        headless_free();
+        return 1;
+    }
+
+    /* Map the square to the whole framebuffer, and write the alpha value of
+       every fragment without blending */
+    glViewport(0, 0, TEST_SIZE, TEST_SIZE);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glDisable(GL_BLEND);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+
+    for (i = 0; i < sizeof(test_programs) / sizeof(*test_programs); i++) {
+        if (!test_program(&test_programs[i], texture, drawn)) {
+            failed = 1;
+        }
+    }
+
+    free(texture);
+    free(drawn);
+    headless_free();
+
+    return failed;
+}
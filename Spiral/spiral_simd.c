@@ -0,0 +1,376 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/*
+ * The vectorised kernels are only built for x86 using GCC, since they rely on
+ * #pragma GCC target to enable instruction sets per kernel.
+ */
+#if defined(__GNUC__) && !defined(__clang__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define SPIRAL_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * The maximum width and height of a spiral for the single precision kernels.
+ *
+ * Four times the squared distance to the centre must fit in a signed 32 bit
+ * integer.
+ */
+#define SPIRAL_SIMD_MAX_SIZE 32768
+
+/**
+ * The scalar values used by a single precision kernel for one scan line.
+ */
+typedef struct {
+    /** Twice the horizontal distance from the centre to the first pixel */
+    int u;
+
+    /** Four times the squared vertical distance to the centre */
+    int vv;
+
+    /** The absolute vertical distance to the centre */
+    float ay;
+
+    /** 1.0 if the scan line is below the centre and -1.0 otherwise */
+    float sign;
+
+    /** Thresholds for four times the squared distance to the centre: inside
+        the centre disc, inside its anti aliased border, inside the rim and
+        inside the spiral */
+    int q_center, q_center1, q_rim, q_outer;
+
+    /** The radius of the centre disc and of the spiral */
+    float center_radius, radius;
+
+    /** Spiral::alterations / Spiral::radius */
+    float alterations;
+
+    /** Spiral::curves / 2 pi */
+    float curves;
+
+    /** The spiral attributes */
+    float twist, line_width;
+
+    /** The slope of the anti aliasing ramp */
+    float ramp;
+} SpiralSimdRow;
+
+/**
+ * Calculates four times the square of a distance, saturated to INT_MAX.
+ *
+ * @param distance
+ *     The distance.
+ * @return four times the squared distance
+ */
+static int
+spiral_simd_square(unsigned int distance)
+{
+    long long result = 4LL * distance * distance;
+
+    return result > INT_MAX ? INT_MAX : (int)result;
+}
+
+/**
+ * Initialises the scalar values for a scan line.
+ *
+ * @param r
+ *     The values to initialise.
+ * @param s
+ *     The spiral.
+ * @param y
+ *     The scan line.
+ * @param start
+ *     The first column to calculate.
+ * @return non-zero if the single precision kernels can be used for the spiral
+ *     and 0 otherwise
+ */
+static int
+spiral_simd_row_init(SpiralSimdRow *r, const Spiral *s, int y, int start)
+{
+    unsigned int center_radius = (unsigned int)sqrt(s->curves * CENTER_RADIUS);
+    int v = 2 * y - (int)s->height;
+
+    if (s->width >= SPIRAL_SIMD_MAX_SIZE || s->height >= SPIRAL_SIMD_MAX_SIZE
+            || s->radius == 0) {
+        return 0;
+    }
+
+    r->u = 2 * start - (int)s->width;
+    r->vv = v * v;
+    r->ay = 0.5f * abs(v);
+    r->sign = v < 0 ? -1.0f : 1.0f;
+    r->q_center = spiral_simd_square(center_radius);
+    r->q_center1 = spiral_simd_square(center_radius + 1);
+    r->q_rim = spiral_simd_square(s->radius);
+    r->q_outer = spiral_simd_square(s->radius + 1);
+    r->center_radius = center_radius;
+    r->radius = s->radius;
+    r->alterations = (float)s->alterations / s->radius;
+    r->curves = s->curves / (2 * M_PI);
+    r->twist = s->twist;
+    r->line_width = s->line_width;
+    r->ramp = -255.0 / ANTI_ALIAS_BORDER;
+
+    return 1;
+}
+
+/*
+ * Portable single precision; 1 pixel per iteration
+ */
+static inline float
+spiral_float_floor(float v)
+{
+    float t = (float)(int)v;
+
+    return t > v ? t - 1.0f : t;
+}
+
+#define KERNEL_NAME spiral_row_float
+#define W 1
+#define W_SHIFT 2
+#define VF float
+#define VI int
+#define F_SET1(a) ((float)(a))
+#define F_ADD(a, b) ((a) + (b))
+#define F_SUB(a, b) ((a) - (b))
+#define F_MUL(a, b) ((a) * (b))
+#define F_DIV(a, b) ((a) / (b))
+#define F_MADD(a, b, c) ((a) * (b) + (c))
+#define F_SQRT(a) sqrtf(a)
+#define F_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define F_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define F_ABS(a) fabsf(a)
+#define F_FLOOR(a) spiral_float_floor(a)
+#define F_TRUNC(a) ((float)(int)(a))
+#define F_FROM_I(a) ((float)(a))
+#define F_LT(a, b) ((a) < (b))
+#define F_GT(a, b) ((a) > (b))
+#define I_SET1(a) ((int)(a))
+#define I_LOADU(p) (*(p))
+#define I_ADD(a, b) ((a) + (b))
+#define I_SLLI(a, n) ((int)((unsigned int)(a) << (n)))
+#define I_TRUNC(a) ((int)(a))
+#define I_LT(a, b) ((a) < (b))
+#define I_ODD(a) ((a) & 1)
+#define SELECT(m, a, b) ((m) ? (a) : (b))
+#define STORE_U8(p, v) (*(p) = (unsigned char)(v))
+#include "spiral_simd.inc"
+
+#ifdef SPIRAL_SIMD
+
+/*
+ * SSE2; 4 pixels per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+static inline __m128
+spiral_sse2_floor(__m128 v)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+
+static inline void
+spiral_sse2_store(unsigned char *d, __m128i v)
+{
+    int packed;
+
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    packed = _mm_cvtsi128_si32(v);
+    memcpy(d, &packed, sizeof(packed));
+}
+
+#define KERNEL_NAME spiral_row_sse2
+#define W 4
+#define W_SHIFT 4
+#define VF __m128
+#define VI __m128i
+#define F_SET1(a) _mm_set1_ps(a)
+#define F_ADD(a, b) _mm_add_ps(a, b)
+#define F_SUB(a, b) _mm_sub_ps(a, b)
+#define F_MUL(a, b) _mm_mul_ps(a, b)
+#define F_DIV(a, b) _mm_div_ps(a, b)
+#define F_MADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define F_SQRT(a) _mm_sqrt_ps(a)
+#define F_MIN(a, b) _mm_min_ps(a, b)
+#define F_MAX(a, b) _mm_max_ps(a, b)
+#define F_ABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define F_FLOOR(a) spiral_sse2_floor(a)
+#define F_TRUNC(a) _mm_cvtepi32_ps(_mm_cvttps_epi32(a))
+#define F_FROM_I(a) _mm_cvtepi32_ps(a)
+#define F_LT(a, b) _mm_cmplt_ps(a, b)
+#define F_GT(a, b) _mm_cmpgt_ps(a, b)
+#define I_SET1(a) _mm_set1_epi32(a)
+#define I_LOADU(p) _mm_loadu_si128((const __m128i*)(p))
+#define I_ADD(a, b) _mm_add_epi32(a, b)
+#define I_SLLI(a, n) _mm_slli_epi32(a, n)
+#define I_TRUNC(a) _mm_cvttps_epi32(a)
+#define I_LT(a, b) _mm_castsi128_ps(_mm_cmplt_epi32(a, b))
+#define I_ODD(a) _mm_castsi128_ps(_mm_cmpeq_epi32( \
+    _mm_and_si128(a, _mm_set1_epi32(1)), _mm_set1_epi32(1)))
+#define SELECT(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#define STORE_U8(p, v) spiral_sse2_store(p, v)
+#include "spiral_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX2 and FMA; 8 pixels per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+static inline void
+spiral_avx2_store(unsigned char *d, __m256i v)
+{
+    __m128i packed = _mm_packs_epi32(
+        _mm256_castsi256_si128(v),
+        _mm256_extracti128_si256(v, 1));
+
+    packed = _mm_packus_epi16(packed, packed);
+    _mm_storel_epi64((__m128i*)d, packed);
+}
+
+#define KERNEL_NAME spiral_row_avx2
+#define W 8
+#define W_SHIFT 5
+#define VF __m256
+#define VI __m256i
+#define F_SET1(a) _mm256_set1_ps(a)
+#define F_ADD(a, b) _mm256_add_ps(a, b)
+#define F_SUB(a, b) _mm256_sub_ps(a, b)
+#define F_MUL(a, b) _mm256_mul_ps(a, b)
+#define F_DIV(a, b) _mm256_div_ps(a, b)
+#define F_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#define F_SQRT(a) _mm256_sqrt_ps(a)
+#define F_MIN(a, b) _mm256_min_ps(a, b)
+#define F_MAX(a, b) _mm256_max_ps(a, b)
+#define F_ABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define F_FLOOR(a) _mm256_floor_ps(a)
+#define F_TRUNC(a) _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#define F_FROM_I(a) _mm256_cvtepi32_ps(a)
+#define F_LT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define F_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define I_SET1(a) _mm256_set1_epi32(a)
+#define I_LOADU(p) _mm256_loadu_si256((const __m256i*)(p))
+#define I_ADD(a, b) _mm256_add_epi32(a, b)
+#define I_SLLI(a, n) _mm256_slli_epi32(a, n)
+#define I_TRUNC(a) _mm256_cvttps_epi32(a)
+#define I_LT(a, b) _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a))
+#define I_ODD(a) _mm256_castsi256_ps(_mm256_cmpeq_epi32( \
+    _mm256_and_si256(a, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)))
+#define SELECT(m, a, b) _mm256_blendv_ps(b, a, m)
+#define STORE_U8(p, v) spiral_avx2_store(p, v)
+#include "spiral_simd.inc"
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512; 16 pixels per iteration
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define KERNEL_NAME spiral_row_avx512
+#define W 16
+#define W_SHIFT 6
+#define VF __m512
+#define VI __m512i
+#define F_SET1(a) _mm512_set1_ps(a)
+#define F_ADD(a, b) _mm512_add_ps(a, b)
+#define F_SUB(a, b) _mm512_sub_ps(a, b)
+#define F_MUL(a, b) _mm512_mul_ps(a, b)
+#define F_DIV(a, b) _mm512_div_ps(a, b)
+#define F_MADD(a, b, c) _mm512_fmadd_ps(a, b, c)
+#define F_SQRT(a) _mm512_sqrt_ps(a)
+#define F_MIN(a, b) _mm512_min_ps(a, b)
+#define F_MAX(a, b) _mm512_max_ps(a, b)
+#define F_ABS(a) _mm512_abs_ps(a)
+#define F_FLOOR(a) _mm512_roundscale_ps(a, \
+    _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+#define F_TRUNC(a) _mm512_roundscale_ps(a, \
+    _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#define F_FROM_I(a) _mm512_cvtepi32_ps(a)
+#define F_LT(a, b) _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define F_GT(a, b) _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define I_SET1(a) _mm512_set1_epi32(a)
+#define I_LOADU(p) _mm512_loadu_si512(p)
+#define I_ADD(a, b) _mm512_add_epi32(a, b)
+#define I_SLLI(a, n) _mm512_slli_epi32(a, n)
+#define I_TRUNC(a) _mm512_cvttps_epi32(a)
+#define I_LT(a, b) _mm512_cmplt_epi32_mask(a, b)
+#define I_ODD(a) _mm512_test_epi32_mask(a, _mm512_set1_epi32(1))
+#define SELECT(m, a, b) _mm512_mask_blend_ps(m, b, a)
+#define STORE_U8(p, v) _mm_storeu_si128((__m128i*)(p), \
+    _mm512_cvtusepi32_epi8(v))
+#include "spiral_simd.inc"
+
+#pragma GCC pop_options
+
+#endif
+
+SpiralKernel
+spiral_kernel_best(void)
+{
+#ifdef SPIRAL_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SPIRAL_KERNEL_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SPIRAL_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SPIRAL_KERNEL_SSE2;
+    }
+#endif
+
+    return SPIRAL_KERNEL_FLOAT;
+}
+
+SpiralRowKernel
+spiral_kernel_get(SpiralKernel kernel)
+{
+#ifdef SPIRAL_SIMD
+    __builtin_cpu_init();
+#endif
+
+    switch (kernel) {
+    case SPIRAL_KERNEL_AUTO:
+        return spiral_kernel_get(spiral_kernel_best());
+
+    case SPIRAL_KERNEL_SCALAR:
+        return spiral_row_scalar;
+
+    case SPIRAL_KERNEL_FLOAT:
+        return spiral_row_float;
+
+#ifdef SPIRAL_SIMD
+    case SPIRAL_KERNEL_SSE2:
+        return __builtin_cpu_supports("sse2")
+            ? spiral_row_sse2
+            : NULL;
+
+    case SPIRAL_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+            ? spiral_row_avx2
+            : NULL;
+
+    case SPIRAL_KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512f")
+            ? spiral_row_avx512
+            : NULL;
+#endif
+
+    /* Prevent compiler warning */
+    default: return NULL;
+    }
+}
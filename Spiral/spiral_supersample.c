@@ -0,0 +1,577 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/**
+ * The smallest difference between the alpha values of a pixel and its
+ * neighbours that causes it to be supersampled.
+ *
+ * Within a ramp wider than a few pixels, the neighbours differ by less than
+ * this, and the average of the samples of a pixel is its centre value, so
+ * samples are spent only where an edge is sharper than a pixel.
+ */
+#define SUPERSAMPLE_THRESHOLD 48
+
+/**
+ * The distance, in pixels, from the edge of the centre disc, the rim and the
+ * circles where the curves change direction within which all pixels are
+ * supersampled.
+ *
+ * These edges are sharper than the differences between neighbouring pixels
+ * reveal.
+ */
+#define SUPERSAMPLE_BAND 1.0
+
+/**
+ * The number of pixels whose neighbours are compared at once when looking for
+ * edges.
+ */
+#define SUPERSAMPLE_BLOCK 8
+
+/**
+ * The number of samples in a scan line of a run is a multiple of this.
+ *
+ * Runs are extended, and nearby runs are joined, so that the vectorised
+ * kernels calculate whole vectors instead of falling back to the reference
+ * implementation for the last samples of every run.
+ */
+#define SUPERSAMPLE_RUN_SAMPLES 16
+
+/**
+ * How a pixel of a scan line is calculated.
+ */
+typedef enum {
+    /** The value of the kernel is used */
+    SUPERSAMPLE_NONE,
+
+    /** The samples are calculated by the kernel in runs of pixels */
+    SUPERSAMPLE_RUN,
+
+    /** The samples are calculated by supersampler_pixel */
+    SUPERSAMPLE_PIXEL
+} SupersampleKind;
+
+/**
+ * The state of a thread supersampling scan lines.
+ */
+typedef struct {
+    /** The spiral generation */
+    const SpiralGeneration *g;
+
+    /** The spiral magnified by the number of samples, so that every pixel is
+        a sample; its centre disc and rim are not magnified, so pixels near
+        them are calculated by supersampler_pixel */
+    Spiral magnified;
+
+    /** The column and scan line of the magnified spiral of the first sample
+        of a pixel are the column and scan line of the pixel multiplied by the
+        number of samples, plus this */
+    int offset;
+
+    /** The radius of the centre disc */
+    int center_radius;
+
+    /** The length of every run is a multiple of this number of pixels, which
+        have a multiple of SUPERSAMPLE_RUN_SAMPLES samples per scan line */
+    int unit;
+
+    /** The kind of every pixel of the current scan line */
+    unsigned char *kinds;
+
+    /** The smallest and largest values of the kernel in every column of the
+        three scan lines around the current one; element 0 is the column
+        before the first pixel of the span */
+    unsigned char *low, *high;
+
+    /** One scan line of samples of a run of pixels */
+    unsigned char *samples;
+
+    /** The sums of the samples of every pixel of a run */
+    unsigned int *sums;
+} Supersampler;
+
+/**
+ * Allocates the buffers of a supersampler.
+ *
+ * @param ss
+ *     The supersampler to initialise.
+ * @param g
+ *     The spiral generation.
+ * @param width
+ *     The largest number of pixels of a scan line to supersample.
+ * @return non-zero if the buffers were allocated and 0 otherwise
+ */
+static int
+supersampler_init(Supersampler *ss, const SpiralGeneration *g,
+    unsigned int width)
+{
+    const Spiral *s = g->spiral;
+    unsigned int n = g->samples;
+
+    ss->g = g;
+    ss->center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+
+    /* The samples of a pixel are centred on the pixel, so with an even
+       number of samples the centre of the magnified spiral is moved by half
+       a sample */
+    ss->magnified = *s;
+    ss->magnified.width = n * s->width + 1 - n % 2;
+    ss->magnified.height = n * s->height + 1 - n % 2;
+    ss->magnified.radius = n * s->radius;
+    ss->offset = (2 - (int)n - (int)(n % 2)) / 2;
+
+    for (ss->unit = 1; (n * ss->unit) % SUPERSAMPLE_RUN_SAMPLES;
+            ss->unit++);
+
+    ss->kinds = malloc(width);
+    ss->low = malloc(width + 2);
+    ss->high = malloc(width + 2);
+    ss->samples = malloc(n * width);
+    ss->sums = malloc(sizeof(*ss->sums) * width);
+    if (!ss->kinds || !ss->low || !ss->high || !ss->samples || !ss->sums) {
+        free(ss->kinds);
+        free(ss->low);
+        free(ss->high);
+        free(ss->samples);
+        free(ss->sums);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Releases the buffers of a supersampler.
+ *
+ * @param ss
+ *     The supersampler.
+ */
+static void
+supersampler_release(Supersampler *ss)
+{
+    free(ss->kinds);
+    free(ss->low);
+    free(ss->high);
+    free(ss->samples);
+    free(ss->sums);
+}
+
+/**
+ * Calculates the average alpha value of samples * samples points of a pixel.
+ *
+ * The points are the centres of a regular grid covering the pixel, which is
+ * centred on the point used by the kernels.
+ *
+ * @param ss
+ *     The supersampler.
+ * @param x, y
+ *     The pixel.
+ * @return the alpha value of the pixel
+ */
+static unsigned char
+supersampler_pixel(const Supersampler *ss, int x, int y)
+{
+    const Spiral *s = ss->g->spiral;
+    unsigned int n = ss->g->samples;
+    double cx = 0.5 * s->width;
+    double cy = 0.5 * s->height;
+    unsigned int i, j, sum = 0, count = n * n;
+
+    for (j = 0; j < n; j++) {
+        double dy = y - cy + (j + 0.5) / n - 0.5;
+
+        for (i = 0; i < n; i++) {
+            double dx = x - cx + (i + 0.5) / n - 0.5;
+            double h = hypot(dx, dy);
+
+            if (h < s->radius + 1) {
+                sum += get_alpha(s, h, atan2(dy, dx), ss->center_radius);
+            }
+        }
+    }
+
+    return (unsigned char)((sum + count / 2) / count);
+}
+
+/**
+ * Calculates the average of the samples of a run of pixels with the kernel.
+ *
+ * Only the pixels of kind SUPERSAMPLE_RUN are written.
+ *
+ * @param ss
+ *     The supersampler.
+ * @param y
+ *     The scan line.
+ * @param start, end
+ *     The first and one past the last column of the run.
+ * @param kinds
+ *     The kinds of the pixels of the run.
+ * @param d
+ *     The destination; the value for column start is written to d[0].
+ */
+static void
+supersampler_run(const Supersampler *ss, int y, int start, int end,
+    const unsigned char *kinds, unsigned char *d)
+{
+    const SpiralGeneration *g = ss->g;
+    unsigned int n = g->samples;
+    unsigned int count = n * n;
+    int length = end - start;
+    int x, i, j;
+
+    memset(ss->sums, 0, sizeof(*ss->sums) * length);
+    for (j = 0; j < n; j++) {
+        g->kernel(&ss->magnified, n * y + j + ss->offset,
+            n * start + ss->offset, n * end + ss->offset, ss->samples);
+        for (x = 0; x < length; x++) {
+            const unsigned char *samples = ss->samples + n * x;
+
+            for (i = 0; i < n; i++) {
+                ss->sums[x] += samples[i];
+            }
+        }
+    }
+
+    for (x = 0; x < length; x++) {
+        if (kinds[x] == SUPERSAMPLE_RUN) {
+            d[x] = (unsigned char)((ss->sums[x] + count / 2) / count);
+        }
+    }
+}
+
+/**
+ * Determines whether SUPERSAMPLE_BLOCK pixels and their neighbours all have
+ * the same value.
+ *
+ * @param low, high
+ *     The smallest and largest values of the columns, starting with the
+ *     column before the first pixel.
+ * @return non-zero if all values are the same, and 0 otherwise
+ */
+static int
+supersampler_is_uniform(const unsigned char *low, const unsigned char *high)
+{
+    uint64_t l0, l1, h0, h1;
+
+    /* The two words overlap, so all SUPERSAMPLE_BLOCK + 2 columns are
+       compared */
+    memcpy(&l0, low, sizeof(l0));
+    memcpy(&l1, low + 2, sizeof(l1));
+    memcpy(&h0, high, sizeof(h0));
+    memcpy(&h1, high + 2, sizeof(h1));
+
+    return l0 == h0 && l1 == h1 && l0 == l1
+        && l0 == low[0] * 0x0101010101010101ULL;
+}
+
+/**
+ * Marks the pixels of a span of a scan line whose distance to the centre is
+ * within a range.
+ *
+ * @param ss
+ *     The supersampler.
+ * @param dy
+ *     The vertical distance of the scan line to the centre.
+ * @param start, end
+ *     The first and one past the last column of the span.
+ * @param inner, outer
+ *     The range of distances.
+ * @param kind
+ *     The kind to give to the pixels.
+ */
+static void
+supersampler_mark(const Supersampler *ss, double dy, int start, int end,
+    double inner, double outer, SupersampleKind kind)
+{
+    double cx = 0.5 * ss->g->spiral->width;
+    double i, o;
+    int x, side;
+
+    if (outer <= fabs(dy)) {
+        return;
+    }
+    o = sqrt(outer * outer - dy * dy);
+    i = inner > fabs(dy) ? sqrt(inner * inner - dy * dy) : 0.0;
+
+    /* The pixels form one interval on either side of the centre */
+    for (side = -1; side <= 1; side += 2) {
+        double a = side < 0 ? cx - o : cx + i;
+        double b = side < 0 ? cx - i : cx + o;
+        int first = (int)ceil(a) > start ? (int)ceil(a) : start;
+        int last = (int)floor(b) + 1 < end ? (int)floor(b) + 1 : end;
+
+        for (x = first; x < last; x++) {
+            ss->kinds[x - start] = kind;
+        }
+    }
+}
+
+/**
+ * Supersamples the pixels of a span of a scan line that lie on an edge.
+ *
+ * A pixel lies on an edge if the alpha values calculated by the kernel for it
+ * and its eight neighbours differ by at least SUPERSAMPLE_THRESHOLD. This
+ * misses edges that are sharper than the differences between neighbours
+ * reveal, so pixels within SUPERSAMPLE_BAND of the centre disc, the rim and
+ * the circles where the curves change direction are always supersampled.
+ * Other pixels keep the value of the kernel.
+ *
+ * @param ss
+ *     The supersampler.
+ * @param y
+ *     The scan line, relative to the spiral.
+ * @param start, end
+ *     The first and one past the last column, relative to the spiral.
+ * @param rows
+ *     The values calculated by the kernel for scan lines y - 1, y and y + 1,
+ *     or for y where these are outside of the spiral; element x is the value
+ *     of column x, and columns start - 1 and end must be present if they are
+ *     inside of the spiral.
+ * @param d
+ *     The destination; the value for column start is written to d[0].
+ */
+static void
+supersampler_refine(const Supersampler *ss, int y, int start, int end,
+    const unsigned char *rows[3], unsigned char *d)
+{
+    const Spiral *s = ss->g->spiral;
+    double dy = y - 0.5 * s->height;
+    double outer = s->radius + 1 + SUPERSAMPLE_BAND;
+    double extent, cx = 0.5 * s->width;
+    int x, first, last;
+    unsigned int segment;
+
+    memcpy(d, rows[1] + start, end - start);
+    memset(ss->kinds, SUPERSAMPLE_NONE, end - start);
+
+    /* Pixels further from the centre are 0 */
+    if (outer <= fabs(dy)) {
+        return;
+    }
+    extent = sqrt(outer * outer - dy * dy);
+    first = (int)floor(cx - extent) > start ? (int)floor(cx - extent) : start;
+    last = (int)ceil(cx + extent) + 1 < end ? (int)ceil(cx + extent) + 1 : end;
+
+    /* Find the edges in two passes over the values of the kernel; the first
+       and last columns are repeated */
+    for (x = first > 0 ? first - 1 : 0;
+            x < (last < s->width ? last + 1 : last); x++) {
+        unsigned char a = rows[0][x], b = rows[1][x], c = rows[2][x];
+        unsigned char low = a < b ? a : b;
+        unsigned char high = a > b ? a : b;
+
+        ss->low[x - start + 1] = low < c ? low : c;
+        ss->high[x - start + 1] = high > c ? high : c;
+    }
+    if (first == 0) {
+        ss->low[first - start] = ss->low[first - start + 1];
+        ss->high[first - start] = ss->high[first - start + 1];
+    }
+    if (last == s->width) {
+        ss->low[last - start + 1] = ss->low[last - start];
+        ss->high[last - start + 1] = ss->high[last - start];
+    }
+    for (x = first; x < last; x++) {
+        const unsigned char *l = ss->low + x - start;
+        const unsigned char *h = ss->high + x - start;
+        unsigned char low, high;
+
+        /* Most blocks of pixels and their neighbours are entirely outside
+           or inside of a curve */
+        if ((x - first) % SUPERSAMPLE_BLOCK == 0
+                && x + SUPERSAMPLE_BLOCK <= last
+                && supersampler_is_uniform(l, h)) {
+            x += SUPERSAMPLE_BLOCK - 1;
+            continue;
+        }
+
+        low = l[0] < l[1] ? l[0] : l[1];
+        high = h[0] > h[1] ? h[0] : h[1];
+        low = low < l[2] ? low : l[2];
+        high = high > h[2] ? high : h[2];
+        ss->kinds[x - start] = high - low >= SUPERSAMPLE_THRESHOLD
+            ? SUPERSAMPLE_RUN
+            : SUPERSAMPLE_NONE;
+    }
+
+    /* Where the curves change direction, their tips may be thinner than a
+       pixel and fall between the values of the kernel */
+    for (segment = 1; segment < s->alterations; segment++) {
+        double h = (double)segment * s->radius / s->alterations;
+
+        supersampler_mark(ss, dy, start, end, h - SUPERSAMPLE_BAND,
+            h + SUPERSAMPLE_BAND, SUPERSAMPLE_RUN);
+    }
+
+    /* The centre disc and the rim are cut off within a pixel, and are too
+       small in the magnified spiral */
+    supersampler_mark(ss, dy, start, end, 0.0,
+        ss->center_radius + SUPERSAMPLE_BAND, SUPERSAMPLE_PIXEL);
+    supersampler_mark(ss, dy, start, end,
+        (double)s->radius - SUPERSAMPLE_BAND, outer, SUPERSAMPLE_PIXEL);
+
+    for (x = first; x < last; x++) {
+        unsigned char *kind = ss->kinds + x - start;
+
+        /* The first samples of the first column and scan line are outside of
+           the magnified spiral */
+        if (*kind == SUPERSAMPLE_PIXEL
+                || (*kind == SUPERSAMPLE_RUN && (x == 0 || y == 0))) {
+            d[x - start] = supersampler_pixel(ss, x, y);
+            *kind = SUPERSAMPLE_NONE;
+        }
+    }
+
+    /* Calculate the samples of nearby pixels together, so that the
+       vectorised kernels are used efficiently */
+    for (x = first; x < last; x++) {
+        int run_start, run_end, tail;
+
+        if (ss->kinds[x - start] != SUPERSAMPLE_RUN) {
+            continue;
+        }
+        for (run_end = tail = x; run_end < last && run_end - tail <= ss->unit;
+                run_end++) {
+            if (ss->kinds[run_end - start] == SUPERSAMPLE_RUN) {
+                tail = run_end;
+            }
+        }
+
+        /* Pad the run to whole vectors, moving it left at the end of the
+           span */
+        run_start = x;
+        run_end = x + (tail + 1 - x + ss->unit - 1) / ss->unit * ss->unit;
+        if (run_end > end) {
+            run_start = run_end - end < run_start - start
+                ? run_start - (run_end - end)
+                : start;
+            run_end = end;
+        }
+
+        supersampler_run(ss, y, run_start, run_end,
+            ss->kinds + run_start - start, d + run_start - start);
+        x = tail;
+    }
+}
+
+/**
+ * Calculates the values of the kernel for a span of a scan line and the
+ * columns around it.
+ *
+ * The span is calculated by the same call as the column after it, but not
+ * the column before it, so that its values equal those calculated without
+ * supersampling for spans of whole vectors.
+ *
+ * @param g
+ *     The spiral generation.
+ * @param y
+ *     The scan line, relative to the spiral.
+ * @param left, right
+ *     The first and one past the last column to calculate.
+ * @param start
+ *     The first column of the span.
+ * @param row
+ *     The values; element x is the value of column x.
+ */
+static void
+supersampler_kernel(const SpiralGeneration *g, int y, int left, int right,
+    int start, unsigned char *row)
+{
+    if (left < start) {
+        g->kernel(g->spiral, y, left, start, row + left);
+    }
+    g->kernel(g->spiral, y, start, right, row + start);
+}
+
+void
+spiral_supersample_span(const SpiralGeneration *g, int y, int start, int end,
+    unsigned char *d)
+{
+    const Spiral *s = g->spiral;
+    const unsigned char *rows[3];
+    unsigned char *buffer;
+    Supersampler ss;
+    int left = start > 0 ? start - 1 : start;
+    int right = end < s->width ? end + 1 : end;
+    int i;
+
+    buffer = malloc(3 * (right - left));
+    if (!buffer || !supersampler_init(&ss, g, end - start)) {
+        free(buffer);
+        g->kernel(s, y, start, end, d);
+        return;
+    }
+
+    for (i = 0; i < 3; i++) {
+        unsigned char *row = buffer + i * (right - left) - left;
+        int line = y + i - 1;
+
+        if (line < 0 || line >= s->height) {
+            line = y;
+        }
+        supersampler_kernel(g, line, left, right, start, row);
+        rows[i] = row;
+    }
+    supersampler_refine(&ss, y, start, end, rows, d);
+
+    supersampler_release(&ss);
+    free(buffer);
+}
+
+void
+spiral_supersample_rows(const SpiralGeneration *g, int start, int end,
+    int first, int last)
+{
+    const Spiral *s = g->spiral;
+    const unsigned char *rows[3];
+    unsigned char *buffer, *ring[3];
+    Supersampler ss;
+    int left = g->region.x + first > 0 ? g->region.x + first - 1 : 0;
+    int right = g->region.x + last < s->width
+        ? g->region.x + last + 1
+        : s->width;
+    int width = right - left;
+    int top = g->region.y + start - 1;
+    int y, i;
+
+    buffer = malloc(3 * width);
+    if (!buffer || !supersampler_init(&ss, g, last - first)) {
+        free(buffer);
+        for (y = start; y < end; y++) {
+            g->kernel(s, g->region.y + y, g->region.x + first,
+                g->region.x + last, g->data + y * g->stride + first);
+        }
+        return;
+    }
+
+    /* Keep the kernel values of three consecutive scan lines, so that every
+       scan line is calculated once; scan line n is stored in ring[n % 3] */
+    for (i = 0; i < 3; i++) {
+        ring[(top + i + 3) % 3] = buffer + i * width - left;
+    }
+    for (y = top; y < top + 2; y++) {
+        if (y >= 0 && y < s->height) {
+            supersampler_kernel(g, y, left, right, g->region.x + first,
+                ring[(y + 3) % 3]);
+        }
+    }
+
+    for (y = g->region.y + start; y < g->region.y + end; y++) {
+        if (y + 1 < s->height) {
+            supersampler_kernel(g, y + 1, left, right, g->region.x + first,
+                ring[(y + 1) % 3]);
+        }
+
+        rows[0] = y > 0 ? ring[(y + 2) % 3] : ring[y % 3];
+        rows[1] = ring[y % 3];
+        rows[2] = y + 1 < s->height ? ring[(y + 1) % 3] : ring[y % 3];
+        supersampler_refine(&ss, y, g->region.x + first, g->region.x + last,
+            rows, g->data + (y - g->region.y) * g->stride + first);
+    }
+
+    supersampler_release(&ss);
+    free(buffer);
+}
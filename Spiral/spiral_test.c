@@ -0,0 +1,1015 @@
+/*
+ * A test of the spiral kernels.
+ *
+ * Every kernel supported by the CPU generates spirals for a matrix of sizes
+ * and parameters, which are compared pixel by pixel to the spirals generated
+ * by the reference kernel. The test fails if any pixel differs by more than
+ * the bound of its kernel.
+ *
+ * Every kernel then generates tiny spirals, whose centre disc reaches their
+ * rim, which are compared to a reference calculated pixel by pixel by the
+ * reference kernel, without the symmetries and the classification of
+ * uniform tiles used to generate spirals.
+ *
+ * The per pixel reference is also compared to regions and bands rendered by
+ * spiral_render_into into padded buffers, to spirals created in batches from
+ * a separable phase, and, reduced by the box filter, to the levels of detail
+ * of spirals created with mipmaps.
+ *
+ * Spirals stored in tiles are copied back to scan lines and sampled by
+ * spiral_sample at the centres of their pixels, which must give the pixels
+ * of the same spiral stored in scan lines exactly, and along rotated lines,
+ * which must match a bilinear interpolation of them.
+ *
+ * Finally, distance fields are thresholded like the reference kernel applies
+ * the line width, and compared to the spirals generated by it.
+ *
+ * The result of every kernel is written to stdout, and the exit status is 0
+ * if all kernels are within their bounds.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiral_private.h"
+
+/**
+ * The largest difference, in alpha levels, allowed between a pixel
+ * calculated by a single precision kernel and by the reference kernel.
+ *
+ * The portable and the vectorised single precision kernels use a polynomial
+ * atan2, which moves the edges of the lines by a small fraction of a pixel.
+ */
+#define TEST_MAX_ERROR_SIMD 2
+
+/**
+ * The dimensions of the spirals compared; odd and non-square dimensions
+ * exercise the symmetries and the pixels at the ends of the vectors.
+ */
+static const unsigned int test_sizes[][2] = {
+    {1024, 1024}, {1023, 1023}, {517, 263}};
+
+/**
+ * The largest difference, in alpha levels, allowed between a thresholded
+ * distance field and a spiral calculated by the reference kernel.
+ *
+ * The 16 bit distances move the edges of the lines by less than a
+ * hundredth of an alpha level, which may still round to the next level.
+ */
+#define TEST_MAX_ERROR_DISTANCE 1
+
+/**
+ * The largest difference, in alpha levels, allowed between a spiral created
+ * by spiral_create_batch and by the reference kernel.
+ *
+ * The grid stores the polar coordinates in single precision, which moves the
+ * edges of the lines by a small fraction of a pixel.
+ */
+#define TEST_MAX_ERROR_BATCH 1
+
+/**
+ * The largest difference, in alpha levels, allowed between spiral_sample
+ * and a bilinear interpolation in double precision.
+ *
+ * spiral_sample truncates the weights to 8 bits, like the texture units of
+ * GPUs.
+ */
+#define TEST_MAX_ERROR_SAMPLE 2
+
+/**
+ * The dimensions of the spirals stored in tiles; they include dimensions
+ * that are not multiples of the tiles, and spirals smaller than a tile.
+ */
+static const unsigned int test_tiled_sizes[][2] = {
+    {1024, 1024}, {517, 263}, {65, 3}, {1, 1}};
+
+/**
+ * The angles, in degrees, of the lines along which tiled spirals are
+ * sampled.
+ */
+static const double test_angles[] = {0.0, 30.0, 90.0, 137.0, 270.0};
+
+/**
+ * The bytes added to every scan line of the buffers rendered into by
+ * spiral_render_into, and the value they are filled with; the pixels outside
+ * of the region rendered must keep this value.
+ */
+#define TEST_PADDING 13
+#define TEST_GUARD 0xa5
+
+/**
+ * The number of scan lines of the bands rendered by spiral_render_into.
+ */
+#define TEST_BAND 37
+
+/**
+ * The largest dimension of the tiny spirals, and the largest radius.
+ */
+#define TEST_TINY_SIZE 9
+#define TEST_TINY_RADIUS 4
+
+static const unsigned int test_curves[] = {3, 10, 12, 30};
+static const unsigned int test_alterations[] = {1, 10, 30};
+
+/**
+ * The twists and line widths compared, from smooth ramps away from the
+ * centre to edges sharper than a pixel everywhere.
+ */
+static const double test_shapes[][2] = {
+    {0.0, 0.2}, {5.0, 0.2}, {-30.0, 0.2}, {5.0, 0.45}};
+
+/**
+ * The difference between the spirals generated by a kernel and by the
+ * reference kernel.
+ */
+typedef struct {
+    /** The numbers of compared and differing pixels */
+    double pixels, differing;
+
+    /** The largest absolute difference */
+    int max;
+} TestError;
+
+/**
+ * Adds the difference between two buffers to an error.
+ *
+ * @param a, b
+ *     The buffers.
+ * @param size
+ *     The size of the buffers.
+ * @param error
+ *     The difference is added to this.
+ */
+static void
+test_difference(const unsigned char *a, const unsigned char *b, size_t size,
+    TestError *error)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        int difference = abs(a[i] - b[i]);
+
+        if (difference) {
+            error->differing++;
+            if (difference > error->max) {
+                error->max = difference;
+            }
+        }
+    }
+    error->pixels += size;
+}
+
+/**
+ * Calculates a spiral pixel by pixel by the reference kernel.
+ *
+ * @param width, height
+ *     The dimensions of the spiral.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @return the pixels in scan lines, which must be freed, or NULL if memory
+ *     could not be allocated
+ */
+static unsigned char*
+test_reference(unsigned int width, unsigned int height,
+    const SpiralParameters *parameters)
+{
+    unsigned char *data = malloc((size_t)width * height);
+    Spiral spiral;
+    unsigned int y;
+
+    if (!data) {
+        return NULL;
+    }
+
+    memset(&spiral, 0, sizeof(spiral));
+    spiral.width = width;
+    spiral.height = height;
+    spiral.depth = 1;
+    spiral.levels = 1;
+    spiral.curves = parameters->curves;
+    spiral.alterations = parameters->alterations;
+    spiral.radius = parameters->radius;
+    spiral.twist = parameters->twist;
+    spiral.line_width = parameters->line_width;
+    for (y = 0; y < height; y++) {
+        spiral_row_scalar(&spiral, y, 0, width, data + (size_t)y * width);
+    }
+
+    return data;
+}
+
+/**
+ * Returns the parameters of a spiral of the matrix.
+ *
+ * @param width, height
+ *     The dimensions of the spiral, which give its radius.
+ * @param curves
+ *     The index of the number of curves in test_curves.
+ * @param shape
+ *     The index of the twist and line width in test_shapes.
+ * @return the parameters
+ */
+static SpiralParameters
+test_parameters(unsigned int width, unsigned int height, unsigned int curves,
+    unsigned int shape)
+{
+    SpiralParameters parameters;
+
+    parameters.curves = test_curves[curves];
+    parameters.alterations = test_alterations[1];
+    parameters.radius = (width < height ? width : height) / 2 - 1;
+    parameters.twist = test_shapes[shape][0];
+    parameters.line_width = test_shapes[shape][1];
+
+    return parameters;
+}
+
+/**
+ * Reduces a level of detail to the next one by the box filter.
+ *
+ * A dimension of 1 is repeated, and the last column or scan line of an odd
+ * dimension is dropped.
+ *
+ * @param data, width, height
+ *     The level.
+ * @param d
+ *     Receives the next level, which has half the dimensions, but at least
+ *     one pixel along every axis.
+ */
+static void
+test_reduce(const unsigned char *data, unsigned int width,
+    unsigned int height, unsigned char *d)
+{
+    unsigned int w = width > 1 ? width / 2 : 1;
+    unsigned int h = height > 1 ? height / 2 : 1;
+    unsigned int x, y;
+
+    for (y = 0; y < h; y++) {
+        const unsigned char *a = data + (size_t)(2 * y) * width;
+        const unsigned char *b = data
+            + (size_t)(2 * y + 1 < height ? 2 * y + 1 : 2 * y) * width;
+
+        for (x = 0; x < w; x++) {
+            unsigned int x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+
+            d[y * w + x] = (a[2 * x] + a[x1] + b[2 * x] + b[x1] + 2) >> 2;
+        }
+    }
+}
+
+/**
+ * Compares every level of detail of a spiral to a reference reduced by the
+ * box filter.
+ *
+ * @param spiral
+ *     The spiral.
+ * @param reference
+ *     The first level of the reference; this buffer is reused for the other
+ *     levels.
+ * @param levels
+ *     The number of levels the spiral must have.
+ * @param error
+ *     The difference is added to this.
+ * @return non-zero if the levels were compared and 0 if the spiral does not
+ *     have the expected number of levels
+ */
+static int
+test_levels(Spiral *spiral, unsigned char *reference, unsigned int levels,
+    TestError *error)
+{
+    unsigned int width = spiral_get_width(spiral);
+    unsigned int height = spiral_get_height(spiral);
+    unsigned int level;
+
+    if (spiral_get_levels(spiral) != levels) {
+        return 0;
+    }
+
+    for (level = 0; level < levels; level++) {
+        if (level > 0) {
+            test_reduce(reference, width, height, reference);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        test_difference(reference, spiral_get_level_data(spiral, level),
+            (size_t)width * height, error);
+    }
+
+    return 1;
+}
+
+/**
+ * Returns the number of levels of detail of a spiral with a full chain.
+ *
+ * @param width, height
+ *     The dimensions of the first level.
+ * @return the number of levels, down to a single pixel
+ */
+static unsigned int
+test_level_count(unsigned int width, unsigned int height)
+{
+    unsigned int levels = 1;
+
+    while (width > 1 || height > 1) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        levels++;
+    }
+
+    return levels;
+}
+
+/**
+ * Compares a buffer rendered into by spiral_render_into to the reference.
+ *
+ * @param buffer
+ *     The buffer, which covers the whole spiral, with scan lines of
+ *     width + TEST_PADDING bytes.
+ * @param reference, width, height
+ *     The reference and its dimensions.
+ * @param region
+ *     The region that was rendered; all other bytes of the buffer must be
+ *     TEST_GUARD.
+ * @param error
+ *     The difference is added to this.
+ */
+static void
+test_region(const unsigned char *buffer, const unsigned char *reference,
+    unsigned int width, unsigned int height, const SpiralRegion *region,
+    TestError *error)
+{
+    size_t stride = width + TEST_PADDING;
+    unsigned int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < stride; x++) {
+            unsigned char expected = x >= region->x
+                    && x < region->x + region->width
+                    && y >= region->y && y < region->y + region->height
+                ? reference[(size_t)y * width + x]
+                : TEST_GUARD;
+
+            test_difference(&expected, buffer + y * stride + x, 1, error);
+        }
+    }
+}
+
+/**
+ * Compares regions and bands rendered by a kernel through
+ * spiral_render_into to the per pixel reference, for the sizes and
+ * parameters of the matrix.
+ *
+ * @param kernel
+ *     The kernel to test; this must be supported.
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all regions were rendered and 0 otherwise
+ */
+static int
+test_render_into(SpiralKernel kernel, TestError *error)
+{
+    unsigned int i, j, k, r, y;
+
+    memset(error, 0, sizeof(*error));
+    spiral_set_kernel(kernel);
+    for (i = 0; i < sizeof(test_sizes) / sizeof(*test_sizes); i++) {
+        unsigned int width = test_sizes[i][0], height = test_sizes[i][1];
+        size_t stride = width + TEST_PADDING;
+        SpiralRegion regions[] = {
+            {0, 0, width, height},
+            {width / 3, height / 4, width / 2, height / 3},
+            {width / 2 - 1, height / 2 - 1, 3, 3},
+            {width - 5, height - 3, 5, 3},
+            {0, height / 2, width, 1}};
+        SpiralRegion whole = {0, 0, width, height};
+        unsigned char *buffer = malloc(stride * height);
+
+        if (!buffer) {
+            return 0;
+        }
+        for (j = 0; j < sizeof(test_curves) / sizeof(*test_curves); j++) {
+            for (k = 0; k < sizeof(test_shapes) / sizeof(*test_shapes);
+                    k++) {
+                SpiralParameters parameters = test_parameters(width, height,
+                    j, k);
+                unsigned char *reference = test_reference(width, height,
+                    &parameters);
+                int rendered = reference != NULL;
+
+                for (r = 0; rendered && r < sizeof(regions) / sizeof(*regions);
+                        r++) {
+                    memset(buffer, TEST_GUARD, stride * height);
+                    rendered = spiral_render_into(
+                        buffer + regions[r].y * stride + regions[r].x,
+                        stride, width, height, &regions[r], &parameters);
+                    test_region(buffer, reference, width, height,
+                        &regions[r], error);
+                }
+
+                /* The whole spiral in bands, like a spiral updated over
+                   several frames */
+                memset(buffer, TEST_GUARD, stride * height);
+                for (y = 0; rendered && y < height; y += TEST_BAND) {
+                    SpiralRegion band = {0, y, width,
+                        height - y < TEST_BAND ? height - y : TEST_BAND};
+
+                    rendered = spiral_render_into(buffer + y * stride,
+                        stride, width, height, &band, &parameters);
+                }
+                if (rendered) {
+                    test_region(buffer, reference, width, height, &whole,
+                        error);
+                }
+
+                free(reference);
+                if (!rendered) {
+                    free(buffer);
+                    return 0;
+                }
+            }
+        }
+        free(buffer);
+    }
+
+    return 1;
+}
+
+/**
+ * Compares the levels of detail of spirals created by a kernel with mipmaps
+ * to the per pixel reference, for the sizes and parameters of the matrix.
+ *
+ * @param kernel
+ *     The kernel to test; this must be supported.
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_mipmaps(SpiralKernel kernel, TestError *error)
+{
+    unsigned int i, j, k;
+
+    memset(error, 0, sizeof(*error));
+    spiral_set_kernel(kernel);
+    for (i = 0; i < sizeof(test_sizes) / sizeof(*test_sizes); i++) {
+        unsigned int width = test_sizes[i][0], height = test_sizes[i][1];
+
+        for (j = 0; j < sizeof(test_curves) / sizeof(*test_curves); j++) {
+            for (k = 0; k < sizeof(test_shapes) / sizeof(*test_shapes);
+                    k++) {
+                SpiralParameters parameters = test_parameters(width, height,
+                    j, k);
+                unsigned char *reference = test_reference(width, height,
+                    &parameters);
+                Spiral *spiral = spiral_create_with_mipmaps(width, height,
+                    &parameters);
+                int compared = spiral && reference
+                    && test_levels(spiral, reference,
+                        test_level_count(width, height), error);
+
+                free(reference);
+                spiral_free(spiral);
+                if (!compared) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Compares spirals created in batches, with and without mipmaps, to the per
+ * pixel reference, for the sizes and parameters of the matrix.
+ *
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_batch(TestError *error)
+{
+    enum {
+        COUNT = sizeof(test_curves) / sizeof(*test_curves)
+            * (sizeof(test_shapes) / sizeof(*test_shapes))
+    };
+    SpiralParameters parameters[COUNT];
+    Spiral *spirals[COUNT];
+    unsigned int i, j, mipmaps;
+    int compared = 1;
+
+    memset(error, 0, sizeof(*error));
+    for (i = 0; compared && i < sizeof(test_sizes) / sizeof(*test_sizes);
+            i++) {
+        unsigned int width = test_sizes[i][0], height = test_sizes[i][1];
+        SpiralGrid *grid = spiral_grid_create(width, height);
+
+        if (!grid) {
+            return 0;
+        }
+        for (j = 0; j < COUNT; j++) {
+            parameters[j] = test_parameters(width, height,
+                j / (sizeof(test_shapes) / sizeof(*test_shapes)),
+                j % (sizeof(test_shapes) / sizeof(*test_shapes)));
+        }
+
+        for (mipmaps = 0; compared && mipmaps < 2; mipmaps++) {
+            compared = mipmaps
+                ? spiral_create_batch_with_mipmaps(grid, parameters, COUNT,
+                    spirals)
+                : spiral_create_batch(grid, parameters, COUNT, spirals);
+            for (j = 0; compared && j < COUNT; j++) {
+                unsigned char *reference = test_reference(width, height,
+                    &parameters[j]);
+
+                compared = reference && test_levels(spirals[j], reference,
+                    mipmaps ? test_level_count(width, height) : 1, error);
+                free(reference);
+            }
+            for (j = 0; j < COUNT; j++) {
+                spiral_free(spirals[j]);
+            }
+        }
+        spiral_grid_free(grid);
+    }
+
+    return compared;
+}
+
+/**
+ * Interpolates a spiral stored in scan lines bilinearly, like a texture
+ * clamped to its edges.
+ *
+ * @param data, width, height
+ *     The spiral.
+ * @param x, y
+ *     The point, in pixels from the top left corner of the spiral.
+ * @return the value at the point
+ */
+static double
+test_bilinear(const unsigned char *data, unsigned int width,
+    unsigned int height, double x, double y)
+{
+    double u = x - 0.5, v = y - 0.5, fu, fv;
+    unsigned int x0, y0, x1, y1;
+
+    u = u < 0.0 ? 0.0 : u > width - 1 ? width - 1 : u;
+    v = v < 0.0 ? 0.0 : v > height - 1 ? height - 1 : v;
+    x0 = (unsigned int)u;
+    y0 = (unsigned int)v;
+    x1 = x0 + (x0 < width - 1);
+    y1 = y0 + (y0 < height - 1);
+    fu = u - x0;
+    fv = v - y0;
+
+    return (data[y0 * width + x0] * (1.0 - fu) + data[y0 * width + x1] * fu)
+            * (1.0 - fv)
+        + (data[y1 * width + x0] * (1.0 - fu) + data[y1 * width + x1] * fu)
+            * fv;
+}
+
+/**
+ * Compares spirals stored in tiles to the same spirals stored in scan
+ * lines.
+ *
+ * spiral_copy_rows and spiral_sample at the centres of the pixels, along
+ * every scan line and every column, must give the pixels exactly, and are
+ * added to exact. spiral_sample along lines at test_angles through points
+ * between pixels, which start and end outside of the spiral, must give the
+ * values sampled from scan lines exactly, and is compared to test_bilinear
+ * and added to sampled.
+ *
+ * @param exact, sampled
+ *     Receive the differences.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_tiled(TestError *exact, TestError *sampled)
+{
+    unsigned int i, j, x, y;
+    int compared = 1;
+
+    memset(exact, 0, sizeof(*exact));
+    memset(sampled, 0, sizeof(*sampled));
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    for (i = 0; compared
+            && i < sizeof(test_tiled_sizes) / sizeof(*test_tiled_sizes);
+            i++) {
+        unsigned int width = test_tiled_sizes[i][0];
+        unsigned int height = test_tiled_sizes[i][1];
+        unsigned int count = 2 * (width > height ? width : height);
+        unsigned int side = width < height ? width : height;
+        SpiralParameters parameters = test_parameters(width, height, 1, 1);
+        unsigned char *copy = malloc((size_t)width * height);
+        unsigned char *line = malloc(2 * (size_t)count);
+        const unsigned char *data;
+        Spiral *rows, *tiled;
+
+        /* The radius of the smallest spirals is at least one pixel */
+        parameters.radius = side > 4 ? side / 2 - 1 : 1;
+        rows = spiral_create_with_parameters(width, height, &parameters);
+        spiral_set_layout(SPIRAL_LAYOUT_TILED);
+        tiled = spiral_create_with_parameters(width, height, &parameters);
+        spiral_set_layout(SPIRAL_LAYOUT_ROWS);
+        compared = rows && tiled && copy && line
+            && spiral_get_data_layout(tiled) == SPIRAL_LAYOUT_TILED
+            && spiral_copy_rows(tiled, copy, width);
+        data = compared ? spiral_get_data(rows) : NULL;
+
+        if (compared) {
+            test_difference(data, copy, (size_t)width * height, exact);
+            for (y = 0; y < height; y++) {
+                spiral_sample(tiled, 0.5, y + 0.5, 1.0, 0.0, width, line);
+                test_difference(data + y * width, line, width, exact);
+            }
+            for (x = 0; x < width; x++) {
+                spiral_sample(tiled, x + 0.5, 0.5, 0.0, 1.0, height, line);
+                for (y = 0; y < height; y++) {
+                    test_difference(data + y * width + x, line + y, 1,
+                        exact);
+                }
+            }
+        }
+
+        /* Lines through the centre of the spiral, offset by a fraction of
+           a pixel, that start and end half their length from it */
+        for (j = 0; compared && j < sizeof(test_angles) / sizeof(*test_angles);
+                j++) {
+            double angle = test_angles[j] * M_PI / 180.0;
+            double dx = cos(angle), dy = sin(angle);
+            double x0 = 0.5 * width + 0.37 - 0.5 * count * dx;
+            double y0 = 0.5 * height + 0.19 - 0.5 * count * dy;
+            unsigned int k;
+
+            /* The second half of line receives the samples from scan lines */
+            spiral_sample(rows, x0, y0, dx, dy, count, line + count);
+            spiral_sample(tiled, x0, y0, dx, dy, count, line);
+            test_difference(line + count, line, count, exact);
+            for (k = 0; k < count; k++) {
+                double value = test_bilinear(data, width, height,
+                    x0 + k * dx, y0 + k * dy);
+                int difference = abs(line[k] - (int)floor(value + 0.5));
+
+                sampled->pixels++;
+                if (difference) {
+                    sampled->differing++;
+                    if (difference > sampled->max) {
+                        sampled->max = difference;
+                    }
+                }
+            }
+        }
+
+        spiral_free(rows);
+        spiral_free(tiled);
+        free(copy);
+        free(line);
+    }
+
+    return compared;
+}
+
+/**
+ * Compares a spiral generated by a kernel to one generated by the reference
+ * kernel.
+ *
+ * @param kernel
+ *     The kernel to test; this must be supported.
+ * @param width, height
+ *     The dimensions of the spiral.
+ * @param parameters
+ *     The parameters of the spiral.
+ * @param error
+ *     The difference is added to this.
+ * @return non-zero if the spirals were compared and 0 otherwise
+ */
+static int
+test_compare(SpiralKernel kernel, unsigned int width, unsigned int height,
+    const SpiralParameters *parameters, TestError *error)
+{
+    Spiral *reference, *spiral;
+
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    reference = spiral_create_with_parameters(width, height, parameters);
+    spiral_set_kernel(kernel);
+    spiral = spiral_create_with_parameters(width, height, parameters);
+    if (!reference || !spiral) {
+        spiral_free(reference);
+        spiral_free(spiral);
+        return 0;
+    }
+
+    test_difference(spiral_get_data(reference), spiral_get_data(spiral),
+        spiral_get_size(spiral), error);
+
+    spiral_free(reference);
+    spiral_free(spiral);
+
+    return 1;
+}
+
+/**
+ * Compares the spirals generated by a kernel for the whole matrix to those
+ * generated by the reference kernel.
+ *
+ * @param kernel
+ *     The kernel to test; this must be supported.
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_kernel(SpiralKernel kernel, TestError *error)
+{
+    unsigned int i, j, k, l;
+
+    memset(error, 0, sizeof(*error));
+    for (i = 0; i < sizeof(test_sizes) / sizeof(*test_sizes); i++) {
+        unsigned int width = test_sizes[i][0], height = test_sizes[i][1];
+
+        for (j = 0; j < sizeof(test_curves) / sizeof(*test_curves); j++) {
+            for (k = 0; k < sizeof(test_alterations)
+                    / sizeof(*test_alterations); k++) {
+                for (l = 0; l < sizeof(test_shapes) / sizeof(*test_shapes);
+                        l++) {
+                    SpiralParameters parameters;
+
+                    parameters.curves = test_curves[j];
+                    parameters.alterations = test_alterations[k];
+                    parameters.radius =
+                        (width < height ? width : height) / 2 - 1;
+                    parameters.twist = test_shapes[l][0];
+                    parameters.line_width = test_shapes[l][1];
+                    if (!test_compare(kernel, width, height, &parameters,
+                            error)) {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Compares the tiny spirals generated by a kernel to the per pixel
+ * reference.
+ *
+ * @param kernel
+ *     The kernel to test; this must be supported.
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_tiny(SpiralKernel kernel, TestError *error)
+{
+    unsigned int width, height, radius, i;
+
+    memset(error, 0, sizeof(*error));
+    spiral_set_kernel(kernel);
+    for (width = 1; width <= TEST_TINY_SIZE; width++) {
+        for (height = 1; height <= TEST_TINY_SIZE; height++) {
+            for (radius = 1; radius <= TEST_TINY_RADIUS; radius++) {
+                for (i = 0; i < sizeof(test_curves) / sizeof(*test_curves);
+                        i++) {
+                    SpiralParameters parameters;
+                    unsigned char *reference;
+                    Spiral *spiral;
+
+                    parameters.curves = test_curves[i];
+                    parameters.alterations = test_alterations[1];
+                    parameters.radius = radius;
+                    parameters.twist = test_shapes[1][0];
+                    parameters.line_width = test_shapes[1][1];
+                    spiral = spiral_create_with_parameters(width, height,
+                        &parameters);
+                    reference = test_reference(width, height, &parameters);
+                    if (!spiral || !reference) {
+                        spiral_free(spiral);
+                        free(reference);
+                        return 0;
+                    }
+                    test_difference(reference, spiral_get_data(spiral),
+                        spiral_get_size(spiral), error);
+                    free(reference);
+                    spiral_free(spiral);
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Thresholds a pixel of a distance field like get_alpha.
+ *
+ * @param s
+ *     The distance field, whose depth is 16 bits.
+ * @param line_width
+ *     The width of the lines.
+ * @param x, y
+ *     The pixel.
+ * @return the alpha value of the pixel
+ */
+static unsigned int
+test_threshold(Spiral *s, double line_width, unsigned int x, unsigned int y)
+{
+    const uint16_t *field = spiral_get_data(s);
+    double distance = field[(size_t)y * s->width + x] / (double)UINT16_MAX;
+    double h = hypot(x - 0.5 * s->width, y - 0.5 * s->height);
+    int center_radius = (int)sqrt(s->curves * CENTER_RADIUS);
+    unsigned int alpha = 0;
+
+    if (h >= s->radius + 1) {
+        return 0;
+    }
+    if (distance < line_width + ANTI_ALIAS_BORDER) {
+        alpha = distance > line_width
+            ? (unsigned int)(255
+                - 255 * (distance - line_width) / ANTI_ALIAS_BORDER)
+            : 255;
+    }
+    if ((int)h < center_radius) {
+        alpha = 255;
+    }
+    else if ((int)h == center_radius) {
+        alpha = (unsigned int)(alpha * (h - center_radius)
+            + 255 * (1.0 - (h - center_radius)));
+    }
+    if ((int)h == (int)s->radius) {
+        alpha = (unsigned int)(alpha * (h - s->radius));
+    }
+
+    return alpha;
+}
+
+/**
+ * Compares thresholded distance fields to the spirals generated by the
+ * reference kernel, for the sizes and parameters of the matrix.
+ *
+ * @param error
+ *     Receives the difference.
+ * @return non-zero if all spirals were compared and 0 otherwise
+ */
+static int
+test_distance(TestError *error)
+{
+    unsigned int i, j, k, x, y;
+
+    memset(error, 0, sizeof(*error));
+    spiral_set_kernel(SPIRAL_KERNEL_SCALAR);
+    for (i = 0; i < sizeof(test_sizes) / sizeof(*test_sizes); i++) {
+        unsigned int width = test_sizes[i][0], height = test_sizes[i][1];
+
+        for (j = 0; j < sizeof(test_curves) / sizeof(*test_curves); j++) {
+            for (k = 0; k < sizeof(test_shapes) / sizeof(*test_shapes);
+                    k++) {
+                SpiralParameters parameters;
+                const unsigned char *d;
+                Spiral *spiral, *field;
+
+                parameters.curves = test_curves[j];
+                parameters.alterations = test_alterations[1];
+                parameters.radius = (width < height ? width : height) / 2 - 1;
+                parameters.twist = test_shapes[k][0];
+                parameters.line_width = test_shapes[k][1];
+                spiral = spiral_create_with_parameters(width, height,
+                    &parameters);
+                field = spiral_create_distance(width, height, &parameters,
+                    16);
+                if (!spiral || !field) {
+                    spiral_free(spiral);
+                    spiral_free(field);
+                    return 0;
+                }
+
+                d = spiral_get_data(spiral);
+                for (y = 0; y < height; y++) {
+                    for (x = 0; x < width; x++) {
+                        unsigned char alpha = test_threshold(field,
+                            parameters.line_width, x, y);
+
+                        test_difference(&alpha, d + y * width + x, 1, error);
+                    }
+                }
+                spiral_free(spiral);
+                spiral_free(field);
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Writes the result of a comparison.
+ *
+ * @param name
+ *     The name of the kernel or of the case.
+ * @param result
+ *     The result of the comparison, which is non-zero if it was made.
+ * @param error
+ *     The difference.
+ * @param bound
+ *     The largest difference allowed.
+ * @return non-zero if the comparison failed and 0 otherwise
+ */
+static int
+test_report(const char *name, int result, const TestError *error, int bound)
+{
+    if (!result) {
+        printf("%-8s FAILED: unable to create or compare spirals\n", name);
+        return 1;
+    }
+
+    printf("%-8s %s: max error %d (bound %d), %.4f%% of pixels differ\n",
+        name, error->max > bound ? "FAILED" : "ok", error->max, bound,
+        100.0 * error->differing / error->pixels);
+
+    return error->max > bound;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct {
+        SpiralKernel kernel;
+        const char *name;
+        int bound;
+    } kernels[] = {
+        {SPIRAL_KERNEL_FLOAT, "float", TEST_MAX_ERROR_SIMD},
+        {SPIRAL_KERNEL_SSE2, "sse2", TEST_MAX_ERROR_SIMD},
+        {SPIRAL_KERNEL_AVX2, "avx2", TEST_MAX_ERROR_SIMD},
+        {SPIRAL_KERNEL_AVX512, "avx512", TEST_MAX_ERROR_SIMD}};
+    TestError error, sampled;
+    unsigned int i;
+    int failed = 0, result;
+
+    spiral_set_samples(1);
+    for (i = 0; i < sizeof(kernels) / sizeof(*kernels); i++) {
+        if (!spiral_set_kernel(kernels[i].kernel)) {
+            printf("%-8s unsupported, skipped\n", kernels[i].name);
+            continue;
+        }
+        failed |= test_report(kernels[i].name,
+            test_kernel(kernels[i].kernel, &error), &error, kernels[i].bound);
+    }
+
+    /* The reference kernel must match its pixels exactly */
+    printf("Tiny spirals against the per pixel reference:\n");
+    failed |= test_report("scalar", test_tiny(SPIRAL_KERNEL_SCALAR, &error),
+        &error, 0);
+    for (i = 0; i < sizeof(kernels) / sizeof(*kernels); i++) {
+        if (!spiral_set_kernel(kernels[i].kernel)) {
+            continue;
+        }
+        failed |= test_report(kernels[i].name,
+            test_tiny(kernels[i].kernel, &error), &error, kernels[i].bound);
+    }
+
+    printf("Regions and bands rendered into buffers against the per pixel "
+        "reference:\n");
+    failed |= test_report("scalar",
+        test_render_into(SPIRAL_KERNEL_SCALAR, &error), &error, 0);
+    for (i = 0; i < sizeof(kernels) / sizeof(*kernels); i++) {
+        if (!spiral_set_kernel(kernels[i].kernel)) {
+            continue;
+        }
+        failed |= test_report(kernels[i].name,
+            test_render_into(kernels[i].kernel, &error), &error,
+            kernels[i].bound);
+    }
+
+    printf("Levels of detail against the reduced per pixel reference:\n");
+    failed |= test_report("scalar",
+        test_mipmaps(SPIRAL_KERNEL_SCALAR, &error), &error, 0);
+    for (i = 0; i < sizeof(kernels) / sizeof(*kernels); i++) {
+        if (!spiral_set_kernel(kernels[i].kernel)) {
+            continue;
+        }
+        failed |= test_report(kernels[i].name,
+            test_mipmaps(kernels[i].kernel, &error), &error,
+            kernels[i].bound);
+    }
+
+    printf("Batches from a separable phase against the per pixel "
+        "reference:\n");
+    failed |= test_report("batch", test_batch(&error), &error,
+        TEST_MAX_ERROR_BATCH);
+
+    printf("Spirals stored in tiles against scan lines:\n");
+    result = test_tiled(&error, &sampled);
+    failed |= test_report("tiled", result, &error, 0);
+    failed |= test_report("sample", result, &sampled, TEST_MAX_ERROR_SAMPLE);
+
+    printf("Thresholded distance fields against the reference kernel:\n");
+    failed |= test_report("distance", test_distance(&error), &error,
+        TEST_MAX_ERROR_DISTANCE);
+
+    return failed;
+}